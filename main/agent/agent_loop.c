@@ -2,21 +2,37 @@
 #include "agent/context_builder.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "bus/channel_dispatch.h"
 #include "llm/llm_proxy.h"
 #include "memory/session_mgr.h"
 #include "tools/tool_registry.h"
+#include "tools/tool_executor.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_heap_caps.h"
 #include "esp_random.h"
+#include "freertos/semphr.h"
 #include "cJSON.h"
 
 static const char *TAG = "agent";
 
 #define TOOL_OUTPUT_SIZE  (8 * 1024)
 
+/* PSRAM each worker holds for its lifetime, counting its kept-alive LLM
+ * connection (llm_proxy pools one per worker) */
+#define WORKER_PSRAM_BYTES  (MIMI_CONTEXT_BUF_SIZE + MIMI_MAX_TOOL_CALLS * TOOL_OUTPUT_SIZE + \
+                             MIMI_TLS_CONN_PSRAM)
+
+typedef struct {
+    int   id;
+    char *system_prompt;    /* MIMI_CONTEXT_BUF_SIZE */
+    char *tool_output;      /* TOOL_OUTPUT_SIZE per tool call */
+} agent_worker_t;
+
 /* Build the assistant content array from llm_response_t for the messages history.
  * Returns a cJSON array with text and tool_use blocks. */
 static cJSON *build_assistant_content(const llm_response_t *resp)
@@ -52,157 +68,361 @@ static cJSON *build_assistant_content(const llm_response_t *resp)
     return content;
 }
 
-/* Build the user message with tool_result blocks */
-static cJSON *build_tool_results(const llm_response_t *resp, char *tool_output, size_t tool_output_size)
+/* tool_start / tool_end for channels that stream the turn */
+static void tool_event(const mimi_msg_t *msg, channel_event_type_t type,
+                       const llm_tool_call_t *call, bool ok)
 {
-    cJSON *content = cJSON_CreateArray();
+    channel_event_t ev = {
+        .type = type,
+        .text = call->name,
+        .len = strlen(call->name),
+        .id = call->id,
+        .ok = ok,
+    };
+    channel_dispatch_event(msg->channel, msg->chat_id, &ev);
+}
 
+/* Build the user message with tool_result blocks, in call order.
+ * Each call gets its own TOOL_OUTPUT_SIZE slice of tool_output, so
+ * independent calls can run concurrently. */
+static cJSON *build_tool_results(const mimi_msg_t *msg, bool live,
+                                 const llm_response_t *resp, char *tool_output)
+{
+    tool_job_t jobs[MIMI_MAX_TOOL_CALLS];
     for (int i = 0; i < resp->call_count; i++) {
-        const llm_tool_call_t *call = &resp->calls[i];
+        jobs[i] = (tool_job_t){
+            .name = resp->calls[i].name,
+            .input_json = resp->calls[i].input,
+            .output = tool_output + i * TOOL_OUTPUT_SIZE,
+            .output_size = TOOL_OUTPUT_SIZE,
+        };
+    }
 
-        /* Execute tool */
-        tool_output[0] = '\0';
-        tool_registry_execute(call->name, call->input, tool_output, tool_output_size);
+    /* Execute tools */
+    if (live) {
+        for (int i = 0; i < resp->call_count; i++) {
+            tool_event(msg, CHANNEL_EVENT_TOOL_START, &resp->calls[i], false);
+        }
+    }
+    tool_executor_run(jobs, resp->call_count);
 
-        ESP_LOGI(TAG, "Tool %s result: %d bytes", call->name, (int)strlen(tool_output));
+    cJSON *content = cJSON_CreateArray();
+    for (int i = 0; i < resp->call_count; i++) {
+        ESP_LOGI(TAG, "Tool %s result: %d bytes", jobs[i].name, (int)strlen(jobs[i].output));
+        if (live) tool_event(msg, CHANNEL_EVENT_TOOL_END, &resp->calls[i], jobs[i].err == ESP_OK);
 
         /* Build tool_result block */
         cJSON *result_block = cJSON_CreateObject();
         cJSON_AddStringToObject(result_block, "type", "tool_result");
-        cJSON_AddStringToObject(result_block, "tool_use_id", call->id);
-        cJSON_AddStringToObject(result_block, "content", tool_output);
+        cJSON_AddStringToObject(result_block, "tool_use_id", resp->calls[i].id);
+        cJSON_AddStringToObject(result_block, "content", jobs[i].output);
         cJSON_AddItemToArray(content, result_block);
     }
 
     return content;
 }
 
-static void agent_loop_task(void *arg)
+/* Partial reply of the current LLM call: token events or a channel draft */
+typedef struct {
+    const mimi_msg_t     *msg;
+    const llm_response_t *resp;     /* resp->text holds everything streamed so far */
+    bool                  live;     /* the channel takes token events */
+    uint32_t              last_ms;
+    bool                  shown;
+} draft_ctx_t;
+
+static void on_token(const char *text, size_t len, void *ctx)
 {
-    ESP_LOGI(TAG, "Agent loop started on core %d", xPortGetCoreID());
+    draft_ctx_t *d = (draft_ctx_t *)ctx;
+    if (d->live) {
+        /* Streaming channel: every delta as it arrives, no draft needed */
+        channel_event_t ev = { .type = CHANNEL_EVENT_TOKEN, .text = text, .len = len };
+        channel_dispatch_event(d->msg->channel, d->msg->chat_id, &ev);
+        d->shown = true;
+        return;
+    }
 
-    /* Allocate large buffers from PSRAM */
-    char *system_prompt = heap_caps_calloc(1, MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
-    char *history_json = heap_caps_calloc(1, MIMI_LLM_STREAM_BUF_SIZE, MALLOC_CAP_SPIRAM);
-    char *tool_output = heap_caps_calloc(1, TOOL_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+    if (d->shown && now - d->last_ms < MIMI_DRAFT_SNAPSHOT_MS) return;
+    d->last_ms = now;
+    if (channel_dispatch_draft(d->msg->channel, d->msg->chat_id, d->resp->text) == ESP_OK) {
+        d->shown = true;
+    }
+}
 
-    if (!system_prompt || !history_json || !tool_output) {
-        ESP_LOGE(TAG, "Failed to allocate PSRAM buffers");
-        vTaskDelete(NULL);
+/* The text shown for this LLM call is not the answer: close it off */
+static void draft_end(const draft_ctx_t *d)
+{
+    if (!d->shown) return;
+    if (d->live) {
+        channel_event_t ev = { .type = CHANNEL_EVENT_TEXT_END, .text = "" };
+        channel_dispatch_event(d->msg->channel, d->msg->chat_id, &ev);
         return;
     }
+    /* Show it in full; the next call's text starts a new draft */
+    if (d->resp->text) channel_dispatch_draft(d->msg->channel, d->msg->chat_id, d->resp->text);
+    channel_dispatch_draft_break(d->msg->channel, d->msg->chat_id);
+}
 
-    const char *tools_json = tool_registry_get_tools_json();
+/* One full turn for msg: ReAct loop, session update, reply */
+static void agent_process(agent_worker_t *w, mimi_msg_t msg)
+{
+    char *system_prompt = w->system_prompt;
+    char *tool_output = w->tool_output;
+    const llm_tools_t *tools = tool_registry_get_manifests();
+    esp_err_t err;
+
+    ESP_LOGI(TAG, "Worker %d processing message from %s:%s", w->id, msg.channel, msg.chat_id);
+
+    /* 1. Build system prompt */
+    llm_system_prompt_t system;
+    context_build_system_prompt(system_prompt, MIMI_CONTEXT_BUF_SIZE, &system);
+
+    /* 2. Load session history into cJSON array (from the PSRAM cache) */
+    cJSON *messages = cJSON_CreateArray();
+    session_get_history(msg.chat_id, messages, MIMI_AGENT_MAX_HISTORY);
+
+    /* 3. Append current user message */
+    cJSON *user_msg = cJSON_CreateObject();
+    cJSON_AddStringToObject(user_msg, "role", "user");
+    cJSON_AddStringToObject(user_msg, "content", msg.content);
+    cJSON_AddItemToArray(messages, user_msg);
+
+    /* 4. ReAct loop */
+    char *final_text = NULL;
+    int iteration = 0;
+    bool drafted = false;
+    bool live = channel_dispatch_has_events(msg.channel);
+
+    while (iteration < MIMI_AGENT_MAX_TOOL_ITER) {
+        /* "Working" status before each API call; coalesced by the channel */
+        {
+            static const char *working_phrases[] = {
+                "mimi\xF0\x9F\x98\x97is working...",
+                "mimi\xF0\x9F\x90\xBE is thinking...",
+                "mimi\xF0\x9F\x92\xAD is pondering...",
+                "mimi\xF0\x9F\x8C\x99 is on it...",
+                "mimi\xE2\x9C\xA8 is cooking...",
+            };
+            const int phrase_count = sizeof(working_phrases) / sizeof(working_phrases[0]);
+            channel_dispatch_status(msg.channel, msg.chat_id,
+                                    working_phrases[esp_random() % phrase_count]);
+        }
 
-    while (1) {
-        mimi_msg_t msg;
-        esp_err_t err = message_bus_pop_inbound(&msg, UINT32_MAX);
-        if (err != ESP_OK) continue;
-
-        ESP_LOGI(TAG, "Processing message from %s:%s", msg.channel, msg.chat_id);
-
-        /* 1. Build system prompt */
-        context_build_system_prompt(system_prompt, MIMI_CONTEXT_BUF_SIZE);
-
-        /* 2. Load session history into cJSON array */
-        session_get_history_json(msg.chat_id, history_json,
-                                 MIMI_LLM_STREAM_BUF_SIZE, MIMI_AGENT_MAX_HISTORY);
-
-        cJSON *messages = cJSON_Parse(history_json);
-        if (!messages) messages = cJSON_CreateArray();
-
-        /* 3. Append current user message */
-        cJSON *user_msg = cJSON_CreateObject();
-        cJSON_AddStringToObject(user_msg, "role", "user");
-        cJSON_AddStringToObject(user_msg, "content", msg.content);
-        cJSON_AddItemToArray(messages, user_msg);
-
-        /* 4. ReAct loop */
-        char *final_text = NULL;
-        int iteration = 0;
-
-        while (iteration < MIMI_AGENT_MAX_TOOL_ITER) {
-            /* Send "working" indicator before each API call */
-            {
-                static const char *working_phrases[] = {
-                    "mimi\xF0\x9F\x98\x97is working...",
-                    "mimi\xF0\x9F\x90\xBE is thinking...",
-                    "mimi\xF0\x9F\x92\xAD is pondering...",
-                    "mimi\xF0\x9F\x8C\x99 is on it...",
-                    "mimi\xE2\x9C\xA8 is cooking...",
-                };
-                const int phrase_count = sizeof(working_phrases) / sizeof(working_phrases[0]);
-                mimi_msg_t status = {0};
-                strncpy(status.channel, msg.channel, sizeof(status.channel) - 1);
-                strncpy(status.chat_id, msg.chat_id, sizeof(status.chat_id) - 1);
-                status.content = strdup(working_phrases[esp_random() % phrase_count]);
-                if (status.content) message_bus_push_outbound(&status);
-            }
+        llm_response_t resp;
+        draft_ctx_t draft = { .msg = &msg, .resp = &resp, .live = live };
+        err = llm_chat_tools_stream(&system, messages, tools, &resp, on_token, &draft);
+        if (draft.shown && !live) drafted = true;
 
-            llm_response_t resp;
-            err = llm_chat_tools(system_prompt, messages, tools_json, &resp);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "LLM call failed: %s", esp_err_to_name(err));
+            draft_end(&draft);      /* the error reply must not replace the partial text */
+            break;
+        }
 
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "LLM call failed: %s", esp_err_to_name(err));
-                break;
+        if (!resp.tool_use) {
+            /* Normal completion — save final text and break */
+            if (resp.text && resp.text_len > 0) {
+                final_text = message_bus_strdup(resp.text);
             }
+            llm_response_free(&resp);
+            break;
+        }
 
-            if (!resp.tool_use) {
-                /* Normal completion — save final text and break */
-                if (resp.text && resp.text_len > 0) {
-                    final_text = strdup(resp.text);
-                }
-                llm_response_free(&resp);
-                break;
-            }
+        ESP_LOGI(TAG, "Tool use iteration %d: %d calls", iteration + 1, resp.call_count);
 
-            ESP_LOGI(TAG, "Tool use iteration %d: %d calls", iteration + 1, resp.call_count);
+        draft_end(&draft);
 
-            /* Append assistant message with content array */
-            cJSON *asst_msg = cJSON_CreateObject();
-            cJSON_AddStringToObject(asst_msg, "role", "assistant");
-            cJSON_AddItemToObject(asst_msg, "content", build_assistant_content(&resp));
-            cJSON_AddItemToArray(messages, asst_msg);
+        char status[64];
+        snprintf(status, sizeof(status), "mimi is using %s...", resp.calls[0].name);
+        channel_dispatch_status(msg.channel, msg.chat_id, status);
 
-            /* Execute tools and append results */
-            cJSON *tool_results = build_tool_results(&resp, tool_output, TOOL_OUTPUT_SIZE);
-            cJSON *result_msg = cJSON_CreateObject();
-            cJSON_AddStringToObject(result_msg, "role", "user");
-            cJSON_AddItemToObject(result_msg, "content", tool_results);
-            cJSON_AddItemToArray(messages, result_msg);
+        /* Append assistant message with content array */
+        cJSON *asst_msg = cJSON_CreateObject();
+        cJSON_AddStringToObject(asst_msg, "role", "assistant");
+        cJSON_AddItemToObject(asst_msg, "content", build_assistant_content(&resp));
+        cJSON_AddItemToArray(messages, asst_msg);
 
-            llm_response_free(&resp);
-            iteration++;
+        /* Execute tools and append results */
+        cJSON *tool_results = build_tool_results(&msg, live, &resp, tool_output);
+        cJSON *result_msg = cJSON_CreateObject();
+        cJSON_AddStringToObject(result_msg, "role", "user");
+        cJSON_AddItemToObject(result_msg, "content", tool_results);
+        cJSON_AddItemToArray(messages, result_msg);
+
+        llm_response_free(&resp);
+        iteration++;
+    }
+
+    cJSON_Delete(messages);
+    channel_dispatch_status(msg.channel, msg.chat_id, NULL);
+    if (drafted) channel_dispatch_draft(msg.channel, msg.chat_id, NULL);
+
+    /* 5. Send response */
+    if (final_text && final_text[0]) {
+        /* Save to session (only user text + final assistant text) */
+        session_append(msg.chat_id, "user", msg.content);
+        session_append(msg.chat_id, "assistant", final_text);
+
+        /* Push response to outbound */
+        mimi_msg_t out = {0};
+        strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
+        strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
+        out.content = final_text;  /* transfer ownership */
+        message_bus_push_outbound(&out);
+    } else {
+        /* Error or empty response */
+        message_bus_unref(final_text);
+        mimi_msg_t out = {0};
+        strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
+        strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
+        out.content = message_bus_strdup("Sorry, I encountered an error.");
+        if (out.content) {
+            message_bus_push_outbound(&out);
         }
+    }
 
-        cJSON_Delete(messages);
+    /* Release inbound message content */
+    message_bus_unref(msg.content);
+}
 
-        /* 5. Send response */
-        if (final_text && final_text[0]) {
-            /* Save to session (only user text + final assistant text) */
-            session_append(msg.chat_id, "user", msg.content);
-            session_append(msg.chat_id, "assistant", final_text);
+/* ── Scheduling ───────────────────────────────────────────────── */
+
+/*
+ * A scheduler task moves inbound messages into a small pending table; idle
+ * workers take the oldest message of the most urgent class whose chat is
+ * not already being handled. A chat is therefore processed by one worker at
+ * a time, in arrival order, while different chats run in parallel.
+ * MIMI_AGENT_INTERACTIVE_RESERVE workers are held back for interactive
+ * traffic, so a WebSocket or CLI user never waits behind long Telegram turns.
+ */
+typedef enum {
+    CLASS_INTERACTIVE,      /* websocket, cli */
+    CLASS_NORMAL,           /* telegram */
+    CLASS_BACKGROUND,       /* anything else */
+    CLASS_COUNT,
+} msg_class_t;
+
+typedef struct {
+    mimi_msg_t msg;
+    uint8_t    cls;
+    uint32_t   arrival;
+    bool       used;
+} pending_t;
+
+typedef struct {
+    char channel[16];
+    char chat_id[32];       /* "" while idle */
+} busy_chat_t;
+
+static pending_t         s_pending[MIMI_AGENT_PENDING];
+static uint32_t          s_arrivals;
+static busy_chat_t       s_busy[MIMI_AGENT_WORKERS];
+static int               s_busy_count;
+static int               s_workers;
+static SemaphoreHandle_t s_sched_lock;
+static SemaphoreHandle_t s_work;        /* given when a message may be runnable */
+static SemaphoreHandle_t s_space;       /* free pending slots */
+
+static msg_class_t msg_class(const char *channel)
+{
+    if (strcmp(channel, MIMI_CHAN_WEBSOCKET) == 0 || strcmp(channel, MIMI_CHAN_CLI) == 0) {
+        return CLASS_INTERACTIVE;
+    }
+    if (strcmp(channel, MIMI_CHAN_TELEGRAM) == 0) return CLASS_NORMAL;
+    return CLASS_BACKGROUND;
+}
 
-            /* Push response to outbound */
-            mimi_msg_t out = {0};
-            strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
-            strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
-            out.content = final_text;  /* transfer ownership */
-            message_bus_push_outbound(&out);
-        } else {
-            /* Error or empty response */
-            free(final_text);
-            mimi_msg_t out = {0};
-            strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
-            strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
-            out.content = strdup("Sorry, I encountered an error.");
-            if (out.content) {
-                message_bus_push_outbound(&out);
-            }
+static bool chat_busy(const mimi_msg_t *msg)
+{
+    for (int i = 0; i < s_workers; i++) {
+        if (s_busy[i].chat_id[0] &&
+            strcmp(s_busy[i].chat_id, msg->chat_id) == 0 &&
+            strcmp(s_busy[i].channel, msg->channel) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Claim the next runnable message for worker id (scheduler lock held) */
+static bool sched_pick(int id, mimi_msg_t *out)
+{
+    int reserve = s_workers > MIMI_AGENT_INTERACTIVE_RESERVE ? MIMI_AGENT_INTERACTIVE_RESERVE : 0;
+
+    for (int cls = 0; cls < CLASS_COUNT; cls++) {
+        if (cls != CLASS_INTERACTIVE && s_busy_count >= s_workers - reserve) break;
+
+        pending_t *best = NULL;
+        for (int i = 0; i < MIMI_AGENT_PENDING; i++) {
+            pending_t *p = &s_pending[i];
+            if (!p->used || p->cls != cls || chat_busy(&p->msg)) continue;
+            if (!best || p->arrival < best->arrival) best = p;
+        }
+        if (!best) continue;
+
+        /* Same chat, same channel, same class: arrival order is kept */
+        *out = best->msg;
+        best->used = false;
+        strcpy(s_busy[id].channel, out->channel);
+        strcpy(s_busy[id].chat_id, out->chat_id);
+        s_busy_count++;
+        return true;
+    }
+    return false;
+}
+
+static void agent_sched_task(void *arg)
+{
+    while (1) {
+        mimi_msg_t msg;
+        if (message_bus_pop_inbound(&msg, UINT32_MAX) != ESP_OK) continue;
+
+        /* A full table pushes back on the inbound queue */
+        xSemaphoreTake(s_space, portMAX_DELAY);
+
+        xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+        for (int i = 0; i < MIMI_AGENT_PENDING; i++) {
+            if (s_pending[i].used) continue;
+            s_pending[i] = (pending_t){
+                .msg = msg,
+                .cls = msg_class(msg.channel),
+                .arrival = s_arrivals++,
+                .used = true,
+            };
+            break;
         }
+        xSemaphoreGive(s_sched_lock);
+        xSemaphoreGive(s_work);
+    }
+}
+
+static void agent_worker_task(void *arg)
+{
+    agent_worker_t *w = (agent_worker_t *)arg;
+    ESP_LOGI(TAG, "Agent worker %d started on core %d", w->id, xPortGetCoreID());
+
+    while (1) {
+        mimi_msg_t msg;
+        xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+        bool got = sched_pick(w->id, &msg);
+        xSemaphoreGive(s_sched_lock);
+
+        if (!got) {
+            xSemaphoreTake(s_work, portMAX_DELAY);
+            continue;
+        }
+        xSemaphoreGive(s_space);
 
-        /* Free inbound message content */
-        free(msg.content);
+        agent_process(w, msg);
+
+        xSemaphoreTake(s_sched_lock, portMAX_DELAY);
+        s_busy[w->id].chat_id[0] = '\0';
+        s_busy_count--;
+        xSemaphoreGive(s_sched_lock);
+
+        /* Messages held for this chat or by the reserve may run now */
+        xSemaphoreGive(s_work);
 
         /* Log memory status */
         ESP_LOGI(TAG, "Free PSRAM: %d bytes",
@@ -212,16 +432,64 @@ static void agent_loop_task(void *arg)
 
 esp_err_t agent_loop_init(void)
 {
+    s_sched_lock = xSemaphoreCreateMutex();
+    s_work = xSemaphoreCreateCounting(MIMI_AGENT_PENDING + MIMI_AGENT_WORKERS, 0);
+    s_space = xSemaphoreCreateCounting(MIMI_AGENT_PENDING, MIMI_AGENT_PENDING);
+    if (!s_sched_lock || !s_work || !s_space) return ESP_ERR_NO_MEM;
+
     ESP_LOGI(TAG, "Agent loop initialized");
     return ESP_OK;
 }
 
 esp_err_t agent_loop_start(void)
 {
+    /* Each worker costs its PSRAM buffers plus an internal-RAM stack; stop
+     * early rather than leave the rest of the system short of PSRAM. */
+    for (int i = 0; i < MIMI_AGENT_WORKERS; i++) {
+        size_t free_psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+        if (free_psram < WORKER_PSRAM_BYTES + MIMI_AGENT_PSRAM_RESERVE) {
+            ESP_LOGW(TAG, "Only %d KB PSRAM free, starting %d of %d workers",
+                     (int)(free_psram / 1024), s_workers, MIMI_AGENT_WORKERS);
+            break;
+        }
+
+        agent_worker_t *w = calloc(1, sizeof(*w));
+        char *system_prompt = heap_caps_calloc(1, MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
+        char *tool_output = heap_caps_calloc(MIMI_MAX_TOOL_CALLS, TOOL_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
+        if (!w || !system_prompt || !tool_output) {
+            ESP_LOGE(TAG, "Failed to allocate PSRAM buffers for worker %d", i);
+            free(w);
+            free(system_prompt);
+            free(tool_output);
+            break;
+        }
+        w->id = i;
+        w->system_prompt = system_prompt;
+        w->tool_output = tool_output;
+
+        char name[16];
+        snprintf(name, sizeof(name), "agent_%d", i);
+        BaseType_t ret = xTaskCreatePinnedToCore(
+            agent_worker_task, name,
+            MIMI_AGENT_STACK, w,
+            MIMI_AGENT_PRIO, NULL, MIMI_AGENT_CORE);
+        if (ret != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create worker %d", i);
+            free(w);
+            free(system_prompt);
+            free(tool_output);
+            break;
+        }
+        s_workers++;
+    }
+    if (s_workers == 0) return ESP_FAIL;
+
     BaseType_t ret = xTaskCreatePinnedToCore(
-        agent_loop_task, "agent_loop",
-        MIMI_AGENT_STACK, NULL,
+        agent_sched_task, "agent_sched",
+        MIMI_AGENT_SCHED_STACK, NULL,
         MIMI_AGENT_PRIO, NULL, MIMI_AGENT_CORE);
 
+    ESP_LOGI(TAG, "%d agent workers, %d KB PSRAM + %d KB stack each",
+             s_workers, WORKER_PSRAM_BYTES / 1024, MIMI_AGENT_STACK / 1024);
     return (ret == pdPASS) ? ESP_OK : ESP_FAIL;
 }
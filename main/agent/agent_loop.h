@@ -8,7 +8,9 @@
 esp_err_t agent_loop_init(void);
 
 /**
- * Start the agent loop task (runs on Core 1).
- * Consumes from inbound queue, calls Claude API, pushes to outbound queue.
+ * Start the scheduler and up to MIMI_AGENT_WORKERS worker tasks (Core 1).
+ * Workers consume the inbound queue, one turn per chat at a time, call the
+ * LLM API and push replies to the outbound queue. Fewer workers start if
+ * PSRAM would drop below MIMI_AGENT_PSRAM_RESERVE.
  */
 esp_err_t agent_loop_start(void);
@@ -3,77 +3,244 @@
 #include "memory/memory_store.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 
 static const char *TAG = "context";
 
-static size_t append_file(char *buf, size_t size, size_t offset, const char *path, const char *header)
+/* Largest MEMORY.md / recent notes excerpt placed in the prompt */
+#define SECTION_READ_MAX    4096
+
+static const char s_preamble[] =
+    "# MimiClaw\n\n"
+    "You are MimiClaw, a personal AI assistant running on an ESP32-S3 device.\n"
+    "You communicate through Telegram and WebSocket.\n\n"
+    "Be helpful, accurate, and concise.\n\n"
+    "## Available Tools\n"
+    "You have access to the following tools:\n"
+    "- web_search: Search the web for current information. "
+    "Use this when you need up-to-date facts, news, weather, or anything beyond your training data.\n"
+    "- get_current_time: Get the current date and time. "
+    "You do NOT have an internal clock — always use this tool when you need to know the time or date.\n"
+    "- read_file: Read a file from SPIFFS (path must start with /spiffs/).\n"
+    "- write_file: Write/overwrite a file on SPIFFS.\n"
+    "- edit_file: Find-and-replace edit a file on SPIFFS.\n"
+    "- list_dir: List files on SPIFFS, optionally filter by prefix.\n\n"
+    "Use tools when needed. Provide your final answer as text after using tools.\n\n"
+    "## Memory\n"
+    "You have persistent memory stored on local flash:\n"
+    "- Long-term memory: /spiffs/memory/MEMORY.md\n"
+    "- Daily notes: /spiffs/memory/daily/<YYYY-MM-DD>.md\n\n"
+    "IMPORTANT: Actively use memory to remember things across conversations.\n"
+    "- When you learn something new about the user (name, preferences, habits, context), write it to MEMORY.md.\n"
+    "- When something noteworthy happens in a conversation, append it to today's daily note.\n"
+    "- Always read_file MEMORY.md before writing, so you can edit_file to update without losing existing content.\n"
+    "- Use get_current_time to know today's date before writing daily notes.\n"
+    "- Keep MEMORY.md concise and organized — summarize, don't dump raw conversation.\n"
+    "- You should proactively save memory without being asked. If the user tells you their name, preferences, or important facts, persist them immediately.\n";
+
+/* ── Section cache ────────────────────────────────────────────── */
+
+/*
+ * The prompt is assembled from sections cached in PSRAM. A section is only
+ * re-read from SPIFFS after context_invalidate_file() bumped its generation
+ * (or, for the notes, the date changed), so steady-state prompt builds do
+ * no flash I/O.
+ */
+enum {
+    SEC_PREAMBLE,
+    SEC_SOUL,
+    SEC_USER,
+    SEC_MEMORY,
+    SEC_NOTES,
+    SEC_COUNT,
+};
+
+typedef struct {
+    char              *text;        /* PSRAM, including its "## " heading */
+    size_t             len;
+    volatile uint32_t  gen;         /* bumped on invalidation */
+    uint32_t           built_gen;   /* generation text was loaded at */
+    bool               built;
+} section_t;
+
+static section_t s_sections[SEC_COUNT];
+static SemaphoreHandle_t s_lock;
+static char s_notes_date[16];       /* day the notes section was loaded for */
+
+static size_t format_file(char *out, size_t cap, const char *path, const char *header)
 {
     FILE *f = fopen(path, "r");
-    if (!f) return offset;
+    if (!f) return 0;
+
+    size_t off = snprintf(out, cap, "\n## %s\n\n", header);
+    off += fread(out + off, 1, cap - off - 1, f);
+    out[off] = '\0';
+    fclose(f);
+    return off;
+}
+
+/* Heading, then whatever read() put after it, then a newline; 0 if empty */
+static size_t format_memory(char *out, size_t cap, const char *header,
+                            esp_err_t (*read)(char *buf, size_t size))
+{
+    size_t off = snprintf(out, cap, "\n## %s\n\n", header);
+    size_t room = cap - off - 1;
+    if (room > SECTION_READ_MAX) room = SECTION_READ_MAX;
 
-    if (header && offset < size - 1) {
-        offset += snprintf(buf + offset, size - offset, "\n## %s\n\n", header);
+    if (read(out + off, room) != ESP_OK || out[off] == '\0') return 0;
+    off += strlen(out + off);
+    out[off++] = '\n';
+    out[off] = '\0';
+    return off;
+}
+
+static esp_err_t read_recent_notes(char *buf, size_t size)
+{
+    return memory_read_recent(buf, size, 3);
+}
+
+static size_t load_section(int sec, char *out, size_t cap)
+{
+    switch (sec) {
+    case SEC_PREAMBLE:
+        return snprintf(out, cap, "%s", s_preamble);
+    case SEC_SOUL:
+        return format_file(out, cap, MIMI_SOUL_FILE, "Personality");
+    case SEC_USER:
+        return format_file(out, cap, MIMI_USER_FILE, "User Info");
+    case SEC_MEMORY:
+        return format_memory(out, cap, "Long-term Memory", memory_read_long_term);
+    case SEC_NOTES:
+        return format_memory(out, cap, "Recent Notes", read_recent_notes);
+    default:
+        return 0;
     }
+}
 
-    size_t n = fread(buf + offset, 1, size - offset - 1, f);
-    offset += n;
-    buf[offset] = '\0';
-    fclose(f);
-    return offset;
+/* Recent notes cover the last three days, so a new day invalidates them */
+static void check_date_rollover(void)
+{
+    char today[16];
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(today, sizeof(today), "%Y-%m-%d", &tm);
+
+    if (strcmp(today, s_notes_date) != 0) {
+        strcpy(s_notes_date, today);
+        s_sections[SEC_NOTES].gen++;
+    }
 }
 
-esp_err_t context_build_system_prompt(char *buf, size_t size)
+/* Reload stale sections; returns how many were read from flash */
+static int refresh_sections(void)
 {
-    size_t off = 0;
+    check_date_rollover();
+
+    char *scratch = NULL;
+    int reloaded = 0;
+    for (int i = 0; i < SEC_COUNT; i++) {
+        section_t *sec = &s_sections[i];
+        uint32_t gen = sec->gen;
+        if (sec->built && sec->built_gen == gen) continue;
+
+        if (!scratch) {
+            scratch = heap_caps_malloc(MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
+            if (!scratch) {
+                ESP_LOGE(TAG, "Out of memory reloading prompt sections");
+                break;
+            }
+        }
+
+        size_t len = load_section(i, scratch, MIMI_CONTEXT_BUF_SIZE);
+        char *text = heap_caps_realloc(sec->text, len + 1, MALLOC_CAP_SPIRAM);
+        if (!text) {
+            ESP_LOGE(TAG, "Out of memory caching prompt section %d", i);
+            continue;
+        }
+        memcpy(text, scratch, len);
+        text[len] = '\0';
+        sec->text = text;
+        sec->len = len;
+        sec->built_gen = gen;
+        sec->built = true;
+        reloaded++;
+    }
+    free(scratch);
+    return reloaded;
+}
+
+static size_t append_section(char *buf, size_t size, size_t off, int sec)
+{
+    const section_t *s = &s_sections[sec];
+    if (!s->built || s->len == 0 || off >= size - 1) return off;
+
+    size_t n = s->len < size - 1 - off ? s->len : size - 1 - off;
+    memcpy(buf + off, s->text, n);
+    off += n;
+    buf[off] = '\0';
+    return off;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
 
-    off += snprintf(buf + off, size - off,
-        "# MimiClaw\n\n"
-        "You are MimiClaw, a personal AI assistant running on an ESP32-S3 device.\n"
-        "You communicate through Telegram and WebSocket.\n\n"
-        "Be helpful, accurate, and concise.\n\n"
-        "## Available Tools\n"
-        "You have access to the following tools:\n"
-        "- web_search: Search the web for current information. "
-        "Use this when you need up-to-date facts, news, weather, or anything beyond your training data.\n"
-        "- get_current_time: Get the current date and time. "
-        "You do NOT have an internal clock — always use this tool when you need to know the time or date.\n"
-        "- read_file: Read a file from SPIFFS (path must start with /spiffs/).\n"
-        "- write_file: Write/overwrite a file on SPIFFS.\n"
-        "- edit_file: Find-and-replace edit a file on SPIFFS.\n"
-        "- list_dir: List files on SPIFFS, optionally filter by prefix.\n\n"
-        "Use tools when needed. Provide your final answer as text after using tools.\n\n"
-        "## Memory\n"
-        "You have persistent memory stored on local flash:\n"
-        "- Long-term memory: /spiffs/memory/MEMORY.md\n"
-        "- Daily notes: /spiffs/memory/daily/<YYYY-MM-DD>.md\n\n"
-        "IMPORTANT: Actively use memory to remember things across conversations.\n"
-        "- When you learn something new about the user (name, preferences, habits, context), write it to MEMORY.md.\n"
-        "- When something noteworthy happens in a conversation, append it to today's daily note.\n"
-        "- Always read_file MEMORY.md before writing, so you can edit_file to update without losing existing content.\n"
-        "- Use get_current_time to know today's date before writing daily notes.\n"
-        "- Keep MEMORY.md concise and organized — summarize, don't dump raw conversation.\n"
-        "- You should proactively save memory without being asked. If the user tells you their name, preferences, or important facts, persist them immediately.\n");
-
-    /* Bootstrap files */
-    off = append_file(buf, size, off, MIMI_SOUL_FILE, "Personality");
-    off = append_file(buf, size, off, MIMI_USER_FILE, "User Info");
-
-    /* Long-term memory */
-    char mem_buf[4096];
-    if (memory_read_long_term(mem_buf, sizeof(mem_buf)) == ESP_OK && mem_buf[0]) {
-        off += snprintf(buf + off, size - off, "\n## Long-term Memory\n\n%s\n", mem_buf);
+esp_err_t context_builder_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    return s_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void context_invalidate_file(const char *path)
+{
+    if (!path) return;
+
+    int sec;
+    if (strcmp(path, MIMI_SOUL_FILE) == 0) {
+        sec = SEC_SOUL;
+    } else if (strcmp(path, MIMI_USER_FILE) == 0) {
+        sec = SEC_USER;
+    } else if (strcmp(path, MIMI_MEMORY_FILE) == 0) {
+        sec = SEC_MEMORY;
+    } else if (strncmp(path, MIMI_SPIFFS_MEMORY_DIR "/",
+                       sizeof(MIMI_SPIFFS_MEMORY_DIR)) == 0) {
+        sec = SEC_NOTES;    /* daily note files */
+    } else {
+        return;
     }
+    s_sections[sec].gen++;
+}
+
+esp_err_t context_build_system_prompt(char *buf, size_t size, llm_system_prompt_t *prompt)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int reloaded = refresh_sections();
+
+    size_t off = 0;
+    buf[0] = '\0';
+    off = append_section(buf, size, off, SEC_PREAMBLE);
+    off = append_section(buf, size, off, SEC_SOUL);
+    off = append_section(buf, size, off, SEC_USER);
+    size_t stable_end = off;
+    off = append_section(buf, size, off, SEC_MEMORY);
+    size_t memory_end = off;
+    off = append_section(buf, size, off, SEC_NOTES);
+    xSemaphoreGive(s_lock);
 
-    /* Recent daily notes (last 3 days) */
-    char recent_buf[4096];
-    if (memory_read_recent(recent_buf, sizeof(recent_buf), 3) == ESP_OK && recent_buf[0]) {
-        off += snprintf(buf + off, size - off, "\n## Recent Notes\n\n%s\n", recent_buf);
+    if (prompt) {
+        prompt->text = buf;
+        prompt->stable_len = stable_end;
+        prompt->memory_len = memory_end - stable_end;
     }
 
-    ESP_LOGI(TAG, "System prompt built: %d bytes", (int)off);
+    ESP_LOGI(TAG, "System prompt built: %d bytes (stable %d, memory %d, %d sections reloaded)",
+             (int)off, (int)stable_end, (int)(memory_end - stable_end), reloaded);
     return ESP_OK;
 }
 
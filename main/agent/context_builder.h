@@ -2,15 +2,32 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include "llm/llm_proxy.h"
+
+/**
+ * Initialize the prompt section cache.
+ */
+esp_err_t context_builder_init(void);
+
+/**
+ * Mark the cached prompt section backed by path as stale, if any.
+ * Call after writing SOUL.md, USER.md, MEMORY.md or a daily note.
+ */
+void context_invalidate_file(const char *path);
 
 /**
  * Build the system prompt from bootstrap files (SOUL.md, USER.md)
  * and memory context (MEMORY.md + recent daily notes).
  *
- * @param buf   Output buffer (caller allocates, recommend MIMI_CONTEXT_BUF_SIZE)
- * @param size  Buffer size
+ * Parts are ordered from least to most frequently changing so the
+ * prompt cache can reuse the longest possible prefix. Each part is kept
+ * in PSRAM and only re-read from SPIFFS after it was invalidated.
+ *
+ * @param buf     Output buffer (caller allocates, recommend MIMI_CONTEXT_BUF_SIZE)
+ * @param size    Buffer size
+ * @param prompt  Optional: set to buf and the boundaries of its parts
  */
-esp_err_t context_build_system_prompt(char *buf, size_t size);
+esp_err_t context_build_system_prompt(char *buf, size_t size, llm_system_prompt_t *prompt);
 
 /**
  * Build the complete messages JSON array for LLM call.
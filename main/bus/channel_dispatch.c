@@ -0,0 +1,539 @@
+#include "channel_dispatch.h"
+#include "message_bus.h"
+#include "mimi_config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "dispatch";
+
+/*
+ * Transient state of one chat: its latest status line and reply draft, and
+ * replies held back because the channel asked for a resend later. Held
+ * replies keep their order; newer statuses and drafts
+ * overwrite older ones instead of queuing.
+ */
+typedef struct {
+    char     chat_id[32];
+    bool     status_on;
+    bool     status_dirty;  /* text changed since last sent */
+    char     status[64];
+    uint32_t status_ms;     /* last status send */
+    bool     drafting;
+    char    *draft;         /* latest unsent draft (bus payload), or NULL */
+    uint32_t draft_ms;      /* last draft send */
+    uint32_t draft_wait;    /* interval the channel asked for before the next */
+    bool     draft_break;   /* a new reply starts; tell the channel before the next draft */
+    bool     draft_early;   /* draft holds the end of the reply before the break */
+    char    *held[MIMI_SEND_HELD_MAX];  /* replies (bus payloads), oldest first */
+    uint32_t held_deadline[MIMI_SEND_HELD_MAX]; /* give up on each after this */
+    int      held_count;
+    uint32_t held_ms;       /* when to (re)send the oldest */
+} chat_slot_t;
+
+typedef struct {
+    char           name[16];
+    channel_ops_t  ops;
+    bus_sub_t     *sub;
+
+    /* Guarded by s_lock */
+    chat_slot_t    chats[MIMI_STATUS_SLOTS];
+    unsigned       sent;
+    unsigned       failed;
+    unsigned       status_sent;
+    unsigned       draft_sent;
+    uint32_t       last_ms;
+    uint32_t       max_ms;
+    uint64_t       total_ms;
+} channel_t;
+
+static channel_t s_channels[MIMI_BUS_MAX_SUBS];
+static int s_channel_count;
+static SemaphoreHandle_t s_lock;
+
+static channel_t *find_channel(const char *name)
+{
+    for (int i = 0; i < s_channel_count; i++) {
+        if (strcmp(s_channels[i].name, name) == 0) return &s_channels[i];
+    }
+    return NULL;
+}
+
+/* Count a finished send that started at start; returns its duration */
+static uint32_t record_send(channel_t *ch, esp_err_t err, uint32_t start)
+{
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() / 1000) - start;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (err == ESP_OK) {
+        ch->sent++;
+    } else {
+        ch->failed++;
+    }
+    ch->last_ms = elapsed;
+    ch->total_ms += elapsed;
+    if (elapsed > ch->max_ms) ch->max_ms = elapsed;
+    xSemaphoreGive(s_lock);
+    return elapsed;
+}
+
+/* ── Status and draft coalescing ──────────────────────────────── */
+
+typedef enum {
+    SLOT_STATUS,
+    SLOT_DRAFT,
+    SLOT_REPLY,
+} slot_job_t;
+
+static bool slot_used(const chat_slot_t *slot)
+{
+    return slot->status_on || slot->drafting || slot->draft_break || slot->held_count > 0;
+}
+
+/* When slot next needs sending, relative to now (<= 0: due); INT32_MAX: never */
+static int32_t slot_due_in(const channel_t *ch, const chat_slot_t *slot, uint32_t now,
+                           slot_job_t *job)
+{
+    int32_t due = INT32_MAX;
+
+    /* Held-back replies go first; nothing newer is shown before them */
+    if (slot->held_count > 0) {
+        *job = SLOT_REPLY;
+        return (int32_t)(slot->held_ms - now);
+    }
+
+    *job = SLOT_STATUS;
+    if (slot->status_on) {
+        if (slot->status_dirty) {
+            due = (int32_t)(slot->status_ms + MIMI_STATUS_MIN_INTERVAL_MS - now);
+        } else if (ch->ops.status_refresh_ms > 0) {
+            due = (int32_t)(slot->status_ms + ch->ops.status_refresh_ms - now);
+        }
+    }
+    if (slot->draft_break) {
+        /* Local to the channel; only the draft sent with it is rate-limited */
+        *job = SLOT_DRAFT;
+        return slot->draft ? (int32_t)(slot->draft_ms + slot->draft_wait - now) : 0;
+    }
+    if (slot->draft) {
+        int32_t d = (int32_t)(slot->draft_ms + slot->draft_wait - now);
+        if (d < due) {
+            due = d;
+            *job = SLOT_DRAFT;
+        }
+    }
+    return due;
+}
+
+/* Pop timeout until the earliest status or draft is due; UINT32_MAX if none is */
+static uint32_t slot_wait_ms(channel_t *ch)
+{
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+    int32_t wait = INT32_MAX;
+    slot_job_t job;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_STATUS_SLOTS; i++) {
+        if (!slot_used(&ch->chats[i])) continue;
+        int32_t due = slot_due_in(ch, &ch->chats[i], now, &job);
+        if (due < wait) wait = due;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (wait == INT32_MAX) return UINT32_MAX;
+    return wait > 0 ? (uint32_t)wait : 0;
+}
+
+/* The chat's slot, claiming a free one if create; NULL if none. Lock held. */
+static chat_slot_t *slot_get(channel_t *ch, const char *chat_id, bool create)
+{
+    chat_slot_t *free_slot = NULL;
+    for (int i = 0; i < MIMI_STATUS_SLOTS; i++) {
+        chat_slot_t *s = &ch->chats[i];
+        if (slot_used(s) && strcmp(s->chat_id, chat_id) == 0) return s;
+        if (!slot_used(s) && !free_slot) free_slot = s;
+    }
+    if (!create || !free_slot) return NULL;
+
+    memset(free_slot, 0, sizeof(*free_slot));
+    strncpy(free_slot->chat_id, chat_id, sizeof(free_slot->chat_id) - 1);
+    return free_slot;
+}
+
+/*
+ * Queue a reply behind the chat's held ones, taking over the reference; the
+ * first held is sent at due. Only the channel's task adds or removes held
+ * replies. False if the chat's queue or every slot is full: the caller
+ * drops it.
+ */
+static bool reply_hold(channel_t *ch, const char *chat_id, char *text,
+                       uint32_t due, uint32_t deadline)
+{
+    bool ok = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    chat_slot_t *slot = slot_get(ch, chat_id, true);
+    if (slot && slot->held_count < MIMI_SEND_HELD_MAX) {
+        if (slot->held_count == 0) slot->held_ms = due;
+        slot->held[slot->held_count] = text;
+        slot->held_deadline[slot->held_count] = deadline;
+        slot->held_count++;
+        ok = true;
+    }
+    xSemaphoreGive(s_lock);
+    return ok;
+}
+
+static bool reply_held(channel_t *ch, const char *chat_id)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    chat_slot_t *slot = slot_get(ch, chat_id, false);
+    bool held = slot && slot->held_count > 0;
+    xSemaphoreGive(s_lock);
+    return held;
+}
+
+/* Send everything due; the lock is not held across the network call */
+static void slot_flush(channel_t *ch)
+{
+    for (int n = 0; n < 2 * MIMI_STATUS_SLOTS; n++) {
+        char chat_id[32];
+        char status[64];
+        char *payload = NULL;
+        uint32_t deadline = 0;
+        slot_job_t job = SLOT_STATUS;
+        bool brk = false;
+        bool early = false;
+        bool found = false;
+        uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int i = 0; i < MIMI_STATUS_SLOTS && !found; i++) {
+            chat_slot_t *slot = &ch->chats[i];
+            if (!slot_used(slot) || slot_due_in(ch, slot, now, &job) > 0) continue;
+            memcpy(chat_id, slot->chat_id, sizeof(chat_id));
+            if (job == SLOT_REPLY) {
+                payload = slot->held[0];    /* stays held until it is through */
+                deadline = slot->held_deadline[0];
+            } else if (job == SLOT_DRAFT) {
+                payload = slot->draft;  /* take over the reference */
+                brk = slot->draft_break;
+                early = slot->draft_early;
+                slot->draft = NULL;
+                slot->draft_break = false;
+                slot->draft_early = false;
+                if (payload) {
+                    slot->draft_ms = now;
+                    ch->draft_sent++;
+                }
+            } else {
+                memcpy(status, slot->status, sizeof(status));
+                slot->status_dirty = false;
+                slot->status_ms = now;
+                ch->status_sent++;
+            }
+            found = true;
+        }
+        xSemaphoreGive(s_lock);
+
+        if (!found) return;
+
+        if (job == SLOT_REPLY) {
+            uint32_t start = (uint32_t)(esp_timer_get_time() / 1000);
+            uint32_t retry = 0;
+            esp_err_t err = ch->ops.send(chat_id, payload, &retry);
+            uint32_t end = (uint32_t)(esp_timer_get_time() / 1000);
+            bool again = err != ESP_OK && retry && (int32_t)(deadline - (end + retry)) >= 0;
+
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            chat_slot_t *slot = slot_get(ch, chat_id, false);
+            if (again) {
+                slot->held_ms = end + retry;
+            } else {
+                /* Done with it (sent or given up): the next one goes now */
+                slot->held_count--;
+                memmove(slot->held, slot->held + 1, slot->held_count * sizeof(slot->held[0]));
+                memmove(slot->held_deadline, slot->held_deadline + 1,
+                        slot->held_count * sizeof(slot->held_deadline[0]));
+                slot->held_ms = end;
+            }
+            xSemaphoreGive(s_lock);
+
+            if (again) {
+                ESP_LOGD(TAG, "%s reply to %s still rate-limited, retry in %lu ms",
+                         ch->name, chat_id, (unsigned long)retry);
+                continue;
+            }
+            message_bus_unref(payload);
+            uint32_t elapsed = record_send(ch, err, start);
+            if (err != ESP_OK) {
+                ESP_LOGW(TAG, "%s resend to %s failed after %lu ms: %s", ch->name, chat_id,
+                         (unsigned long)elapsed, esp_err_to_name(err));
+            }
+            continue;
+        }
+
+        if (job == SLOT_STATUS) {
+            esp_err_t err = ch->ops.status(chat_id, status);
+            if (err != ESP_OK) {
+                ESP_LOGD(TAG, "%s status to %s failed: %s", ch->name, chat_id, esp_err_to_name(err));
+            }
+            continue;
+        }
+
+        /* The break goes after the draft that ends the earlier reply and
+         * before one that starts the next */
+        uint32_t wait = MIMI_STATUS_MIN_INTERVAL_MS;
+        uint32_t unused;
+        esp_err_t err = ESP_OK;
+        if (brk && !early) ch->ops.draft(chat_id, NULL, &unused);
+        if (payload) err = ch->ops.draft(chat_id, payload, &wait);
+        if (brk && early) ch->ops.draft(chat_id, NULL, &unused);
+        message_bus_unref(payload);
+        if (err != ESP_OK) {
+            ESP_LOGD(TAG, "%s draft to %s failed: %s", ch->name, chat_id, esp_err_to_name(err));
+        }
+        if (!payload) continue;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int i = 0; i < MIMI_STATUS_SLOTS; i++) {
+            chat_slot_t *slot = &ch->chats[i];
+            if (slot->drafting && strcmp(slot->chat_id, chat_id) == 0) {
+                slot->draft_wait = wait;
+                slot->draft_ms = (uint32_t)(esp_timer_get_time() / 1000);
+            }
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+esp_err_t channel_dispatch_status(const char *channel, const char *chat_id, const char *status)
+{
+    channel_t *ch = find_channel(channel);
+    if (!ch || !ch->ops.status) return ESP_ERR_NOT_SUPPORTED;
+
+    bool wake = false;
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    chat_slot_t *slot = slot_get(ch, chat_id, status != NULL);
+    if (!status) {
+        if (slot) slot->status_on = false;
+    } else if (slot) {
+        if (!slot->status_on) {
+            slot->status_ms = (uint32_t)(esp_timer_get_time() / 1000) - MIMI_STATUS_MIN_INTERVAL_MS;
+            slot->status_on = true;
+        }
+        if (!slot->status_dirty || strcmp(slot->status, status) != 0) {
+            strncpy(slot->status, status, sizeof(slot->status) - 1);
+            slot->status[sizeof(slot->status) - 1] = '\0';
+            wake = !slot->status_dirty;
+            slot->status_dirty = true;
+        }
+    } else {
+        ret = ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(s_lock);
+
+    /* The task may be blocked with no deadline; have it recompute one */
+    if (wake) message_bus_wake_sub(ch->sub);
+    return ret;
+}
+
+esp_err_t channel_dispatch_draft(const char *channel, const char *chat_id, const char *text)
+{
+    channel_t *ch = find_channel(channel);
+    if (!ch || !ch->ops.draft) return ESP_ERR_NOT_SUPPORTED;
+
+    char *copy = NULL;
+    if (text) {
+        copy = message_bus_strdup(text);
+        if (!copy) return ESP_ERR_NO_MEM;
+    }
+
+    char *stale = NULL;
+    bool wake = false;
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    chat_slot_t *slot = slot_get(ch, chat_id, copy != NULL);
+    if (!copy) {
+        if (slot) {
+            /* A pending break is kept: the next reply must not edit the old one */
+            stale = slot->draft;
+            slot->draft = NULL;
+            slot->draft_early = false;
+            slot->drafting = false;
+        }
+    } else if (slot) {
+        if (!slot->drafting) {
+            slot->drafting = true;
+            slot->draft_ms = (uint32_t)(esp_timer_get_time() / 1000);
+            slot->draft_wait = 0;
+        }
+        stale = slot->draft;
+        slot->draft = copy;
+        slot->draft_early = false;  /* superseded: the earlier reply's end is lost */
+        wake = !stale;
+    } else {
+        stale = copy;
+        ret = ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(s_lock);
+
+    message_bus_unref(stale);
+    if (wake) message_bus_wake_sub(ch->sub);
+    return ret;
+}
+
+esp_err_t channel_dispatch_draft_break(const char *channel, const char *chat_id)
+{
+    channel_t *ch = find_channel(channel);
+    if (!ch || !ch->ops.draft) return ESP_ERR_NOT_SUPPORTED;
+
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    chat_slot_t *slot = slot_get(ch, chat_id, true);
+    if (slot) {
+        slot->draft_early = slot->draft != NULL;
+        slot->draft_break = true;
+    } else {
+        ret = ESP_ERR_NO_MEM;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (ret == ESP_OK) message_bus_wake_sub(ch->sub);
+    return ret;
+}
+
+/* ── Live events ──────────────────────────────────────────────── */
+
+bool channel_dispatch_has_events(const char *channel)
+{
+    channel_t *ch = find_channel(channel);
+    return ch && ch->ops.event;
+}
+
+esp_err_t channel_dispatch_event(const char *channel, const char *chat_id,
+                                 const channel_event_t *ev)
+{
+    channel_t *ch = find_channel(channel);
+    if (!ch || !ch->ops.event) return ESP_ERR_NOT_SUPPORTED;
+    return ch->ops.event(chat_id, ev);
+}
+
+/* ── Dispatch tasks ───────────────────────────────────────────── */
+
+static void channel_task(void *arg)
+{
+    channel_t *ch = (channel_t *)arg;
+    ESP_LOGI(TAG, "Dispatch for %s started on core %d", ch->name, xPortGetCoreID());
+
+    while (1) {
+        mimi_msg_t msg;
+        uint32_t wait = slot_wait_ms(ch);
+        if (message_bus_pop_sub(ch->sub, &msg, wait) != ESP_OK || !msg.content) {
+            /* Queue drained (or woken): catch up on statuses and drafts */
+            slot_flush(ch);
+            continue;
+        }
+
+        ESP_LOGI(TAG, "Dispatching response to %s:%s", msg.channel, msg.chat_id);
+
+        uint32_t start = (uint32_t)(esp_timer_get_time() / 1000);
+        uint32_t deadline = start + MIMI_SEND_RETRY_DEADLINE_MS;
+        uint32_t retry = 0;
+        esp_err_t err;
+        if (reply_held(ch, msg.chat_id)) {
+            /* Behind a rate-limited reply: queue up after it to keep the order */
+            if (reply_hold(ch, msg.chat_id, msg.content, start, deadline)) continue;
+            err = ESP_ERR_NO_MEM;
+        } else {
+            err = ch->ops.send(msg.chat_id, msg.content, &retry);
+            uint32_t due = (uint32_t)(esp_timer_get_time() / 1000) + retry;
+            if (err != ESP_OK && retry && (int32_t)(deadline - due) >= 0 &&
+                reply_hold(ch, msg.chat_id, msg.content, due, deadline)) {
+                /* Rate-limited: resent from the chat's slot, without blocking this task */
+                ESP_LOGI(TAG, "%s reply to %s rate-limited, retry in %lu ms",
+                         ch->name, msg.chat_id, (unsigned long)retry);
+                continue;
+            }
+        }
+        message_bus_unref(msg.content);
+        uint32_t elapsed = record_send(ch, err, start);
+
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "%s send to %s failed after %lu ms: %s", ch->name, msg.chat_id,
+                     (unsigned long)elapsed, esp_err_to_name(err));
+        }
+    }
+}
+
+/* Messages for channels without a registered sender */
+static void unrouted_task(void *arg)
+{
+    while (1) {
+        mimi_msg_t msg;
+        if (message_bus_pop_outbound(&msg, UINT32_MAX) != ESP_OK) continue;
+        ESP_LOGW(TAG, "Unknown channel: %s", msg.channel);
+        message_bus_unref(msg.content);
+    }
+}
+
+esp_err_t channel_dispatch_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    BaseType_t ret = xTaskCreatePinnedToCore(
+        unrouted_task, "out_unrouted",
+        3 * 1024, NULL,
+        MIMI_OUTBOUND_PRIO, NULL, MIMI_OUTBOUND_CORE);
+    return (ret == pdPASS) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t channel_dispatch_register(const char *channel, const channel_ops_t *ops)
+{
+    if (!ops->send) return ESP_ERR_INVALID_ARG;
+    if (s_channel_count >= MIMI_BUS_MAX_SUBS) return ESP_ERR_NO_MEM;
+
+    channel_t *ch = &s_channels[s_channel_count];
+    strncpy(ch->name, channel, sizeof(ch->name) - 1);
+    ch->ops = *ops;
+    ch->sub = message_bus_subscribe(channel, MIMI_BUS_QUEUE_LEN);
+    if (!ch->sub) return ESP_ERR_NO_MEM;
+
+    char task_name[16];
+    snprintf(task_name, sizeof(task_name), "out_%s", channel);
+    BaseType_t ret = xTaskCreatePinnedToCore(
+        channel_task, task_name,
+        ops->stack, ch,
+        MIMI_OUTBOUND_PRIO, NULL, MIMI_OUTBOUND_CORE);
+    if (ret != pdPASS) return ESP_FAIL;
+
+    s_channel_count++;
+    return ESP_OK;
+}
+
+void channel_dispatch_print_stats(void)
+{
+    printf("Channels:\n");
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < s_channel_count; i++) {
+        const channel_t *ch = &s_channels[i];
+        unsigned n = ch->sent + ch->failed;
+        printf("  %-12s sent %-6u failed %-4u last %lu ms  avg %lu ms  max %lu ms  "
+               "status %u  drafts %u\n",
+               ch->name, ch->sent, ch->failed, (unsigned long)ch->last_ms,
+               (unsigned long)(n ? ch->total_ms / n : 0), (unsigned long)ch->max_ms,
+               ch->status_sent, ch->draft_sent);
+    }
+    xSemaphoreGive(s_lock);
+}
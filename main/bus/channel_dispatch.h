@@ -0,0 +1,129 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Delivers one outbound message on a channel. When rate-limited before
+ * anything could be shown, sets *retry_ms to when to try the same text
+ * again; the dispatch task keeps it in the chat's slot and resends it then,
+ * until MIMI_SEND_RETRY_DEADLINE_MS after the first attempt.
+ */
+typedef esp_err_t (*channel_send_t)(const char *chat_id, const char *text, uint32_t *retry_ms);
+
+/** Shows a transient "still working" status in a chat. */
+typedef esp_err_t (*channel_status_t)(const char *chat_id, const char *status);
+
+/**
+ * Shows the reply so far (the whole text, not a delta) while it is being
+ * generated. The final text still arrives through send. Sets *next_ms to
+ * how long to wait before the next draft for this chat. text NULL marks a
+ * break: the reply shown so far stays as it is and the next draft starts
+ * a new one.
+ */
+typedef esp_err_t (*channel_draft_t)(const char *chat_id, const char *text, uint32_t *next_ms);
+
+typedef enum {
+    CHANNEL_EVENT_TOKEN,            /* text delta of the reply being generated */
+    CHANNEL_EVENT_TOOL_START,
+    CHANNEL_EVENT_TOOL_END,
+    CHANNEL_EVENT_TEXT_END,         /* the tokens so far were not the answer (tool call, error) */
+} channel_event_type_t;
+
+typedef struct {
+    channel_event_type_t type;
+    const char          *text;      /* token: delta (not NUL-terminated); tool: tool name; text end: "" */
+    size_t               len;       /* of text */
+    const char          *id;        /* tool call id, NULL for tokens */
+    bool                 ok;        /* tool end: the tool succeeded */
+} channel_event_t;
+
+/**
+ * Delivers one live turn event. Called on the agent worker's task, in turn
+ * order, while the LLM response is still being read: hand the event off
+ * instead of waiting on the network. The final reply still arrives through
+ * send afterwards.
+ */
+typedef esp_err_t (*channel_event_fn_t)(const char *chat_id, const channel_event_t *ev);
+
+typedef struct {
+    channel_send_t   send;          /* required */
+    channel_status_t status;        /* NULL: the channel has no status indicator */
+    int              status_refresh_ms; /* re-send an unchanged status this often, 0 = never */
+    channel_draft_t  draft;         /* NULL: replies are only sent when complete */
+    channel_event_fn_t event;       /* NULL: no live token/tool events */
+    int              stack;         /* dispatch task stack size in bytes */
+} channel_ops_t;
+
+/**
+ * Start the task that drains outbound messages no channel is registered
+ * for (logged and dropped).
+ */
+esp_err_t channel_dispatch_init(void);
+
+/**
+ * Register a channel: it gets its own bus subscription, queue and dispatch
+ * task, so a slow channel never holds up another. Register during startup,
+ * before the channel's messages flow.
+ *
+ * @param channel  Channel identifier (MIMI_CHAN_*)
+ * @param ops      Delivery functions (called from the channel's task) and
+ *                 task stack size; copied
+ */
+esp_err_t channel_dispatch_register(const char *channel, const channel_ops_t *ops);
+
+/**
+ * Set or clear the status shown in a chat while the agent works.
+ * Never blocks on the network: only the latest status per chat is kept and
+ * the channel's task sends it, at most once per MIMI_STATUS_MIN_INTERVAL_MS
+ * and only while no outbound message is waiting, so statuses never delay
+ * a reply. Clear the status before pushing the reply.
+ *
+ * @param channel  Channel identifier
+ * @param chat_id  Chat the status belongs to
+ * @param status   Status text, or NULL to clear
+ * @return ESP_ERR_NOT_SUPPORTED if the channel has no status indicator,
+ *         ESP_ERR_NO_MEM if all status slots are taken
+ */
+esp_err_t channel_dispatch_status(const char *channel, const char *chat_id, const char *status);
+
+/**
+ * Publish the reply generated so far, or NULL when it is complete (call
+ * before pushing the final reply). Like statuses, drafts never block and
+ * never delay a queued message: only the latest text per chat is kept and
+ * the channel's task sends it when the channel's own interval allows.
+ *
+ * @return ESP_ERR_NOT_SUPPORTED if the channel has no draft support,
+ *         ESP_ERR_NO_MEM if no slot or payload is free
+ */
+esp_err_t channel_dispatch_draft(const char *channel, const char *chat_id, const char *text);
+
+/**
+ * Mark the end of one reply and the start of the next in the same turn
+ * (between agent iterations): the earlier draft is left as shown and the
+ * next draft does not replace it. A draft published just before the break
+ * is still shown first.
+ *
+ * @return ESP_ERR_NOT_SUPPORTED if the channel has no draft support,
+ *         ESP_ERR_NO_MEM if no slot is free
+ */
+esp_err_t channel_dispatch_draft_break(const char *channel, const char *chat_id);
+
+/** Whether the channel takes live events (worth producing them). */
+bool channel_dispatch_has_events(const char *channel);
+
+/**
+ * Deliver a live event right away, bypassing the outbound queue, for
+ * channels cheap enough to stream to (a local socket). Events of one turn
+ * are in order and all precede its reply, because the reply is pushed
+ * after the last event returns.
+ *
+ * @return ESP_ERR_NOT_SUPPORTED if the channel takes no events
+ */
+esp_err_t channel_dispatch_event(const char *channel, const char *chat_id,
+                                 const channel_event_t *ev);
+
+/** Print per-channel send counts, latency and status/draft sends to stdout. */
+void channel_dispatch_print_stats(void);
@@ -1,59 +1,288 @@
 #include "message_bus.h"
 #include "mimi_config.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
 #include <string.h>
 
 static const char *TAG = "bus";
 
-static QueueHandle_t s_inbound_queue;
-static QueueHandle_t s_outbound_queue;
+/* ── Payload pool ─────────────────────────────────────────────── */
 
-esp_err_t message_bus_init(void)
+/*
+ * Payloads live in PSRAM slabs of fixed-size buffers, one slab per size
+ * class, each buffer preceded by a small header with its reference count.
+ * A message fanned out to several subscribers shares one buffer; the last
+ * unref puts it back on its class's free list. Oversized payloads come from
+ * the PSRAM heap with the same header.
+ */
+#define CLASS_COUNT  4
+#define CLASS_HEAP   0xFF
+
+typedef struct bus_buf {
+    struct bus_buf *next_free;
+    uint16_t        refs;
+    uint8_t         cls;            /* size class, or CLASS_HEAP */
+    uint8_t         pad[1];
+} bus_buf_t;
+
+typedef struct {
+    size_t     size;
+    int        count;
+    int        in_use;
+    int        high_water;
+    bus_buf_t *free_list;
+} slab_t;
+
+static slab_t s_slabs[CLASS_COUNT] = {
+    { .size = 256,       .count = MIMI_BUS_SLAB_SMALL },
+    { .size = 1024,      .count = MIMI_BUS_SLAB_MEDIUM },
+    { .size = 4096,      .count = MIMI_BUS_SLAB_LARGE },
+    { .size = 16 * 1024, .count = MIMI_BUS_SLAB_HUGE },
+};
+static unsigned s_heap_allocs;      /* payloads that did not fit a free slab buffer */
+static SemaphoreHandle_t s_lock;    /* pool, reference counts and counters */
+
+static esp_err_t pool_init(void)
 {
-    s_inbound_queue = xQueueCreate(MIMI_BUS_QUEUE_LEN, sizeof(mimi_msg_t));
-    s_outbound_queue = xQueueCreate(MIMI_BUS_QUEUE_LEN, sizeof(mimi_msg_t));
+    for (int c = 0; c < CLASS_COUNT; c++) {
+        slab_t *slab = &s_slabs[c];
+        size_t stride = sizeof(bus_buf_t) + slab->size;
+        uint8_t *mem = heap_caps_malloc(stride * slab->count, MALLOC_CAP_SPIRAM);
+        if (!mem) return ESP_ERR_NO_MEM;
 
-    if (!s_inbound_queue || !s_outbound_queue) {
-        ESP_LOGE(TAG, "Failed to create message queues");
-        return ESP_ERR_NO_MEM;
+        for (int i = slab->count - 1; i >= 0; i--) {
+            bus_buf_t *b = (bus_buf_t *)(mem + stride * i);
+            b->cls = (uint8_t)c;
+            b->next_free = slab->free_list;
+            slab->free_list = b;
+        }
     }
-
-    ESP_LOGI(TAG, "Message bus initialized (queue depth %d)", MIMI_BUS_QUEUE_LEN);
     return ESP_OK;
 }
 
-esp_err_t message_bus_push_inbound(const mimi_msg_t *msg)
+char *message_bus_alloc(size_t size)
 {
-    if (xQueueSend(s_inbound_queue, msg, pdMS_TO_TICKS(1000)) != pdTRUE) {
-        ESP_LOGW(TAG, "Inbound queue full, dropping message");
+    bus_buf_t *b = NULL;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int c = 0; c < CLASS_COUNT && !b; c++) {
+        slab_t *slab = &s_slabs[c];
+        if (slab->size < size || !slab->free_list) continue;
+        b = slab->free_list;
+        slab->free_list = b->next_free;
+        if (++slab->in_use > slab->high_water) slab->high_water = slab->in_use;
+    }
+    if (!b) s_heap_allocs++;
+    xSemaphoreGive(s_lock);
+
+    if (!b) {
+        b = heap_caps_malloc(sizeof(bus_buf_t) + size, MALLOC_CAP_SPIRAM);
+        if (!b) return NULL;
+        b->cls = CLASS_HEAP;
+    }
+    b->next_free = NULL;
+    b->refs = 1;
+    return (char *)(b + 1);
+}
+
+char *message_bus_strdup(const char *s)
+{
+    size_t len = strlen(s);
+    char *payload = message_bus_alloc(len + 1);
+    if (payload) memcpy(payload, s, len + 1);
+    return payload;
+}
+
+void message_bus_ref(const char *payload)
+{
+    if (!payload) return;
+    bus_buf_t *b = (bus_buf_t *)payload - 1;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    b->refs++;
+    xSemaphoreGive(s_lock);
+}
+
+void message_bus_unref(const char *payload)
+{
+    if (!payload) return;
+    bus_buf_t *b = (bus_buf_t *)payload - 1;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool last = --b->refs == 0;
+    if (last && b->cls != CLASS_HEAP) {
+        slab_t *slab = &s_slabs[b->cls];
+        b->next_free = slab->free_list;
+        slab->free_list = b;
+        slab->in_use--;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (last && b->cls == CLASS_HEAP) free(b);
+}
+
+/* ── Queues ───────────────────────────────────────────────────── */
+
+typedef struct {
+    char          name[16];
+    QueueHandle_t handle;
+    int           depth;
+    int           high_water;
+    unsigned      pushed;
+    unsigned      dropped;
+} bus_queue_t;
+
+struct bus_sub {
+    char        channel[16];        /* "*" matches every channel */
+    bus_queue_t queue;
+};
+
+static bus_queue_t s_inbound;
+static bus_queue_t s_outbound;
+static bus_sub_t   s_subs[MIMI_BUS_MAX_SUBS];
+static int         s_sub_count;
+
+static esp_err_t queue_create(bus_queue_t *q, const char *name, int depth)
+{
+    strncpy(q->name, name, sizeof(q->name) - 1);
+    q->depth = depth;
+    q->handle = xQueueCreate(depth, sizeof(mimi_msg_t));
+    return q->handle ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+/* Enqueue one reference to msg->content; it is dropped if the queue stays full */
+static esp_err_t queue_push(bus_queue_t *q, const mimi_msg_t *msg)
+{
+    bool ok = xQueueSend(q->handle, msg, pdMS_TO_TICKS(MIMI_BUS_PUSH_TIMEOUT_MS)) == pdTRUE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (ok) {
+        q->pushed++;
+        int waiting = (int)uxQueueMessagesWaiting(q->handle);
+        if (waiting > q->high_water) q->high_water = waiting;
+    } else {
+        q->dropped++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (!ok) {
+        ESP_LOGW(TAG, "%s queue full, dropping message for %s:%s", q->name, msg->channel, msg->chat_id);
+        message_bus_unref(msg->content);
         return ESP_ERR_NO_MEM;
     }
     return ESP_OK;
 }
 
-esp_err_t message_bus_pop_inbound(mimi_msg_t *msg, uint32_t timeout_ms)
+static esp_err_t queue_pop(bus_queue_t *q, mimi_msg_t *msg, uint32_t timeout_ms)
 {
     TickType_t ticks = (timeout_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
-    if (xQueueReceive(s_inbound_queue, msg, ticks) != pdTRUE) {
+    if (xQueueReceive(q->handle, msg, ticks) != pdTRUE) {
         return ESP_ERR_TIMEOUT;
     }
     return ESP_OK;
 }
 
-esp_err_t message_bus_push_outbound(const mimi_msg_t *msg)
+esp_err_t message_bus_init(void)
 {
-    if (xQueueSend(s_outbound_queue, msg, pdMS_TO_TICKS(1000)) != pdTRUE) {
-        ESP_LOGW(TAG, "Outbound queue full, dropping message");
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock || pool_init() != ESP_OK ||
+        queue_create(&s_inbound, "inbound", MIMI_BUS_QUEUE_LEN) != ESP_OK ||
+        queue_create(&s_outbound, "outbound", MIMI_BUS_QUEUE_LEN) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create message queues");
         return ESP_ERR_NO_MEM;
     }
+
+    ESP_LOGI(TAG, "Message bus initialized (queue depth %d)", MIMI_BUS_QUEUE_LEN);
     return ESP_OK;
 }
 
+esp_err_t message_bus_push_inbound(const mimi_msg_t *msg)
+{
+    return queue_push(&s_inbound, msg);
+}
+
+esp_err_t message_bus_pop_inbound(mimi_msg_t *msg, uint32_t timeout_ms)
+{
+    return queue_pop(&s_inbound, msg, timeout_ms);
+}
+
+esp_err_t message_bus_push_outbound(const mimi_msg_t *msg)
+{
+    bus_sub_t *match[MIMI_BUS_MAX_SUBS];
+    int n = 0;
+    for (int i = 0; i < s_sub_count; i++) {
+        if (strcmp(s_subs[i].channel, "*") == 0 || strcmp(s_subs[i].channel, msg->channel) == 0) {
+            match[n++] = &s_subs[i];
+        }
+    }
+    if (n == 0) return queue_push(&s_outbound, msg);
+
+    /* One reference per subscriber; the caller's covers the first */
+    for (int i = 1; i < n; i++) message_bus_ref(msg->content);
+
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < n; i++) {
+        if (queue_push(&match[i]->queue, msg) != ESP_OK) ret = ESP_ERR_NO_MEM;
+    }
+    return ret;
+}
+
 esp_err_t message_bus_pop_outbound(mimi_msg_t *msg, uint32_t timeout_ms)
 {
-    TickType_t ticks = (timeout_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
-    if (xQueueReceive(s_outbound_queue, msg, ticks) != pdTRUE) {
-        return ESP_ERR_TIMEOUT;
+    return queue_pop(&s_outbound, msg, timeout_ms);
+}
+
+bus_sub_t *message_bus_subscribe(const char *channel, int depth)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bus_sub_t *sub = s_sub_count < MIMI_BUS_MAX_SUBS ? &s_subs[s_sub_count] : NULL;
+    if (sub) {
+        strncpy(sub->channel, channel, sizeof(sub->channel) - 1);
+        if (queue_create(&sub->queue, channel, depth) == ESP_OK) {
+            s_sub_count++;
+        } else {
+            memset(sub, 0, sizeof(*sub));
+            sub = NULL;
+        }
     }
-    return ESP_OK;
+    xSemaphoreGive(s_lock);
+
+    if (!sub) ESP_LOGE(TAG, "Cannot subscribe to %s", channel);
+    return sub;
+}
+
+esp_err_t message_bus_pop_sub(bus_sub_t *sub, mimi_msg_t *msg, uint32_t timeout_ms)
+{
+    return queue_pop(&sub->queue, msg, timeout_ms);
+}
+
+void message_bus_wake_sub(bus_sub_t *sub)
+{
+    mimi_msg_t wake = {0};
+    xQueueSend(sub->queue.handle, &wake, 0);
+}
+
+static void print_queue(const bus_queue_t *q)
+{
+    printf("  %-12s %3d/%-3d  peak %-3d  pushed %-6u dropped %u\n", q->name,
+           (int)uxQueueMessagesWaiting(q->handle), q->depth, q->high_water, q->pushed, q->dropped);
+}
+
+void message_bus_print_stats(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    printf("Queues:\n");
+    print_queue(&s_inbound);
+    print_queue(&s_outbound);
+    for (int i = 0; i < s_sub_count; i++) print_queue(&s_subs[i].queue);
+
+    printf("Payload pool:\n");
+    for (int c = 0; c < CLASS_COUNT; c++) {
+        const slab_t *slab = &s_slabs[c];
+        printf("  %5d B   %3d/%-3d in use  peak %d\n",
+               (int)slab->size, slab->in_use, slab->count, slab->high_water);
+    }
+    printf("  heap fallbacks: %u\n", s_heap_allocs);
+    xSemaphoreGive(s_lock);
 }
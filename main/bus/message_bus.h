@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stddef.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 
@@ -13,34 +14,83 @@
 typedef struct {
     char channel[16];       /* "telegram", "websocket", "cli" */
     char chat_id[32];       /* Telegram chat_id or WS client id */
-    char *content;          /* Heap-allocated message text (caller must free) */
+    char *content;          /* Bus payload (message_bus_alloc/strdup), reference-counted */
 } mimi_msg_t;
 
 /**
- * Initialize the message bus (inbound + outbound FreeRTOS queues).
+ * Initialize the message bus: payload pool and inbound + outbound queues.
  */
 esp_err_t message_bus_init(void);
 
+/* ── Payloads ─────────────────────────────────────────────────── */
+
+/**
+ * Allocate a payload of size bytes from the PSRAM slab pool (falls back to
+ * the PSRAM heap for sizes beyond the largest class). The caller holds one
+ * reference. Payloads are read-only once pushed.
+ */
+char *message_bus_alloc(size_t size);
+
+/** message_bus_alloc() + copy of a string. */
+char *message_bus_strdup(const char *s);
+
+/** Take another reference to a payload (NULL is ignored). */
+void message_bus_ref(const char *payload);
+
+/** Drop a reference; the last one returns the buffer to its pool. */
+void message_bus_unref(const char *payload);
+
+/* ── Queues ───────────────────────────────────────────────────── */
+
 /**
  * Push a message to the inbound queue (towards Agent Loop).
- * The bus takes ownership of msg->content.
+ * The bus takes over the caller's reference to msg->content, also when the
+ * queue stays full for MIMI_BUS_PUSH_TIMEOUT_MS and the message is dropped.
  */
 esp_err_t message_bus_push_inbound(const mimi_msg_t *msg);
 
 /**
  * Pop a message from the inbound queue (blocking).
- * Caller must free msg->content when done.
+ * Caller must message_bus_unref(msg->content) when done.
  */
 esp_err_t message_bus_pop_inbound(mimi_msg_t *msg, uint32_t timeout_ms);
 
 /**
- * Push a message to the outbound queue (towards channels).
- * The bus takes ownership of msg->content.
+ * Push a message towards the channels. Every subscriber whose channel
+ * matches gets the same payload with its own reference; with no matching
+ * subscriber it goes to the default outbound queue. Takes over the caller's
+ * reference like message_bus_push_inbound().
  */
 esp_err_t message_bus_push_outbound(const mimi_msg_t *msg);
 
 /**
- * Pop a message from the outbound queue (blocking).
- * Caller must free msg->content when done.
+ * Pop a message from the default outbound queue (blocking).
+ * Caller must message_bus_unref(msg->content) when done.
  */
 esp_err_t message_bus_pop_outbound(mimi_msg_t *msg, uint32_t timeout_ms);
+
+/** An outbound subscription with its own queue. */
+typedef struct bus_sub bus_sub_t;
+
+/**
+ * Subscribe to outbound messages of one channel, or "*" for all. Meant for
+ * startup, before messages flow.
+ * @return NULL when MIMI_BUS_MAX_SUBS subscriptions exist or out of memory
+ */
+bus_sub_t *message_bus_subscribe(const char *channel, int depth);
+
+/**
+ * Pop a message from a subscription's queue (blocking).
+ * Caller must message_bus_unref(msg->content) when done.
+ */
+esp_err_t message_bus_pop_sub(bus_sub_t *sub, mimi_msg_t *msg, uint32_t timeout_ms);
+
+/**
+ * Wake a subscription's consumer without a message: its pop returns one
+ * with NULL content. Lets a consumer interleave other work (status updates)
+ * with its queue. Never blocks; a full queue wakes the consumer anyway.
+ */
+void message_bus_wake_sub(bus_sub_t *sub);
+
+/** Print queue occupancy, drop counters and pool usage to stdout. */
+void message_bus_print_stats(void);
@@ -7,6 +7,8 @@
 #include "memory/session_mgr.h"
 #include "proxy/http_proxy.h"
 #include "tools/tool_web_search.h"
+#include "bus/message_bus.h"
+#include "bus/channel_dispatch.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -184,6 +186,28 @@ static int cmd_session_clear(int argc, char **argv)
     return 0;
 }
 
+/* --- session_bench command --- */
+static struct {
+    struct arg_int *records;
+    struct arg_end *end;
+} session_bench_args;
+
+static int cmd_session_bench(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&session_bench_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, session_bench_args.end, argv[0]);
+        return 1;
+    }
+    int records = session_bench_args.records->count ? session_bench_args.records->ival[0] : 10000;
+    if (records < 100 || records > 100000) {
+        printf("Records must be between 100 and 100000.\n");
+        return 1;
+    }
+    session_bench(records);
+    return 0;
+}
+
 /* --- heap_info command --- */
 static int cmd_heap_info(int argc, char **argv)
 {
@@ -196,6 +220,21 @@ static int cmd_heap_info(int argc, char **argv)
     return 0;
 }
 
+/* --- bus_stats command --- */
+static int cmd_bus_stats(int argc, char **argv)
+{
+    message_bus_print_stats();
+    channel_dispatch_print_stats();
+    return 0;
+}
+
+/* --- tg_stats command --- */
+static int cmd_tg_stats(int argc, char **argv)
+{
+    telegram_print_stats();
+    return 0;
+}
+
 /* --- set_proxy command --- */
 static struct {
     struct arg_str *host;
@@ -241,6 +280,35 @@ static int cmd_set_search_key(int argc, char **argv)
     return 0;
 }
 
+/* --- search_cache command --- */
+static struct {
+    struct arg_lit *clear;
+    struct arg_end *end;
+} search_cache_args;
+
+static int cmd_search_cache(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&search_cache_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, search_cache_args.end, argv[0]);
+        return 1;
+    }
+    if (search_cache_args.clear->count) {
+        tool_web_search_cache_clear();
+        printf("Search cache cleared.\n");
+        return 0;
+    }
+
+    web_search_cache_stats_t stats;
+    tool_web_search_cache_stats(&stats);
+    unsigned lookups = stats.hits + stats.misses;
+    printf("Entries: %d / %d\n", stats.entries, MIMI_SEARCH_CACHE_SLOTS);
+    printf("Hits:    %u\n", stats.hits);
+    printf("Misses:  %u\n", stats.misses);
+    printf("Hit rate: %u%%\n", lookups ? stats.hits * 100 / lookups : 0);
+    return 0;
+}
+
 /* --- wifi_scan command --- */
 static int cmd_wifi_scan(int argc, char **argv)
 {
@@ -450,6 +518,17 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&sess_clear_cmd);
 
+    /* session_bench */
+    session_bench_args.records = arg_int0(NULL, NULL, "<records>", "Largest file size in records (default 10000)");
+    session_bench_args.end = arg_end(1);
+    esp_console_cmd_t sess_bench_cmd = {
+        .command = "session_bench",
+        .help = "Time session history loading as the file grows",
+        .func = &cmd_session_bench,
+        .argtable = &session_bench_args,
+    };
+    esp_console_cmd_register(&sess_bench_cmd);
+
     /* heap_info */
     esp_console_cmd_t heap_cmd = {
         .command = "heap_info",
@@ -458,6 +537,22 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&heap_cmd);
 
+    /* bus_stats */
+    esp_console_cmd_t bus_stats_cmd = {
+        .command = "bus_stats",
+        .help = "Show bus queues, payload pool and per-channel send latency",
+        .func = &cmd_bus_stats,
+    };
+    esp_console_cmd_register(&bus_stats_cmd);
+
+    /* tg_stats */
+    esp_console_cmd_t tg_stats_cmd = {
+        .command = "tg_stats",
+        .help = "Show Telegram poll/send counts and TLS handshakes",
+        .func = &cmd_tg_stats,
+    };
+    esp_console_cmd_register(&tg_stats_cmd);
+
     /* set_search_key */
     search_key_args.key = arg_str1(NULL, NULL, "<key>", "Brave Search API key");
     search_key_args.end = arg_end(1);
@@ -469,6 +564,17 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&search_key_cmd);
 
+    /* search_cache */
+    search_cache_args.clear = arg_lit0(NULL, "clear", "Drop all cached results");
+    search_cache_args.end = arg_end(1);
+    esp_console_cmd_t search_cache_cmd = {
+        .command = "search_cache",
+        .help = "Show web_search cache hit/miss counters",
+        .func = &cmd_search_cache,
+        .argtable = &search_cache_args,
+    };
+    esp_console_cmd_register(&search_cache_cmd);
+
     /* set_proxy */
     proxy_args.host = arg_str1(NULL, NULL, "<host>", "Proxy host/IP");
     proxy_args.port = arg_int1(NULL, NULL, "<port>", "Proxy port");
@@ -0,0 +1,173 @@
+#include "clock_service.h"
+#include "mimi_config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#if MIMI_CLOCK_SNTP
+#include "esp_netif_sntp.h"
+#endif
+
+static const char *TAG = "clock";
+
+typedef enum {
+    SRC_NONE,
+    SRC_HTTP,
+    SRC_SNTP,
+} clock_source_t;
+
+static const char *SOURCE_NAMES[] = { "none", "HTTP Date", "SNTP" };
+
+static SemaphoreHandle_t s_lock;
+static clock_source_t s_source;
+static int64_t s_ref_mono_us;       /* monotonic time of the last sync */
+static int64_t s_ref_wall_us;       /* wall time it was synced to */
+static int     s_drift_ppm;
+
+/* ── Sync ─────────────────────────────────────────────────────── */
+
+/*
+ * Record a reference time taken at monotonic time mono. The wall clock
+ * projected from the previous sync along the monotonic clock gives the
+ * offset accumulated since; over a long enough span that is the drift.
+ * HTTP Date has one-second resolution, so it only steps the clock when it
+ * is off by more than that, and only spans of 10+ minutes estimate drift.
+ */
+static void clock_sample(int64_t wall_us, int64_t mono, clock_source_t src, bool already_set)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    int64_t offset_us = 0;
+    if (s_source != SRC_NONE) {
+        int64_t elapsed_us = mono - s_ref_mono_us;
+        offset_us = wall_us - (s_ref_wall_us + elapsed_us);
+        if (elapsed_us >= 10LL * 60 * 1000000) {
+            s_drift_ppm = (int)(offset_us * 1000000 / elapsed_us);
+        }
+    }
+
+    if (!already_set) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        int64_t system_us = (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+        int64_t error_us = wall_us - system_us;
+        if (s_source == SRC_NONE || error_us > 2000000 || error_us < -2000000) {
+            struct timeval tv = {
+                .tv_sec = (time_t)(wall_us / 1000000),
+                .tv_usec = (suseconds_t)(wall_us % 1000000),
+            };
+            settimeofday(&tv, NULL);
+        }
+    }
+
+    bool first = s_source == SRC_NONE;
+    s_source = src;
+    s_ref_mono_us = mono;
+    s_ref_wall_us = wall_us;
+    int drift = s_drift_ppm;
+    xSemaphoreGive(s_lock);
+
+    if (first) {
+        time_t t = (time_t)(wall_us / 1000000);
+        struct tm local;
+        char buf[40];
+        localtime_r(&t, &local);
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S %Z", &local);
+        ESP_LOGI(TAG, "Clock set via %s: %s", SOURCE_NAMES[src], buf);
+    } else {
+        ESP_LOGI(TAG, "Resynced via %s, offset %+lld ms, drift %d ppm",
+                 SOURCE_NAMES[src], (long long)(offset_us / 1000), drift);
+    }
+}
+
+#if MIMI_CLOCK_SNTP
+static void sntp_synced(struct timeval *tv)
+{
+    clock_sample((int64_t)tv->tv_sec * 1000000 + tv->tv_usec, esp_timer_get_time(), SRC_SNTP, true);
+}
+#endif
+
+/* Days since 1970-01-01 of a proleptic Gregorian date (no TZ involved) */
+static int64_t days_from_civil(int y, int m, int d)
+{
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + doe - 719468;
+}
+
+/* Parse "Sat, 01 Feb 2025 10:25:00 GMT" into seconds since the epoch */
+static bool parse_http_date(const char *s, int64_t *out)
+{
+    static const char *MONTHS = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    int day, year, hour, min, sec;
+    char mon[4] = {0};
+    if (sscanf(s, "%*[^,], %d %3s %d %d:%d:%d", &day, mon, &year, &hour, &min, &sec) != 6) {
+        return false;
+    }
+    const char *p = strstr(MONTHS, mon);
+    if (!p || strlen(mon) != 3 || (p - MONTHS) % 3 != 0) return false;
+
+    *out = days_from_civil(year, (int)(p - MONTHS) / 3 + 1, day) * 86400 +
+           hour * 3600 + min * 60 + sec;
+    return true;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+esp_err_t clock_service_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+    /* The only place TZ is set; everything else just uses localtime_r() */
+    setenv("TZ", MIMI_TIMEZONE, 1);
+    tzset();
+
+#if MIMI_CLOCK_SNTP
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(MIMI_CLOCK_SNTP_SERVER);
+    config.sync_cb = sntp_synced;
+    esp_err_t err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "SNTP unavailable (%s), relying on HTTP Date headers", esp_err_to_name(err));
+    }
+#endif
+
+    ESP_LOGI(TAG, "Clock service started (TZ %s)", MIMI_TIMEZONE);
+    return ESP_OK;
+}
+
+void clock_service_observe_date(const char *http_date)
+{
+    if (!s_lock) return;
+    int64_t mono = esp_timer_get_time();
+
+    /* Only needed until the first sync and when the last one has aged */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool want = s_source == SRC_NONE ||
+                mono - s_ref_mono_us >= (int64_t)MIMI_CLOCK_RESYNC_S * 1000000;
+    xSemaphoreGive(s_lock);
+    if (!want) return;
+
+    int64_t t;
+    if (!parse_http_date(http_date, &t)) return;
+    /* Midpoint of the second the server stamped */
+    clock_sample(t * 1000000 + 500000, mono, SRC_HTTP, false);
+}
+
+bool clock_service_synced(void)
+{
+    if (!s_lock) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool synced = s_source != SRC_NONE;
+    xSemaphoreGive(s_lock);
+    return synced;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+
+/**
+ * Wall clock service.
+ *
+ * Sets TZ once, then keeps the system clock in sync from two sources: SNTP
+ * (if MIMI_CLOCK_SNTP) and the Date header of HTTP responses the firmware
+ * receives anyway (Telegram polls, LLM calls), which http_client reports
+ * here. Each sync is checked against the monotonic clock to track drift.
+ * Readers just call time() / localtime_r().
+ */
+
+/** Set the timezone and start SNTP. Call after wifi_manager_init(). */
+esp_err_t clock_service_init(void);
+
+/** Feed an HTTP Date header value ("Sat, 01 Feb 2025 10:25:00 GMT"). */
+void clock_service_observe_date(const char *http_date);
+
+/** True once the system clock has been set from any source. */
+bool clock_service_synced(void);
@@ -1,22 +1,32 @@
 #include "ws_server.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "bus/channel_dispatch.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include "esp_log.h"
 #include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "cJSON.h"
 
 static const char *TAG = "ws";
 
 static httpd_handle_t s_server = NULL;
 
-/* Simple client tracking */
+/*
+ * Simple client tracking. Frames to a client are serialized into its queue
+ * and written by the server task, so neither the agent worker nor the
+ * dispatch task ever waits on a slow socket.
+ */
 typedef struct {
     int fd;
     char chat_id[32];
     bool active;
+    QueueHandle_t frames;           /* serialized frames (char *) in send order */
+    bool draining;                  /* a drain is queued on the server task */
+    unsigned dropped;               /* event frames lost to a full queue */
 } ws_client_t;
 
 static ws_client_t s_clients[MIMI_WS_MAX_CLIENTS];
@@ -41,10 +51,21 @@ static ws_client_t *find_client_by_chat_id(const char *chat_id)
     return NULL;
 }
 
+/* Free frames left for a client that is gone */
+static void discard_frames(ws_client_t *client)
+{
+    char *json_str;
+    while (xQueueReceive(client->frames, &json_str, 0) == pdTRUE) {
+        free(json_str);
+    }
+}
+
 static ws_client_t *add_client(int fd)
 {
     for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
         if (!s_clients[i].active) {
+            discard_frames(&s_clients[i]);
+            s_clients[i].dropped = 0;
             s_clients[i].fd = fd;
             snprintf(s_clients[i].chat_id, sizeof(s_clients[i].chat_id), "ws_%d", fd);
             s_clients[i].active = true;
@@ -130,7 +151,7 @@ static esp_err_t ws_handler(httpd_req_t *req)
         mimi_msg_t msg = {0};
         strncpy(msg.channel, MIMI_CHAN_WEBSOCKET, sizeof(msg.channel) - 1);
         strncpy(msg.chat_id, chat_id, sizeof(msg.chat_id) - 1);
-        msg.content = strdup(content->valuestring);
+        msg.content = message_bus_strdup(content->valuestring);
         if (msg.content) {
             message_bus_push_inbound(&msg);
         }
@@ -143,6 +164,10 @@ static esp_err_t ws_handler(httpd_req_t *req)
 esp_err_t ws_server_start(void)
 {
     memset(s_clients, 0, sizeof(s_clients));
+    for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
+        s_clients[i].frames = xQueueCreate(MIMI_WS_CLIENT_QUEUE, sizeof(char *));
+        if (!s_clients[i].frames) return ESP_ERR_NO_MEM;
+    }
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = MIMI_WS_PORT;
@@ -168,7 +193,82 @@ esp_err_t ws_server_start(void)
     return ESP_OK;
 }
 
-esp_err_t ws_server_send(const char *chat_id, const char *text)
+/* Server task: write out everything queued for one client */
+static void drain_frames(void *arg)
+{
+    ws_client_t *client = (ws_client_t *)arg;
+
+    while (1) {
+        char *json_str;
+        while (xQueueReceive(client->frames, &json_str, 0) == pdTRUE) {
+            if (!client->active) {
+                free(json_str);
+                continue;
+            }
+            httpd_ws_frame_t ws_pkt = {
+                .type = HTTPD_WS_TYPE_TEXT,
+                .payload = (uint8_t *)json_str,
+                .len = strlen(json_str),
+            };
+            esp_err_t ret = httpd_ws_send_frame_async(s_server, client->fd, &ws_pkt);
+            free(json_str);
+            if (ret != ESP_OK) {
+                ESP_LOGW(TAG, "Failed to send to %s: %s", client->chat_id, esp_err_to_name(ret));
+                remove_client(client->fd);
+            }
+        }
+
+        /* A sender that saw draining still set did not queue a drain;
+         * pick its frame up here */
+        __atomic_store_n(&client->draining, false, __ATOMIC_RELEASE);
+        if (uxQueueMessagesWaiting(client->frames) == 0 ||
+            __atomic_exchange_n(&client->draining, true, __ATOMIC_ACQ_REL)) {
+            return;
+        }
+    }
+}
+
+/*
+ * Serialize frame (consumed) into the client's queue and have the server
+ * task send it. Frames to one client go out whole and in queue order.
+ * Waits up to wait_ms for room; an event that finds the queue full is
+ * dropped (the reply still carries the whole text).
+ */
+static esp_err_t send_frame(ws_client_t *client, cJSON *frame, uint32_t wait_ms)
+{
+    char *json_str = cJSON_PrintUnformatted(frame);
+    cJSON_Delete(frame);
+
+    if (!json_str) return ESP_ERR_NO_MEM;
+    if (!client->active) {
+        free(json_str);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (xQueueSend(client->frames, &json_str, pdMS_TO_TICKS(wait_ms)) != pdTRUE) {
+        free(json_str);
+        client->dropped++;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    if (!__atomic_exchange_n(&client->draining, true, __ATOMIC_ACQ_REL) &&
+        httpd_queue_work(s_server, drain_frames, client) != ESP_OK) {
+        __atomic_store_n(&client->draining, false, __ATOMIC_RELEASE);
+        ESP_LOGW(TAG, "Cannot schedule send to %s", client->chat_id);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static cJSON *new_frame(const char *type, const char *chat_id)
+{
+    cJSON *frame = cJSON_CreateObject();
+    cJSON_AddStringToObject(frame, "type", type);
+    cJSON_AddStringToObject(frame, "chat_id", chat_id);
+    return frame;
+}
+
+static esp_err_t send_json(const char *chat_id, const char *type, const char *text)
 {
     if (!s_server) return ESP_ERR_INVALID_STATE;
 
@@ -178,32 +278,75 @@ esp_err_t ws_server_send(const char *chat_id, const char *text)
         return ESP_ERR_NOT_FOUND;
     }
 
-    /* Build response JSON */
-    cJSON *resp = cJSON_CreateObject();
-    cJSON_AddStringToObject(resp, "type", "response");
-    cJSON_AddStringToObject(resp, "content", text);
-    cJSON_AddStringToObject(resp, "chat_id", chat_id);
-
-    char *json_str = cJSON_PrintUnformatted(resp);
-    cJSON_Delete(resp);
+    cJSON *frame = new_frame(type, chat_id);
+    cJSON_AddStringToObject(frame, "content", text);
+    return send_frame(client, frame, MIMI_WS_REPLY_WAIT_MS);
+}
 
-    if (!json_str) return ESP_ERR_NO_MEM;
+esp_err_t ws_server_send(const char *chat_id, const char *text, uint32_t *retry_ms)
+{
+    esp_err_t ret = send_json(chat_id, "response", text);
 
-    httpd_ws_frame_t ws_pkt = {
-        .type = HTTPD_WS_TYPE_TEXT,
-        .payload = (uint8_t *)json_str,
-        .len = strlen(json_str),
-    };
+    /* Ends the turn for clients following token frames, even if the
+     * response frame itself could not be queued */
+    ws_client_t *client = find_client_by_chat_id(chat_id);
+    if (!client) return ret;
+    if (client->dropped) {
+        ESP_LOGW(TAG, "%s: %u event frames dropped, client reads too slowly",
+                 chat_id, client->dropped);
+        client->dropped = 0;
+    }
+    esp_err_t done = send_frame(client, new_frame("done", chat_id), MIMI_WS_REPLY_WAIT_MS);
+    return ret != ESP_OK ? ret : done;
+}
 
-    esp_err_t ret = httpd_ws_send_frame_async(s_server, client->fd, &ws_pkt);
-    free(json_str);
+esp_err_t ws_server_send_event(const char *chat_id, const channel_event_t *ev)
+{
+    if (!s_server) return ESP_ERR_INVALID_STATE;
 
-    if (ret != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to send to %s: %s", chat_id, esp_err_to_name(ret));
-        remove_client(client->fd);
+    /* Quietly skip: the client may have left mid-turn */
+    ws_client_t *client = find_client_by_chat_id(chat_id);
+    if (!client) return ESP_ERR_NOT_FOUND;
+
+    char *text = malloc(ev->len + 1);
+    if (!text) return ESP_ERR_NO_MEM;
+    memcpy(text, ev->text, ev->len);
+    text[ev->len] = '\0';
+
+    cJSON *frame;
+    switch (ev->type) {
+    case CHANNEL_EVENT_TOKEN:
+        frame = new_frame("token", chat_id);
+        cJSON_AddStringToObject(frame, "content", text);
+        break;
+    case CHANNEL_EVENT_TEXT_END:
+        frame = new_frame("text_end", chat_id);
+        break;
+    case CHANNEL_EVENT_TOOL_START:
+        frame = new_frame("tool_start", chat_id);
+        cJSON_AddStringToObject(frame, "content", text);
+        cJSON_AddStringToObject(frame, "id", ev->id ? ev->id : "");
+        break;
+    default:
+        frame = new_frame("tool_end", chat_id);
+        cJSON_AddStringToObject(frame, "content", text);
+        cJSON_AddStringToObject(frame, "id", ev->id ? ev->id : "");
+        cJSON_AddBoolToObject(frame, "ok", ev->ok);
+        break;
     }
+    free(text);
+    return send_frame(client, frame, 0);
+}
+
+esp_err_t ws_server_send_status(const char *chat_id, const char *status)
+{
+    return send_json(chat_id, "status", status);
+}
 
-    return ret;
+esp_err_t ws_server_register_uri(const httpd_uri_t *uri)
+{
+    if (!s_server) return ESP_ERR_INVALID_STATE;
+    return httpd_register_uri_handler(s_server, uri);
 }
 
 esp_err_t ws_server_stop(void)
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "esp_err.h"
+#include "esp_http_server.h"
+#include "bus/channel_dispatch.h"
 
 /**
  * Initialize and start the WebSocket server on MIMI_WS_PORT.
@@ -8,16 +10,52 @@
  *
  * Protocol:
  *   Inbound:  {"type":"message","content":"hello","chat_id":"ws_client1"}
- *   Outbound: {"type":"response","content":"Hi!","chat_id":"ws_client1"}
+ *   Outbound: {"type":"status","content":"mimi is thinking...","chat_id":"ws_client1"}
+ *             {"type":"token","content":"Let me ","chat_id":"ws_client1"}
+ *             {"type":"text_end","chat_id":"ws_client1"}
+ *             {"type":"tool_start","content":"web_search","id":"toolu_1","chat_id":"ws_client1"}
+ *             {"type":"tool_end","content":"web_search","id":"toolu_1","ok":true,"chat_id":"ws_client1"}
+ *             {"type":"token","content":"Hi!","chat_id":"ws_client1"}
+ *             {"type":"response","content":"Hi!","chat_id":"ws_client1"}
+ *             {"type":"done","chat_id":"ws_client1"}
+ *
+ * text_end closes tokens that are not the answer (text before a tool call,
+ * or a partial reply cut off by an error); the next tokens start anew.
+ * response carries the whole answer, or the error message, and replaces
+ * the tokens since the last text_end. done ends every turn, failed ones
+ * included.
  */
 esp_err_t ws_server_start(void);
 
 /**
- * Send a text message to a specific WebSocket client by chat_id.
- * @param chat_id  Client identifier (assigned on connection)
- * @param text     Message text
+ * Send a reply to a specific WebSocket client by chat_id: a "response"
+ * frame with the full text, then "done".
+ * @param chat_id   Client identifier (assigned on connection)
+ * @param text      Message text
+ * @param retry_ms  Unused: a local socket is never rate-limited
+ */
+esp_err_t ws_server_send(const char *chat_id, const char *text, uint32_t *retry_ms);
+
+/**
+ * Send a live token or tool event of the turn in progress (channel event
+ * hook). Called from the agent's task and never blocks: the frame joins the
+ * client's queue (MIMI_WS_CLIENT_QUEUE frames) for the server task to
+ * write, and is dropped if that queue is full.
+ */
+esp_err_t ws_server_send_event(const char *chat_id, const channel_event_t *ev);
+
+/**
+ * Tell a client the agent is still working on its message.
+ * @param chat_id  Client identifier
+ * @param status   Short status line
+ */
+esp_err_t ws_server_send_status(const char *chat_id, const char *status);
+
+/**
+ * Serve an extra URI (e.g. the Telegram webhook) on the same port.
+ * Call after ws_server_start().
  */
-esp_err_t ws_server_send(const char *chat_id, const char *text);
+esp_err_t ws_server_register_uri(const httpd_uri_t *uri);
 
 /**
  * Stop the WebSocket server.
@@ -0,0 +1,736 @@
+#include "http_client.h"
+#include "mimi_config.h"
+#include "proxy/http_proxy.h"
+#include "clock/clock_service.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_http_client.h"
+#include "esp_crt_bundle.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "http";
+
+#define HTTP_RX_BUF_SIZE          4096
+#define HTTP_CONNECT_TIMEOUT_MS   30000
+
+/* ── URL ──────────────────────────────────────────────────────── */
+
+typedef struct {
+    bool        tls;
+    char        host[64];
+    int         port;
+    const char *path;       /* points into the request URL */
+} http_url_t;
+
+static esp_err_t parse_url(const char *url, http_url_t *u)
+{
+    const char *p;
+    if (strncmp(url, "https://", 8) == 0) {
+        u->tls = true;
+        u->port = 443;
+        p = url + 8;
+    } else if (strncmp(url, "http://", 7) == 0) {
+        u->tls = false;
+        u->port = 80;
+        p = url + 7;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t hlen = strcspn(p, ":/?");
+    if (hlen == 0 || hlen >= sizeof(u->host)) return ESP_ERR_INVALID_ARG;
+    memcpy(u->host, p, hlen);
+    u->host[hlen] = '\0';
+    p += hlen;
+
+    if (*p == ':') {
+        u->port = atoi(p + 1);
+        p += 1 + strspn(p + 1, "0123456789");
+    }
+    u->path = (*p == '/') ? p : "/";
+    return ESP_OK;
+}
+
+/* ── Response sink: caller callback or collected body ─────────── */
+
+typedef struct {
+    const http_request_t *req;
+    http_response_t      *resp;
+    size_t                cap;
+    bool                  received;   /* any response bytes seen */
+} sink_t;
+
+static esp_err_t sink_body(sink_t *s, const char *data, size_t len)
+{
+    if (len == 0) return ESP_OK;
+    if (s->req->on_body) return s->req->on_body(data, len, s->req->ctx);
+
+    http_response_t *resp = s->resp;
+    if (s->req->max_body && resp->body_len + len > s->req->max_body) {
+        ESP_LOGW(TAG, "Response body exceeds %u bytes", (unsigned)s->req->max_body);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (resp->body_len + len + 1 > s->cap) {
+        size_t new_cap = s->cap ? s->cap : 4096;
+        while (new_cap < resp->body_len + len + 1) new_cap *= 2;
+        char *tmp = heap_caps_realloc(resp->body, new_cap, MALLOC_CAP_SPIRAM);
+        if (!tmp) return ESP_ERR_NO_MEM;
+        resp->body = tmp;
+        s->cap = new_cap;
+    }
+    memcpy(resp->body + resp->body_len, data, len);
+    resp->body_len += len;
+    resp->body[resp->body_len] = '\0';
+    return ESP_OK;
+}
+
+static int request_timeout(const http_request_t *req)
+{
+    return req->timeout_ms > 0 ? req->timeout_ms : 15000;
+}
+
+static const char *request_method(const http_request_t *req)
+{
+    return req->method ? req->method : "GET";
+}
+
+static bool request_has_body(const http_request_t *req)
+{
+    return req->body || req->body_writer;
+}
+
+/* ── Streamed request bodies ──────────────────────────────────── */
+
+/* Byte budget around a transport write: a writer that produces more or
+ * less than the announced body_len would corrupt the connection. */
+typedef struct {
+    http_write_t write;
+    void        *wctx;
+    size_t       left;
+} body_guard_t;
+
+static esp_err_t guarded_write(const char *data, size_t len, void *ctx)
+{
+    body_guard_t *g = (body_guard_t *)ctx;
+    if (len > g->left) {
+        ESP_LOGE(TAG, "Request body larger than announced");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    g->left -= len;
+    return g->write(data, len, g->wctx);
+}
+
+static esp_err_t run_body_writer(const http_request_t *req, http_write_t write, void *wctx)
+{
+    body_guard_t g = { .write = write, .wctx = wctx, .left = req->body_len };
+    esp_err_t err = req->body_writer(guarded_write, &g, req->body_ctx);
+    if (err == ESP_OK && g.left != 0) {
+        ESP_LOGE(TAG, "Request body %u bytes short", (unsigned)g.left);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    return err;
+}
+
+/* ── Proxy path: HTTP/1.1 framing over a CONNECT tunnel ───────── */
+
+typedef enum {
+    BODY_UNTIL_CLOSE,
+    BODY_LENGTH,
+    BODY_CHUNK_SIZE,
+    BODY_CHUNK_DATA,
+    BODY_CHUNK_CRLF,
+    BODY_TRAILER,
+    BODY_DONE,
+} body_state_t;
+
+typedef struct {
+    body_state_t    state;
+    size_t          remaining;  /* bytes left in chunk / Content-Length */
+    bool            in_ext;     /* skipping chunk extension up to LF */
+    size_t          line_len;   /* current trailer line length */
+    sink_t         *sink;
+    esp_err_t       err;
+} body_decoder_t;
+
+static void body_emit(body_decoder_t *d, const char *data, size_t len)
+{
+    if (d->err != ESP_OK) return;
+    d->err = sink_body(d->sink, data, len);
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Feed raw body bytes through the framing state machine.
+ * Returns how many were consumed; anything past the end of the body is left. */
+static size_t body_decode(body_decoder_t *d, const char *p, size_t n)
+{
+    size_t i = 0;
+    while (i < n && d->state != BODY_DONE && d->err == ESP_OK) {
+        switch (d->state) {
+        case BODY_UNTIL_CLOSE:
+            body_emit(d, p + i, n - i);
+            i = n;
+            break;
+
+        case BODY_LENGTH:
+        case BODY_CHUNK_DATA: {
+            size_t take = n - i;
+            if (take > d->remaining) take = d->remaining;
+            body_emit(d, p + i, take);
+            i += take;
+            d->remaining -= take;
+            if (d->remaining == 0) {
+                d->state = (d->state == BODY_LENGTH) ? BODY_DONE : BODY_CHUNK_CRLF;
+            }
+            break;
+        }
+
+        case BODY_CHUNK_SIZE: {
+            char c = p[i++];
+            if (c == '\n') {
+                d->state = d->remaining ? BODY_CHUNK_DATA : BODY_TRAILER;
+                d->in_ext = false;
+                d->line_len = 0;
+            } else if (!d->in_ext) {
+                int v = hex_value(c);
+                if (v >= 0) {
+                    d->remaining = d->remaining * 16 + v;
+                } else {
+                    d->in_ext = true;   /* ';' extension or CR */
+                }
+            }
+            break;
+        }
+
+        case BODY_CHUNK_CRLF:
+            if (p[i++] == '\n') {
+                d->state = BODY_CHUNK_SIZE;
+                d->remaining = 0;
+            }
+            break;
+
+        case BODY_TRAILER: {
+            char c = p[i++];
+            if (c == '\n') {
+                if (d->line_len == 0) d->state = BODY_DONE;
+                d->line_len = 0;
+            } else if (c != '\r') {
+                d->line_len++;
+            }
+            break;
+        }
+
+        case BODY_DONE:
+            break;
+        }
+    }
+    return i;
+}
+
+/* Framing-relevant facts from the response head */
+typedef struct {
+    int    status;
+    bool   keep_alive;      /* HTTP/1.1 without Connection: close */
+    bool   chunked;
+    bool   has_length;
+    size_t length;
+} resp_head_t;
+
+/*
+ * Read the status line and headers into buf and parse them in place.
+ * On success *body points just past the blank line and *len counts every
+ * byte read so far, so [*body, buf + *len) is the start of the body.
+ */
+static esp_err_t read_head(proxy_conn_t *conn, char *buf, int *len, char **body,
+                           resp_head_t *h, sink_t *s, int timeout_ms)
+{
+    memset(h, 0, sizeof(*h));
+    *len = 0;
+
+    char *head_end = NULL;
+    while (!head_end) {
+        if (*len >= HTTP_RX_BUF_SIZE - 1) {
+            ESP_LOGE(TAG, "Response headers too large");
+            return ESP_ERR_INVALID_SIZE;
+        }
+        int n = proxy_conn_read(conn, buf + *len, HTTP_RX_BUF_SIZE - 1 - *len, timeout_ms);
+        if (n <= 0) return ESP_ERR_HTTP_FETCH_HEADER;
+        s->received = true;
+        int scan_from = *len > 3 ? *len - 3 : 0;
+        *len += n;
+        buf[*len] = '\0';
+        head_end = strstr(buf + scan_from, "\r\n\r\n");
+    }
+
+    *body = head_end + 4;
+    head_end[2] = '\0';     /* keep the CRLF ending the last header */
+
+    if (strncmp(buf, "HTTP/", 5) == 0) {
+        h->keep_alive = strncmp(buf + 5, "1.1", 3) == 0;
+        const char *sp = strchr(buf, ' ');
+        if (sp) h->status = atoi(sp + 1);
+    }
+
+    char *line = strstr(buf, "\r\n");
+    while (line) {
+        line += 2;
+        char *eol = strstr(line, "\r\n");
+        if (!eol) break;
+        *eol = '\0';
+
+        char *colon = strchr(line, ':');
+        if (colon) {
+            *colon = '\0';
+            char *value = colon + 1;
+            while (*value == ' ' || *value == '\t') value++;
+
+            if (strcasecmp(line, "Content-Length") == 0) {
+                h->has_length = true;
+                h->length = strtoul(value, NULL, 10);
+            } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+                if (strcasestr(value, "chunked")) h->chunked = true;
+            } else if (strcasecmp(line, "Connection") == 0) {
+                if (strcasestr(value, "close")) h->keep_alive = false;
+                else if (strcasestr(value, "keep-alive")) h->keep_alive = true;
+            }
+            if (strcasecmp(line, "Date") == 0) clock_service_observe_date(value);
+            if (s->req->on_header) s->req->on_header(line, value, s->req->ctx);
+        }
+        line = eol;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t tunnel_write(const char *data, size_t len, void *wctx)
+{
+    return proxy_conn_write((proxy_conn_t *)wctx, data, len) < 0 ? ESP_ERR_HTTP_WRITE_DATA : ESP_OK;
+}
+
+static esp_err_t send_request(proxy_conn_t *conn, const http_url_t *u, const http_request_t *req)
+{
+    size_t cap = strlen(request_method(req)) + strlen(u->path) + strlen(u->host) + 96;
+    for (int i = 0; i < req->header_count; i++) {
+        cap += strlen(req->headers[i].name) + strlen(req->headers[i].value) + 4;
+    }
+    char *head = malloc(cap);
+    if (!head) return ESP_ERR_NO_MEM;
+
+    int off = snprintf(head, cap, "%s %s HTTP/1.1\r\nHost: %s", request_method(req), u->path, u->host);
+    if (u->port != 443) off += snprintf(head + off, cap - off, ":%d", u->port);
+    off += snprintf(head + off, cap - off, "\r\n");
+    for (int i = 0; i < req->header_count; i++) {
+        off += snprintf(head + off, cap - off, "%s: %s\r\n",
+                        req->headers[i].name, req->headers[i].value);
+    }
+    if (request_has_body(req)) {
+        off += snprintf(head + off, cap - off, "Content-Length: %u\r\n", (unsigned)req->body_len);
+    }
+    off += snprintf(head + off, cap - off, "\r\n");
+
+    esp_err_t err = ESP_OK;
+    if (proxy_conn_write(conn, head, off) < 0) {
+        err = ESP_ERR_HTTP_WRITE_DATA;
+    } else if (req->body_writer) {
+        /* Streamed straight into the TLS tunnel, chunk by chunk */
+        err = run_body_writer(req, tunnel_write, conn);
+    } else if (req->body_len && proxy_conn_write(conn, req->body, req->body_len) < 0) {
+        err = ESP_ERR_HTTP_WRITE_DATA;
+    }
+    free(head);
+    return err;
+}
+
+/* One request/response on an open tunnel. *keep_alive tells whether the
+ * tunnel is left at a clean message boundary and may be reused. */
+static esp_err_t proxy_exchange(proxy_conn_t *conn, const http_url_t *u,
+                                const http_request_t *req, sink_t *s, bool *keep_alive)
+{
+    *keep_alive = false;
+    int timeout_ms = request_timeout(req);
+
+    esp_err_t err = send_request(conn, u, req);
+    if (err != ESP_OK) return err;
+
+    char *buf = malloc(HTTP_RX_BUF_SIZE);
+    if (!buf) return ESP_ERR_NO_MEM;
+
+    /* 1) Status line + headers */
+    int len;
+    char *body;
+    resp_head_t h;
+    err = read_head(conn, buf, &len, &body, &h, s, timeout_ms);
+    if (err != ESP_OK) {
+        free(buf);
+        return err;
+    }
+    s->resp->status = h.status;
+
+    body_decoder_t d = {
+        .state = BODY_UNTIL_CLOSE,
+        .sink = s,
+        .err = ESP_OK,
+    };
+    if (strcmp(request_method(req), "HEAD") == 0 ||
+        h.status == 204 || h.status == 304 || (h.status >= 100 && h.status < 200)) {
+        d.state = BODY_DONE;
+    } else if (h.chunked) {
+        d.state = BODY_CHUNK_SIZE;
+    } else if (h.has_length) {
+        d.remaining = h.length;
+        d.state = h.length ? BODY_LENGTH : BODY_DONE;
+    }
+
+    /* 2) Body: leftover bytes from the header read, then the rest,
+     *    each slice handed out straight from the receive buffer */
+    size_t avail = buf + len - body;
+    bool leftover = body_decode(&d, body, avail) < avail;
+
+    while (d.state != BODY_DONE && d.err == ESP_OK) {
+        int n = proxy_conn_read(conn, buf, HTTP_RX_BUF_SIZE, timeout_ms);
+        if (n <= 0) break;
+        if (body_decode(&d, buf, n) < (size_t)n) leftover = true;
+    }
+    free(buf);
+
+    if (d.err != ESP_OK) return d.err;
+    if (d.state != BODY_DONE && d.state != BODY_UNTIL_CLOSE) {
+        ESP_LOGW(TAG, "Response body from %s truncated", u->host);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    /* Only a cleanly delimited body leaves the tunnel in a known state */
+    *keep_alive = h.keep_alive && d.state == BODY_DONE && !leftover;
+    return ESP_OK;
+}
+
+static esp_err_t perform_via_proxy(const http_url_t *u, const http_request_t *req, sink_t *s)
+{
+    if (!u->tls) {
+        ESP_LOGE(TAG, "Proxy path supports https only");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    int connect_timeout = request_timeout(req);
+    if (connect_timeout > HTTP_CONNECT_TIMEOUT_MS) connect_timeout = HTTP_CONNECT_TIMEOUT_MS;
+
+    for (int attempt = 0; ; attempt++) {
+        proxy_conn_t *conn = proxy_conn_open(u->host, u->port, connect_timeout);
+        if (!conn) return ESP_ERR_HTTP_CONNECT;
+
+        bool keep_alive = false;
+        esp_err_t err = proxy_exchange(conn, u, req, s, &keep_alive);
+        if (err == ESP_OK) {
+            proxy_conn_release(conn, keep_alive);
+            return ESP_OK;
+        }
+
+        bool retry = attempt == 0 && proxy_conn_reused(conn) && !s->received;
+        proxy_conn_close(conn);
+        if (!retry) return err;
+
+        /* Pooled tunnel was closed under us */
+        ESP_LOGW(TAG, "Reused tunnel to %s failed (%s), reconnecting", u->host, esp_err_to_name(err));
+    }
+}
+
+/* ── Direct path: esp_http_client, optionally kept alive ──────── */
+
+/* One kept-alive connection; its client is created on first use */
+typedef struct {
+    SemaphoreHandle_t        lock;
+    esp_http_client_handle_t client;
+    bool                     reusable;  /* last request left the connection open */
+    TickType_t               last_used;
+} session_conn_t;
+
+struct http_session {
+    char                     name[16];
+    int                      idle_ms;
+    int                      conn_count;
+    unsigned                 connects;  /* counters are shared by all connections */
+    unsigned                 requests;
+    unsigned                 fallbacks;
+    session_conn_t           conns[];
+};
+
+typedef struct {
+    sink_t         *sink;
+    http_session_t *session;
+    esp_err_t       err;        /* first body callback failure */
+    bool            reading;    /* body pulled by esp_http_client_read() */
+} direct_ctx_t;
+
+static esp_err_t direct_event_handler(esp_http_client_event_t *evt)
+{
+    direct_ctx_t *d = (direct_ctx_t *)evt->user_data;
+    const http_request_t *req = d->sink->req;
+
+    switch (evt->event_id) {
+    case HTTP_EVENT_ON_CONNECTED:
+        if (d->session) {
+            unsigned n = __atomic_add_fetch(&d->session->connects, 1, __ATOMIC_RELAXED);
+            ESP_LOGI(TAG, "%s: connection opened (#%u)", d->session->name, n);
+        }
+        break;
+    case HTTP_EVENT_ON_HEADER:
+        d->sink->received = true;
+        if (strcasecmp(evt->header_key, "Date") == 0) clock_service_observe_date(evt->header_value);
+        if (req->on_header) req->on_header(evt->header_key, evt->header_value, req->ctx);
+        break;
+    case HTTP_EVENT_ON_DATA:
+        d->sink->received = true;
+        if (d->reading) break;  /* direct_stream() sinks what it reads */
+        d->sink->resp->status = esp_http_client_get_status_code(evt->client);
+        if (d->err == ESP_OK) {
+            d->err = sink_body(d->sink, (const char *)evt->data, evt->data_len);
+        }
+        break;
+    default:
+        break;
+    }
+    return ESP_OK;
+}
+
+static esp_http_client_method_t client_method(const http_request_t *req)
+{
+    const char *m = request_method(req);
+    if (strcmp(m, "POST") == 0) return HTTP_METHOD_POST;
+    if (strcmp(m, "HEAD") == 0) return HTTP_METHOD_HEAD;
+    if (strcmp(m, "PUT") == 0) return HTTP_METHOD_PUT;
+    if (strcmp(m, "DELETE") == 0) return HTTP_METHOD_DELETE;
+    return HTTP_METHOD_GET;
+}
+
+static esp_http_client_handle_t direct_client_create(const http_request_t *req)
+{
+    esp_http_client_config_t config = {
+        .url = req->url,
+        .event_handler = direct_event_handler,
+        .timeout_ms = request_timeout(req),
+        .buffer_size = 4096,
+        .buffer_size_tx = 4096,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .keep_alive_enable = true,
+    };
+    return esp_http_client_init(&config);
+}
+
+static esp_err_t direct_write(const char *data, size_t len, void *wctx)
+{
+    esp_http_client_handle_t client = (esp_http_client_handle_t)wctx;
+    while (len > 0) {
+        int n = esp_http_client_write(client, data, (int)len);
+        if (n <= 0) return ESP_ERR_HTTP_WRITE_DATA;
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+/*
+ * esp_http_client_perform() sends the body from one buffer, so a streamed
+ * body goes out through open/write instead: each json_writer flush is
+ * written straight to the connection and the body is never held whole.
+ * open() keeps an already connected handle, so sessions stay alive.
+ */
+static esp_err_t direct_stream(esp_http_client_handle_t client, const http_request_t *req,
+                               direct_ctx_t *d)
+{
+    esp_err_t err = esp_http_client_open(client, (int)req->body_len);
+    if (err != ESP_OK) return err;
+
+    err = run_body_writer(req, direct_write, client);
+    if (err != ESP_OK) return err;
+
+    if (esp_http_client_fetch_headers(client) < 0) return ESP_ERR_HTTP_FETCH_HEADER;
+    d->sink->resp->status = esp_http_client_get_status_code(client);
+
+    d->reading = true;
+    char buf[512];
+    for (;;) {
+        int n = esp_http_client_read(client, buf, sizeof(buf));
+        if (n < 0) return ESP_ERR_HTTP_CONNECTION_CLOSED;
+        if (n == 0) break;
+        err = sink_body(d->sink, buf, n);
+        if (err != ESP_OK) return err;
+    }
+    if (!esp_http_client_is_complete_data_received(client)) return ESP_ERR_HTTP_CONNECTION_CLOSED;
+    return ESP_OK;
+}
+
+static esp_err_t direct_exchange(esp_http_client_handle_t client, http_session_t *session,
+                                 const http_request_t *req, sink_t *s)
+{
+    direct_ctx_t d = { .sink = s, .session = session, .err = ESP_OK };
+
+    /* Same host keeps the open connection; another host reconnects */
+    esp_http_client_set_url(client, req->url);
+    esp_http_client_set_timeout_ms(client, request_timeout(req));
+    esp_http_client_set_method(client, client_method(req));
+    esp_http_client_set_user_data(client, &d);
+    for (int i = 0; i < req->header_count; i++) {
+        esp_http_client_set_header(client, req->headers[i].name, req->headers[i].value);
+    }
+
+    esp_err_t err;
+    if (req->body_writer) {
+        esp_http_client_set_post_field(client, NULL, 0);
+        err = direct_stream(client, req, &d);
+    } else {
+        esp_http_client_set_post_field(client, req->body, req->body ? (int)req->body_len : 0);
+        err = esp_http_client_perform(client);
+        if (err == ESP_OK) {
+            s->resp->status = esp_http_client_get_status_code(client);
+            err = d.err;
+        }
+    }
+
+    /* Session clients outlive the request: don't leak headers into the next */
+    for (int i = 0; i < req->header_count; i++) {
+        esp_http_client_delete_header(client, req->headers[i].name);
+    }
+    return err;
+}
+
+/* First connection not in use by another caller; its lock is held on return */
+static session_conn_t *session_acquire(http_session_t *session)
+{
+    for (int i = 0; i < session->conn_count; i++) {
+        if (xSemaphoreTake(session->conns[i].lock, 0) == pdTRUE) return &session->conns[i];
+    }
+    return NULL;
+}
+
+static esp_err_t perform_direct(http_session_t *session, const http_request_t *req, sink_t *s)
+{
+    session_conn_t *conn = session ? session_acquire(session) : NULL;
+    if (!conn) {
+        /* One-shot, or every connection is busy with another caller */
+        if (session) __atomic_add_fetch(&session->fallbacks, 1, __ATOMIC_RELAXED);
+        esp_http_client_handle_t client = direct_client_create(req);
+        if (!client) return ESP_FAIL;
+        esp_err_t err = direct_exchange(client, NULL, req, s);
+        esp_http_client_cleanup(client);
+        return err;
+    }
+
+    if (conn->client && conn->reusable &&
+        xTaskGetTickCount() - conn->last_used > pdMS_TO_TICKS(session->idle_ms)) {
+        /* Server has likely dropped it already; don't find out mid-request */
+        ESP_LOGI(TAG, "%s: closing idle connection", session->name);
+        esp_http_client_close(conn->client);
+        conn->reusable = false;
+    }
+
+    if (!conn->client) {
+        conn->client = direct_client_create(req);
+        if (!conn->client) {
+            xSemaphoreGive(conn->lock);
+            return ESP_FAIL;
+        }
+        conn->reusable = false;
+    }
+
+    __atomic_add_fetch(&session->requests, 1, __ATOMIC_RELAXED);
+    esp_err_t err = direct_exchange(conn->client, session, req, s);
+    if (err != ESP_OK && conn->reusable && !s->received) {
+        /* Kept-alive connection closed by the server: reconnect once */
+        ESP_LOGW(TAG, "%s: reused connection failed (%s), reconnecting",
+                 session->name, esp_err_to_name(err));
+        esp_http_client_close(conn->client);
+        err = direct_exchange(conn->client, session, req, s);
+    }
+
+    if (err != ESP_OK) {
+        esp_http_client_close(conn->client);
+    }
+    conn->reusable = (err == ESP_OK);
+    conn->last_used = xTaskGetTickCount();
+
+    xSemaphoreGive(conn->lock);
+    return err;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+http_session_t *http_session_create_pool(const char *name, int idle_ms, int conns)
+{
+    if (conns < 1) conns = 1;
+    http_session_t *session = calloc(1, sizeof(*session) + conns * sizeof(session_conn_t));
+    if (!session) return NULL;
+    for (int i = 0; i < conns; i++) {
+        session->conns[i].lock = xSemaphoreCreateMutex();
+        if (!session->conns[i].lock) {
+            while (i--) vSemaphoreDelete(session->conns[i].lock);
+            free(session);
+            return NULL;
+        }
+    }
+    strncpy(session->name, name, sizeof(session->name) - 1);
+    session->idle_ms = idle_ms;
+    session->conn_count = conns;
+    return session;
+}
+
+http_session_t *http_session_create(const char *name, int idle_ms)
+{
+    return http_session_create_pool(name, idle_ms, 1);
+}
+
+unsigned http_session_connects(const http_session_t *session)
+{
+    return session ? __atomic_load_n(&session->connects, __ATOMIC_RELAXED) : 0;
+}
+
+void http_session_get_stats(const http_session_t *session, http_session_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!session) return;
+    stats->requests = __atomic_load_n(&session->requests, __ATOMIC_RELAXED);
+    stats->connects = __atomic_load_n(&session->connects, __ATOMIC_RELAXED);
+    stats->fallbacks = __atomic_load_n(&session->fallbacks, __ATOMIC_RELAXED);
+}
+
+esp_err_t http_client_perform(http_session_t *session, const http_request_t *req,
+                              http_response_t *resp)
+{
+    memset(resp, 0, sizeof(*resp));
+
+    http_url_t u;
+    if (parse_url(req->url, &u) != ESP_OK) {
+        ESP_LOGE(TAG, "Unsupported URL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sink_t s = { .req = req, .resp = resp };
+    esp_err_t err = http_proxy_is_enabled() ? perform_via_proxy(&u, req, &s)
+                                            : perform_direct(session, req, &s);
+
+    if (err == ESP_OK && !req->on_body && !resp->body) {
+        /* Empty body: still hand back a valid string */
+        resp->body = heap_caps_calloc(1, 1, MALLOC_CAP_SPIRAM);
+        if (!resp->body) err = ESP_ERR_NO_MEM;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "%s %s failed: %s", request_method(req), u.host, esp_err_to_name(err));
+        http_response_free(resp);
+    }
+    return err;
+}
+
+void http_response_free(http_response_t *resp)
+{
+    free(resp->body);
+    resp->body = NULL;
+    resp->body_len = 0;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Shared HTTP/1.1 client.
+ *
+ * One request API for every outbound HTTPS call. Requests go through the
+ * configured CONNECT proxy (pooled tunnels, framing done here) or directly
+ * via esp_http_client. Response headers and body are handed out straight
+ * from the receive buffer; nothing is copied unless the caller asks for the
+ * body to be collected.
+ */
+
+/** Receives each response header, NUL-terminated and trimmed. */
+typedef void (*http_header_cb_t)(const char *name, const char *value, void *ctx);
+
+/**
+ * Receives decoded body bytes (chunked framing already removed) as they
+ * arrive. The slice is only valid for the duration of the call.
+ * Return non-ESP_OK to abort the request.
+ */
+typedef esp_err_t (*http_body_cb_t)(const char *data, size_t len, void *ctx);
+
+/** Transport write function handed to a body writer. */
+typedef esp_err_t (*http_write_t)(const char *data, size_t len, void *wctx);
+
+/**
+ * Produces a request body of exactly body_len bytes through write().
+ * May be called more than once per request (retry), so it must be repeatable.
+ */
+typedef esp_err_t (*http_body_writer_t)(http_write_t write, void *wctx, void *ctx);
+
+typedef struct {
+    const char *name;
+    const char *value;
+} http_header_t;
+
+typedef struct {
+    const char          *method;        /* "GET" (default), "POST", "HEAD" */
+    const char          *url;           /* https://host[:port]/path?query */
+    const http_header_t *headers;       /* extra request headers, or NULL */
+    int                  header_count;
+    const char          *body;          /* request body, or NULL */
+    size_t               body_len;
+    http_body_writer_t   body_writer;   /* streams body_len bytes instead of body */
+    void                *body_ctx;
+    int                  timeout_ms;
+
+    http_header_cb_t     on_header;     /* optional */
+    http_body_cb_t       on_body;       /* NULL: collect body into the response */
+    void                *ctx;           /* passed to both callbacks */
+    size_t               max_body;      /* collected body limit, 0 = unlimited */
+} http_request_t;
+
+typedef struct {
+    int     status;     /* set before the first on_body call */
+    char   *body;       /* collected body, NUL-terminated (PSRAM); NULL with on_body */
+    size_t  body_len;
+} http_response_t;
+
+/** Keep-alive state for the direct path; see http_session_create(). */
+typedef struct http_session http_session_t;
+
+/**
+ * Create a session that keeps one esp_http_client connection open between
+ * requests and closes it after idle_ms without use. Sessions are meant to
+ * live for the lifetime of the owning module. Requests through the proxy
+ * share the tunnel pool instead.
+ */
+http_session_t *http_session_create(const char *name, int idle_ms);
+
+/**
+ * Like http_session_create(), but with up to conns connections so that many
+ * tasks can keep their own connection alive. A request takes the first idle
+ * one; each connection (and its TLS context) is only opened when first
+ * needed, so concurrency that never happens costs nothing.
+ */
+http_session_t *http_session_create_pool(const char *name, int idle_ms, int conns);
+
+/** Number of TCP/TLS connections the session has opened so far. */
+unsigned http_session_connects(const http_session_t *session);
+
+typedef struct {
+    unsigned requests;      /* requests performed on the session's connections */
+    unsigned connects;      /* TCP/TLS handshakes of those connections */
+    unsigned fallbacks;     /* requests sent one-shot because all were busy */
+} http_session_stats_t;
+
+/** Snapshot of the session's counters (all zero for NULL). */
+void http_session_get_stats(const http_session_t *session, http_session_stats_t *stats);
+
+/**
+ * Perform one request. session may be NULL for a one-shot connection.
+ * A request on a reused connection that fails before any response arrives
+ * is retried once on a fresh connection.
+ *
+ * @return ESP_OK once a complete response was received (any status);
+ *         resp->body must then be released with http_response_free()
+ */
+esp_err_t http_client_perform(http_session_t *session, const http_request_t *req,
+                              http_response_t *resp);
+
+/** Free a collected response body. */
+void http_response_free(http_response_t *resp);
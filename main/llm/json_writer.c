@@ -0,0 +1,250 @@
+#include "json_writer.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+/* ── Output buffer ────────────────────────────────────────────── */
+
+static void jw_flush(json_writer_t *w)
+{
+    if (w->len == 0) return;
+    if (w->sink && w->err == ESP_OK) {
+        w->err = w->sink(w->buf, w->len, w->ctx);
+    }
+    w->len = 0;
+}
+
+static void jw_put(json_writer_t *w, const char *data, size_t len)
+{
+    w->total += len;
+    if (!w->sink) return;   /* counting pass */
+
+    while (len > 0) {
+        size_t room = JW_BUF_SIZE - w->len;
+        size_t n = len < room ? len : room;
+        memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+        if (w->len == JW_BUF_SIZE) jw_flush(w);
+    }
+}
+
+static void jw_putc(json_writer_t *w, char c)
+{
+    jw_put(w, &c, 1);
+}
+
+/* Comma before every member but the first; nothing right after a key */
+static void jw_prefix(json_writer_t *w)
+{
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    if (w->depth > 0) {
+        if (!w->first[w->depth]) jw_putc(w, ',');
+        w->first[w->depth] = false;
+    }
+}
+
+/* ── Structure ────────────────────────────────────────────────── */
+
+void jw_init(json_writer_t *w, jw_sink_t sink, void *ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->sink = sink;
+    w->ctx = ctx;
+}
+
+esp_err_t jw_finish(json_writer_t *w)
+{
+    jw_flush(w);
+    return w->err;
+}
+
+static void jw_open(json_writer_t *w, char c)
+{
+    jw_prefix(w);
+    jw_putc(w, c);
+    if (w->depth < JW_MAX_DEPTH - 1) {
+        w->depth++;
+        w->first[w->depth] = true;
+    } else {
+        w->err = ESP_ERR_INVALID_STATE;
+    }
+}
+
+static void jw_close(json_writer_t *w, char c)
+{
+    if (w->depth > 0) w->depth--;
+    jw_putc(w, c);
+}
+
+void jw_begin_object(json_writer_t *w) { jw_open(w, '{'); }
+void jw_end_object(json_writer_t *w)   { jw_close(w, '}'); }
+void jw_begin_array(json_writer_t *w)  { jw_open(w, '['); }
+void jw_end_array(json_writer_t *w)    { jw_close(w, ']'); }
+
+/* ── Scalars ──────────────────────────────────────────────────── */
+
+/* Escape as cJSON does: quotes, backslash and control characters */
+void jw_string_part(json_writer_t *w, const char *s, size_t len)
+{
+    size_t run = 0;     /* start of the pending unescaped run */
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        jw_put(w, s + run, i - run);
+        run = i + 1;
+        char esc[8];
+        switch (c) {
+        case '"':  jw_put(w, "\\\"", 2); break;
+        case '\\': jw_put(w, "\\\\", 2); break;
+        case '\b': jw_put(w, "\\b", 2); break;
+        case '\f': jw_put(w, "\\f", 2); break;
+        case '\n': jw_put(w, "\\n", 2); break;
+        case '\r': jw_put(w, "\\r", 2); break;
+        case '\t': jw_put(w, "\\t", 2); break;
+        default:
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            jw_put(w, esc, 6);
+            break;
+        }
+    }
+    jw_put(w, s + run, len - run);
+}
+
+void jw_string_begin(json_writer_t *w)
+{
+    jw_prefix(w);
+    jw_putc(w, '"');
+}
+
+void jw_string_end(json_writer_t *w)
+{
+    jw_putc(w, '"');
+}
+
+void jw_string_n(json_writer_t *w, const char *s, size_t len)
+{
+    jw_string_begin(w);
+    jw_string_part(w, s, len);
+    jw_string_end(w);
+}
+
+void jw_string(json_writer_t *w, const char *s)
+{
+    jw_string_n(w, s ? s : "", s ? strlen(s) : 0);
+}
+
+void jw_key(json_writer_t *w, const char *key)
+{
+    jw_string(w, key);
+    jw_putc(w, ':');
+    w->after_key = true;
+}
+
+void jw_int(json_writer_t *w, long v)
+{
+    char num[24];
+    int n = snprintf(num, sizeof(num), "%ld", v);
+    jw_prefix(w);
+    jw_put(w, num, n);
+}
+
+void jw_bool(json_writer_t *w, bool v)
+{
+    jw_prefix(w);
+    if (v) jw_put(w, "true", 4);
+    else jw_put(w, "false", 5);
+}
+
+void jw_raw_n(json_writer_t *w, const char *json, size_t len)
+{
+    jw_prefix(w);
+    jw_put(w, json, len);
+}
+
+void jw_raw(json_writer_t *w, const char *json)
+{
+    jw_raw_n(w, json, strlen(json));
+}
+
+/* ── cJSON values ─────────────────────────────────────────────── */
+
+/* Same number formatting as cJSON_PrintUnformatted */
+static void jw_number(json_writer_t *w, double d)
+{
+    char num[32];
+    int n;
+    if (isnan(d) || isinf(d)) {
+        n = snprintf(num, sizeof(num), "null");
+    } else if (d == (double)(long long)d && fabs(d) < 1e15) {
+        n = snprintf(num, sizeof(num), "%lld", (long long)d);
+    } else {
+        n = snprintf(num, sizeof(num), "%1.15g", d);
+        double back = 0;
+        if (sscanf(num, "%lg", &back) != 1 || back != d) {
+            n = snprintf(num, sizeof(num), "%1.17g", d);
+        }
+    }
+    jw_prefix(w);
+    jw_put(w, num, n);
+}
+
+void jw_cjson(json_writer_t *w, const cJSON *item)
+{
+    if (!item) {
+        jw_raw(w, "null");
+        return;
+    }
+
+    if (cJSON_IsObject(item)) {
+        jw_begin_object(w);
+        for (const cJSON *c = item->child; c; c = c->next) {
+            jw_key(w, c->string ? c->string : "");
+            jw_cjson(w, c);
+        }
+        jw_end_object(w);
+    } else if (cJSON_IsArray(item)) {
+        jw_begin_array(w);
+        for (const cJSON *c = item->child; c; c = c->next) {
+            jw_cjson(w, c);
+        }
+        jw_end_array(w);
+    } else if (cJSON_IsString(item)) {
+        jw_string(w, item->valuestring);
+    } else if (cJSON_IsNumber(item)) {
+        jw_number(w, item->valuedouble);
+    } else if (cJSON_IsTrue(item)) {
+        jw_bool(w, true);
+    } else if (cJSON_IsFalse(item)) {
+        jw_bool(w, false);
+    } else if (cJSON_IsRaw(item) && item->valuestring) {
+        jw_raw(w, item->valuestring);
+    } else {
+        jw_raw(w, "null");
+    }
+}
+
+/* Nested writer whose output is escaped into the parent string */
+static esp_err_t escape_sink(const char *data, size_t len, void *ctx)
+{
+    json_writer_t *parent = (json_writer_t *)ctx;
+    jw_string_part(parent, data, len);
+    return parent->err;
+}
+
+void jw_cjson_as_string(json_writer_t *w, const cJSON *item)
+{
+    /* Also on the counting pass: escaping changes the length */
+    json_writer_t inner;
+    jw_init(&inner, escape_sink, w);
+    jw_string_begin(w);
+    jw_cjson(&inner, item);
+    jw_finish(&inner);
+    jw_string_end(w);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+#include "cJSON.h"
+
+#define JW_BUF_SIZE     1024    /* output is flushed to the sink in chunks of this size */
+#define JW_MAX_DEPTH    16
+
+/** Receives serialized output. Return non-ESP_OK to stop writing. */
+typedef esp_err_t (*jw_sink_t)(const char *data, size_t len, void *ctx);
+
+/**
+ * Streaming JSON writer.
+ *
+ * Serializes straight into a small fixed buffer that is flushed to a sink
+ * as it fills, so a request body never exists as one string. With a NULL
+ * sink it only counts bytes, which gives Content-Length for a second,
+ * identical pass. Commas between members are inserted automatically.
+ */
+typedef struct {
+    char      buf[JW_BUF_SIZE];
+    size_t    len;
+    size_t    total;                /* bytes produced so far */
+    jw_sink_t sink;                 /* NULL: count only */
+    void     *ctx;
+    esp_err_t err;                  /* first sink error; later writes are no-ops */
+    int       depth;
+    bool      first[JW_MAX_DEPTH];  /* nothing written yet at this nesting level */
+    bool      after_key;
+} json_writer_t;
+
+void jw_init(json_writer_t *w, jw_sink_t sink, void *ctx);
+
+/** Flush buffered output. Returns the first error seen, if any. */
+esp_err_t jw_finish(json_writer_t *w);
+
+void jw_begin_object(json_writer_t *w);
+void jw_end_object(json_writer_t *w);
+void jw_begin_array(json_writer_t *w);
+void jw_end_array(json_writer_t *w);
+
+/** Member name inside an object; the next value belongs to it. */
+void jw_key(json_writer_t *w, const char *key);
+
+void jw_string(json_writer_t *w, const char *s);
+void jw_string_n(json_writer_t *w, const char *s, size_t len);
+void jw_int(json_writer_t *w, long v);
+void jw_bool(json_writer_t *w, bool v);
+
+/** A string value written in pieces (e.g. joining several text blocks). */
+void jw_string_begin(json_writer_t *w);
+void jw_string_part(json_writer_t *w, const char *s, size_t len);
+void jw_string_end(json_writer_t *w);
+
+/** An already serialized JSON value, copied verbatim. */
+void jw_raw(json_writer_t *w, const char *json);
+void jw_raw_n(json_writer_t *w, const char *json, size_t len);
+
+/** Serialize a cJSON value without printing it to an intermediate string. */
+void jw_cjson(json_writer_t *w, const cJSON *item);
+
+/** Serialize a cJSON value as an escaped JSON string (its compact text). */
+void jw_cjson_as_string(json_writer_t *w, const cJSON *item);
@@ -0,0 +1,601 @@
+#include "llm_decode.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+
+static const char *TAG = "llm_decode";
+
+/* Tokenizer states */
+enum {
+    ST_VALUE,           /* expecting a value */
+    ST_VALUE_OR_END,    /* after '[' */
+    ST_KEY_OR_END,      /* after '{' */
+    ST_KEY,             /* after ',' in an object */
+    ST_COLON,
+    ST_AFTER,           /* after a value: ',' or a closing bracket */
+    ST_STRING,
+    ST_ESCAPE,
+    ST_UNICODE,
+    ST_SCALAR,          /* number or literal */
+    ST_END,             /* root value complete */
+};
+
+/* Destination of the current string's decoded bytes */
+enum {
+    T_NONE,
+    T_KEY,
+    T_TEXT,
+    T_ARGS,
+    T_STOP,
+    T_TYPE,
+    T_ID,
+    T_NAME,
+    T_ERROR,
+};
+
+/* ── Growable buffers ─────────────────────────────────────────── */
+
+static bool buf_append(char **buf, size_t *len, size_t *cap,
+                       const char *data, size_t n)
+{
+    if (*len + n + 1 > *cap) {
+        size_t new_cap = *cap ? *cap : 256;
+        while (*len + n + 1 > new_cap) new_cap *= 2;
+        char *tmp = realloc(*buf, new_cap);
+        if (!tmp) return false;
+        *buf = tmp;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+    return true;
+}
+
+static void append_text(llm_decoder_t *d, const char *text, size_t len)
+{
+    llm_response_t *resp = d->resp;
+    if (!buf_append(&resp->text, &resp->text_len, &d->text_cap, text, len)) {
+        ESP_LOGE(TAG, "Out of memory for response text");
+        d->failed = true;
+    }
+}
+
+static void append_input(llm_decoder_t *d, int slot, const char *json, size_t len)
+{
+    llm_tool_call_t *call = &d->resp->calls[slot];
+    if (!buf_append(&call->input, &call->input_len, &d->input_cap[slot], json, len)) {
+        ESP_LOGE(TAG, "Out of memory for tool input");
+        d->failed = true;
+    }
+}
+
+/* ── Path tracking ────────────────────────────────────────────── */
+
+/* Member name at a nesting level ("" for arrays and untracked levels) */
+static const char *key_at(const llm_decoder_t *d, int level)
+{
+    if (level >= d->depth || level >= LLM_DECODE_MAX_DEPTH) return "";
+    const llm_decode_frame_t *f = &d->frames[level];
+    return f->array ? "" : f->key;
+}
+
+static bool key_is(const llm_decoder_t *d, int level, const char *key)
+{
+    return strcmp(key_at(d, level), key) == 0;
+}
+
+static int index_at(const llm_decoder_t *d, int level)
+{
+    if (level >= d->depth || level >= LLM_DECODE_MAX_DEPTH) return -1;
+    const llm_decode_frame_t *f = &d->frames[level];
+    return f->array ? f->index : -1;
+}
+
+/* ── Anthropic: $.content[i] blocks ───────────────────────────── */
+
+static bool in_content_block(const llm_decoder_t *d)
+{
+    return d->depth == 3 && key_is(d, 0, "content") && index_at(d, 1) >= 0;
+}
+
+static bool block_type_is(const llm_decoder_t *d, const char *type)
+{
+    /* "type" normally comes first; until it does, assume the block matches */
+    return d->block_type[0] == '\0' || strcmp(d->block_type, type) == 0;
+}
+
+static int block_slot(llm_decoder_t *d)
+{
+    if (d->block_call == -1) {
+        llm_response_t *resp = d->resp;
+        if (resp->call_count >= MIMI_MAX_TOOL_CALLS) {
+            ESP_LOGW(TAG, "Too many tool calls, ignoring extra tool_use block");
+            d->block_call = -2;
+        } else {
+            d->block_call = resp->call_count++;
+        }
+    }
+    return d->block_call;
+}
+
+static void block_end(llm_decoder_t *d)
+{
+    /* A slot opened before "type" turned out not to be a tool_use */
+    if (d->block_call >= 0 && !block_type_is(d, "tool_use")) {
+        llm_tool_call_t *call = &d->resp->calls[d->block_call];
+        free(call->input);
+        memset(call, 0, sizeof(*call));
+        d->input_cap[d->block_call] = 0;
+        d->resp->call_count--;
+    }
+    d->block_call = -1;
+    d->block_type[0] = '\0';
+}
+
+/* ── OpenAI: $.choices[0].message ─────────────────────────────── */
+
+static bool in_choice0(const llm_decoder_t *d)
+{
+    return d->depth >= 3 && key_is(d, 0, "choices") && index_at(d, 1) == 0;
+}
+
+/* Map a tool_calls[] index onto a call slot, allocating on first sight */
+static int openai_call_slot(llm_decoder_t *d, int index)
+{
+    llm_response_t *resp = d->resp;
+    for (int i = 0; i < resp->call_count; i++) {
+        if (d->call_index[i] == index) return i;
+    }
+    if (resp->call_count >= MIMI_MAX_TOOL_CALLS) {
+        ESP_LOGW(TAG, "Too many tool calls, ignoring tool_calls[%d]", index);
+        return -1;
+    }
+    d->call_index[resp->call_count] = index;
+    return resp->call_count++;
+}
+
+static bool in_tool_call(const llm_decoder_t *d)
+{
+    return in_choice0(d) && key_is(d, 2, "message") && key_is(d, 3, "tool_calls") &&
+           index_at(d, 4) >= 0;
+}
+
+/* ── Value routing ────────────────────────────────────────────── */
+
+/* Decide where the string value starting now should go */
+static uint8_t string_target(llm_decoder_t *d)
+{
+    d->str_slot = -1;
+
+    if (d->depth == 2 && key_is(d, 0, "error") && key_is(d, 1, "message")) {
+        return T_ERROR;
+    }
+
+    if (d->format == LLM_STREAM_ANTHROPIC) {
+        if (d->depth == 1 && key_is(d, 0, "stop_reason")) return T_STOP;
+        if (!in_content_block(d)) return T_NONE;
+
+        const char *key = key_at(d, 2);
+        if (strcmp(key, "type") == 0) return T_TYPE;
+        if (strcmp(key, "text") == 0) return block_type_is(d, "text") ? T_TEXT : T_NONE;
+        if (strcmp(key, "id") == 0 || strcmp(key, "name") == 0) {
+            if (!block_type_is(d, "tool_use")) return T_NONE;
+            d->str_slot = block_slot(d);
+            if (d->str_slot < 0) return T_NONE;
+            return key[0] == 'i' ? T_ID : T_NAME;
+        }
+        return T_NONE;
+    }
+
+    if (!in_choice0(d)) return T_NONE;
+    if (d->depth == 3 && key_is(d, 2, "finish_reason")) return T_STOP;
+    if (d->depth == 4 && key_is(d, 2, "message") && key_is(d, 3, "content")) return T_TEXT;
+    if (!in_tool_call(d)) return T_NONE;
+
+    uint8_t target = T_NONE;
+    if (d->depth == 6 && key_is(d, 5, "id")) {
+        target = T_ID;
+    } else if (d->depth == 7 && key_is(d, 5, "function")) {
+        if (key_is(d, 6, "name")) target = T_NAME;
+        else if (key_is(d, 6, "arguments")) target = T_ARGS;
+    }
+    if (target == T_NONE) return T_NONE;
+    d->str_slot = openai_call_slot(d, index_at(d, 4));
+    return d->str_slot < 0 ? T_NONE : target;
+}
+
+/* A value starts at data[i]: count array elements, maybe start a raw capture */
+static void value_begin(llm_decoder_t *d, size_t i)
+{
+    if (d->depth > 0 && d->depth <= LLM_DECODE_MAX_DEPTH) {
+        llm_decode_frame_t *top = &d->frames[d->depth - 1];
+        if (top->array) top->index++;
+    }
+
+    if (d->capturing || d->format != LLM_STREAM_ANTHROPIC) return;
+    if (!in_content_block(d) || !key_is(d, 2, "input") || !block_type_is(d, "tool_use")) return;
+
+    int slot = block_slot(d);
+    if (slot < 0) return;
+    d->capturing = true;
+    d->capture_depth = d->depth;
+    d->capture_slot = slot;
+    d->capture_from = i;
+}
+
+/* The value ending just before data[end] is complete */
+static void value_end(llm_decoder_t *d, const char *data, size_t end)
+{
+    if (d->depth == 0) d->state = ST_END;
+    if (!d->capturing || d->depth != d->capture_depth) return;
+
+    append_input(d, d->capture_slot, data + d->capture_from, end - d->capture_from);
+    d->capturing = false;
+}
+
+static void container_open(llm_decoder_t *d, bool array)
+{
+    if (d->depth < LLM_DECODE_MAX_DEPTH) {
+        llm_decode_frame_t *f = &d->frames[d->depth];
+        f->array = array;
+        f->index = -1;
+        f->key[0] = '\0';
+    }
+    d->depth++;
+
+    if (!array && d->format == LLM_STREAM_ANTHROPIC && in_content_block(d)) {
+        d->block_call = -1;
+        d->block_type[0] = '\0';
+    }
+}
+
+static bool container_close(llm_decoder_t *d, bool array)
+{
+    if (d->depth == 0) return false;
+    if (d->depth <= LLM_DECODE_MAX_DEPTH && d->frames[d->depth - 1].array != array) {
+        return false;
+    }
+    if (!array && d->format == LLM_STREAM_ANTHROPIC && in_content_block(d)) {
+        block_end(d);
+    }
+    d->depth--;
+    return true;
+}
+
+/* ── Strings ──────────────────────────────────────────────────── */
+
+static void string_begin(llm_decoder_t *d, uint8_t target, uint8_t after)
+{
+    d->target = target;
+    d->after_string = after;
+    d->small_len = 0;
+    d->small[0] = '\0';
+    d->hi_surrogate = 0;
+    d->state = ST_STRING;
+}
+
+static void string_put(llm_decoder_t *d, const char *p, size_t n)
+{
+    if (n == 0) return;
+    switch (d->target) {
+    case T_NONE:
+        return;
+    case T_TEXT:
+        append_text(d, p, n);
+        return;
+    case T_ARGS:
+        append_input(d, d->str_slot, p, n);
+        return;
+    default:
+        /* Short values: keep what fits, remember the full length */
+        if (d->small_len < sizeof(d->small) - 1) {
+            size_t room = sizeof(d->small) - 1 - d->small_len;
+            memcpy(d->small + d->small_len, p, n < room ? n : room);
+            d->small[d->small_len + (n < room ? n : room)] = '\0';
+        }
+        d->small_len += n;
+        return;
+    }
+}
+
+static void string_put_codepoint(llm_decoder_t *d, uint32_t cp)
+{
+    char u[4];
+    size_t n;
+    if (cp < 0x80) {
+        u[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        u[0] = (char)(0xC0 | (cp >> 6));
+        u[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        u[0] = (char)(0xE0 | (cp >> 12));
+        u[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        u[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        u[0] = (char)(0xF0 | (cp >> 18));
+        u[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        u[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        u[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    string_put(d, u, n);
+}
+
+static void string_unicode(llm_decoder_t *d, uint32_t cp)
+{
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        d->hi_surrogate = cp;
+        return;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        if (!d->hi_surrogate) return;   /* lone low surrogate */
+        cp = 0x10000 + ((d->hi_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+    }
+    d->hi_surrogate = 0;
+    string_put_codepoint(d, cp);
+}
+
+static void string_end(llm_decoder_t *d)
+{
+    llm_response_t *resp = d->resp;
+    llm_decode_frame_t *top = d->depth > 0 && d->depth <= LLM_DECODE_MAX_DEPTH
+                              ? &d->frames[d->depth - 1] : NULL;
+
+    switch (d->target) {
+    case T_KEY:
+        if (!top) break;
+        if (d->small_len < sizeof(top->key)) {
+            memcpy(top->key, d->small, d->small_len + 1);
+        } else {
+            top->key[0] = '\0';     /* too long to be one we look for */
+        }
+        break;
+    case T_STOP:
+        resp->tool_use = strcmp(d->small, d->format == LLM_STREAM_OPENAI
+                                          ? "tool_calls" : "tool_use") == 0;
+        break;
+    case T_TYPE:
+        strncpy(d->block_type, d->small, sizeof(d->block_type) - 1);
+        d->block_type[sizeof(d->block_type) - 1] = '\0';
+        break;
+    case T_ID:
+        strncpy(resp->calls[d->str_slot].id, d->small, sizeof(resp->calls[0].id) - 1);
+        break;
+    case T_NAME:
+        strncpy(resp->calls[d->str_slot].name, d->small, sizeof(resp->calls[0].name) - 1);
+        break;
+    case T_ERROR:
+        ESP_LOGE(TAG, "API error: %s", d->small);
+        d->failed = true;
+        break;
+    default:
+        break;
+    }
+    d->target = T_NONE;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+void llm_decode_init(llm_decoder_t *d, llm_stream_format_t format, llm_response_t *resp)
+{
+    memset(d, 0, sizeof(*d));
+    d->format = format;
+    d->resp = resp;
+    d->state = ST_VALUE;
+    d->block_call = -1;
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_scalar_char(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+           c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+esp_err_t llm_decode_feed(llm_decoder_t *d, const char *data, size_t len)
+{
+    if (d->failed) return ESP_FAIL;
+    d->capture_from = 0;
+
+    size_t i = 0;
+    while (i < len && !d->failed) {
+        char c = data[i];
+
+        switch (d->state) {
+        case ST_STRING: {
+            /* Copy the run up to the next quote or escape in one go */
+            size_t run = i;
+            while (run < len && data[run] != '"' && data[run] != '\\') run++;
+            string_put(d, data + i, run - i);
+            i = run;
+            if (i == len) continue;
+            if (data[i] == '\\') {
+                d->state = ST_ESCAPE;
+            } else {
+                string_end(d);
+                d->state = d->after_string;
+                if (d->state == ST_AFTER) value_end(d, data, i + 1);
+            }
+            i++;
+            continue;
+        }
+
+        case ST_ESCAPE: {
+            char out;
+            switch (c) {
+            case '"':  out = '"'; break;
+            case '\\': out = '\\'; break;
+            case '/':  out = '/'; break;
+            case 'b':  out = '\b'; break;
+            case 'f':  out = '\f'; break;
+            case 'n':  out = '\n'; break;
+            case 'r':  out = '\r'; break;
+            case 't':  out = '\t'; break;
+            case 'u':
+                d->uhex = 0;
+                d->uhex_digits = 0;
+                d->state = ST_UNICODE;
+                i++;
+                continue;
+            default:
+                goto malformed;
+            }
+            string_put(d, &out, 1);
+            d->state = ST_STRING;
+            i++;
+            continue;
+        }
+
+        case ST_UNICODE: {
+            int h = hex_value(c);
+            if (h < 0) {
+                goto malformed;
+            }
+            d->uhex = (d->uhex << 4) | (uint32_t)h;
+            if (++d->uhex_digits == 4) {
+                string_unicode(d, d->uhex);
+                d->state = ST_STRING;
+            }
+            i++;
+            continue;
+        }
+
+        case ST_SCALAR:
+            if (is_scalar_char(c)) {
+                i++;
+                continue;
+            }
+            /* The scalar ended on the previous byte; re-read this one */
+            d->state = ST_AFTER;
+            value_end(d, data, i);
+            continue;
+
+        default:
+            break;
+        }
+
+        if (is_space(c)) {
+            i++;
+            continue;
+        }
+
+        switch (d->state) {
+        case ST_KEY_OR_END:
+            if (c == '}') goto close;
+            /* fall through */
+        case ST_KEY:
+            if (c != '"') {
+                goto malformed;
+            }
+            string_begin(d, T_KEY, ST_COLON);
+            break;
+
+        case ST_COLON:
+            if (c != ':') {
+                goto malformed;
+            }
+            d->state = ST_VALUE;
+            break;
+
+        case ST_VALUE_OR_END:
+            if (c == ']') goto close;
+            /* fall through */
+        case ST_VALUE:
+            value_begin(d, i);
+            if (c == '{') {
+                container_open(d, false);
+                d->state = ST_KEY_OR_END;
+            } else if (c == '[') {
+                container_open(d, true);
+                d->state = ST_VALUE_OR_END;
+            } else if (c == '"') {
+                string_begin(d, string_target(d), ST_AFTER);
+            } else if (is_scalar_char(c)) {
+                d->state = ST_SCALAR;
+            } else {
+                goto malformed;
+            }
+            break;
+
+        case ST_AFTER:
+            if (c == ',' && d->depth > 0) {
+                bool array = d->depth <= LLM_DECODE_MAX_DEPTH &&
+                             d->frames[d->depth - 1].array;
+                d->state = array ? ST_VALUE : ST_KEY;
+            } else if (c == '}') {
+                goto close;
+            } else if (c == ']') {
+                goto close;
+            } else {
+                goto malformed;
+            }
+            break;
+
+        default:    /* ST_END: trailing garbage */
+            goto malformed;
+        }
+        i++;
+        continue;
+
+close:
+        if (!container_close(d, c == ']')) {
+            goto malformed;
+        }
+        d->state = ST_AFTER;
+        value_end(d, data, i + 1);
+        i++;
+    }
+
+    if (d->failed) return ESP_FAIL;
+
+    /* Tool input continues into the next slice */
+    if (d->capturing) {
+        append_input(d, d->capture_slot, data + d->capture_from, len - d->capture_from);
+    }
+    d->offset += len;
+    return d->failed ? ESP_FAIL : ESP_OK;
+
+malformed:
+    ESP_LOGE(TAG, "Malformed response JSON near byte %u", (unsigned)(d->offset + i));
+    d->failed = true;
+    return ESP_FAIL;
+}
+
+esp_err_t llm_decode_finish(llm_decoder_t *d)
+{
+    if (d->failed) return ESP_FAIL;
+    if (d->state != ST_END) {
+        ESP_LOGE(TAG, "Response JSON truncated after %u bytes", (unsigned)d->offset);
+        return ESP_FAIL;
+    }
+
+    llm_response_t *resp = d->resp;
+    for (int i = 0; i < resp->call_count; i++) {
+        if (resp->calls[i].input_len == 0) {
+            /* Tool called without arguments */
+            append_input(d, i, "{}", 2);
+        }
+    }
+    if (d->format == LLM_STREAM_OPENAI && resp->call_count > 0) {
+        resp->tool_use = true;
+    }
+    return d->failed ? ESP_FAIL : ESP_OK;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "llm/llm_proxy.h"
+#include "llm/llm_stream.h"     /* llm_stream_format_t selects the response shape */
+
+#define LLM_DECODE_MAX_DEPTH    8   /* levels whose member names are tracked */
+
+typedef struct {
+    bool array;
+    int  index;         /* current element (arrays) */
+    char key[16];       /* current member name (objects); "" if longer */
+} llm_decode_frame_t;
+
+/**
+ * Single-pass, event-driven decoder for a non-streaming LLM response body.
+ *
+ * A byte-level JSON tokenizer tracks only the path of the current value and
+ * routes the few strings that matter (text, stop reason, tool call id, name)
+ * straight into an llm_response_t. No cJSON tree is built: an Anthropic
+ * tool_use "input" object is copied as its raw byte span, an OpenAI
+ * "arguments" string is unescaped in place. Like llm_stream_t it is fed in
+ * arbitrary slices and has no transport dependency, so recorded bodies can
+ * be replayed through it on the host.
+ */
+typedef struct {
+    llm_stream_format_t format;
+    llm_response_t     *resp;
+
+    /* Tokenizer */
+    uint8_t  state;
+    uint8_t  after_string;      /* state to resume after a string ends */
+    int      depth;             /* open containers */
+    llm_decode_frame_t frames[LLM_DECODE_MAX_DEPTH];
+    size_t   offset;            /* bytes consumed, for error reports */
+
+    /* Current string */
+    uint8_t  target;            /* where decoded bytes go */
+    int      str_slot;          /* call slot for id / name / arguments */
+    char     small[64];         /* short values: stop reason, type, id, name */
+    size_t   small_len;
+    uint32_t uhex;              /* \uXXXX being read */
+    int      uhex_digits;
+    uint32_t hi_surrogate;
+
+    /* Response assembly */
+    size_t   text_cap;
+    size_t   input_cap[MIMI_MAX_TOOL_CALLS];
+    int      call_index[MIMI_MAX_TOOL_CALLS];  /* OpenAI tool_calls[] index per slot */
+    int      block_call;        /* Anthropic: slot opened by the current content block */
+    char     block_type[16];
+    bool     capturing;         /* copying a raw tool input span */
+    int      capture_depth;
+    int      capture_slot;
+    size_t   capture_from;      /* span start within the slice being fed */
+    bool     failed;
+} llm_decoder_t;
+
+/** Prepare a decoder that fills resp (which must be zeroed by the caller). */
+void llm_decode_init(llm_decoder_t *d, llm_stream_format_t format, llm_response_t *resp);
+
+/** Feed raw body bytes. */
+esp_err_t llm_decode_feed(llm_decoder_t *d, const char *data, size_t len);
+
+/**
+ * Check the document ended cleanly and finalize tool calls.
+ * @return ESP_OK on a complete, well-formed response
+ */
+esp_err_t llm_decode_finish(llm_decoder_t *d);
@@ -1,12 +1,13 @@
 #include "llm_proxy.h"
+#include "llm_stream.h"
+#include "llm_decode.h"
+#include "json_writer.h"
 #include "mimi_config.h"
-#include "proxy/http_proxy.h"
+#include "http/http_client.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include "esp_log.h"
-#include "esp_http_client.h"
-#include "esp_crt_bundle.h"
 #include "esp_heap_caps.h"
 #include "nvs.h"
 #include "cJSON.h"
@@ -16,6 +17,7 @@ static const char *TAG = "llm";
 static char s_api_key[128] = {0};
 static char s_model[64] = MIMI_LLM_DEFAULT_MODEL;
 static char s_provider[16] = MIMI_LLM_PROVIDER_DEFAULT;
+static http_session_t *s_session;       /* one kept-alive connection per agent worker */
 
 static void safe_copy(char *dst, size_t dst_size, const char *src)
 {
@@ -67,15 +69,24 @@ static void resp_buf_free(resp_buf_t *rb)
     rb->cap = 0;
 }
 
-/* ── HTTP event handler (for esp_http_client direct path) ─────── */
+/* ── Response sink: decoder for 200 responses, else buffer ────── */
 
-static esp_err_t http_event_handler(esp_http_client_event_t *evt)
+typedef struct {
+    int status;
+    const http_response_t *http;    /* in-flight response (status known before body) */
+    resp_buf_t *rb;             /* error body */
+    llm_stream_t *stream;       /* SSE decoder (streaming calls), or NULL */
+    llm_decoder_t *decoder;     /* JSON decoder (non-streaming calls), or NULL */
+} llm_sink_t;
+
+static esp_err_t llm_sink_write(const char *data, size_t len, void *ctx)
 {
-    resp_buf_t *rb = (resp_buf_t *)evt->user_data;
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
-        resp_buf_append(rb, (const char *)evt->data, evt->data_len);
+    llm_sink_t *sink = (llm_sink_t *)ctx;
+    if (sink->http->status == 200) {
+        if (sink->stream) return llm_stream_feed(sink->stream, data, len);
+        if (sink->decoder) return llm_decode_feed(sink->decoder, data, len);
     }
-    return ESP_OK;
+    return resp_buf_append(sink->rb, data, len);
 }
 
 /* ── Provider helpers ──────────────────────────────────────────── */
@@ -90,20 +101,17 @@ static const char *llm_api_url(void)
     return provider_is_openai() ? MIMI_OPENAI_API_URL : MIMI_LLM_API_URL;
 }
 
-static const char *llm_api_host(void)
-{
-    return provider_is_openai() ? "api.openai.com" : "api.anthropic.com";
-}
-
-static const char *llm_api_path(void)
+static llm_stream_format_t llm_format(void)
 {
-    return provider_is_openai() ? "/v1/chat/completions" : "/v1/messages";
+    return provider_is_openai() ? LLM_STREAM_OPENAI : LLM_STREAM_ANTHROPIC;
 }
 
 /* ── Init ─────────────────────────────────────────────────────── */
 
 esp_err_t llm_proxy_init(void)
 {
+    s_session = http_session_create_pool("llm", MIMI_LLM_CONN_IDLE_MS, MIMI_AGENT_WORKERS);
+
     /* Start with build-time defaults */
     if (MIMI_SECRET_API_KEY[0] != '\0') {
         safe_copy(s_api_key, sizeof(s_api_key), MIMI_SECRET_API_KEY);
@@ -144,325 +152,351 @@ esp_err_t llm_proxy_init(void)
     return ESP_OK;
 }
 
-/* ── Direct path: esp_http_client ───────────────────────────── */
+/* ── Request body (streamed JSON) ─────────────────────────────── */
 
-static esp_err_t llm_http_direct(const char *post_data, resp_buf_t *rb, int *out_status)
+/*
+ * The request body is never built as a tree or printed to one string: it
+ * is serialized from the caller's messages straight to the connection by
+ * json_writer, once to count Content-Length and once to send.
+ */
+typedef struct {
+    const llm_system_prompt_t *system;
+    const cJSON               *messages;
+    const llm_tools_t         *tools;   /* pre-serialized, spliced in verbatim */
+    bool                       stream;
+} llm_body_t;
+
+static bool block_is(const cJSON *block, const char *type)
 {
-    esp_http_client_config_t config = {
-        .url = llm_api_url(),
-        .event_handler = http_event_handler,
-        .user_data = rb,
-        .timeout_ms = 120 * 1000,
-        .buffer_size = 4096,
-        .buffer_size_tx = 4096,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
+    const char *t = cJSON_GetStringValue(cJSON_GetObjectItem(block, "type"));
+    return t && strcmp(t, type) == 0;
+}
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) return ESP_FAIL;
+/* Concatenation of all text blocks, as one string value */
+static void write_joined_text(json_writer_t *w, const cJSON *content)
+{
+    jw_string_begin(w);
+    const cJSON *block;
+    cJSON_ArrayForEach(block, content) {
+        if (!block_is(block, "text")) continue;
+        const char *text = cJSON_GetStringValue(cJSON_GetObjectItem(block, "text"));
+        if (text) jw_string_part(w, text, strlen(text));
+    }
+    jw_string_end(w);
+}
 
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/json");
-    if (provider_is_openai()) {
-        if (s_api_key[0]) {
-            char auth[192];
-            snprintf(auth, sizeof(auth), "Bearer %s", s_api_key);
-            esp_http_client_set_header(client, "Authorization", auth);
+static void write_assistant_openai(json_writer_t *w, const cJSON *content)
+{
+    bool has_calls = false;
+    const cJSON *block;
+    cJSON_ArrayForEach(block, content) {
+        if (block_is(block, "tool_use")) has_calls = true;
+    }
+
+    jw_begin_object(w);
+    jw_key(w, "role");
+    jw_string(w, "assistant");
+    jw_key(w, "content");
+    write_joined_text(w, content);
+
+    if (has_calls) {
+        jw_key(w, "tool_calls");
+        jw_begin_array(w);
+        cJSON_ArrayForEach(block, content) {
+            if (!block_is(block, "tool_use")) continue;
+            cJSON *id = cJSON_GetObjectItem(block, "id");
+            cJSON *name = cJSON_GetObjectItem(block, "name");
+            cJSON *input = cJSON_GetObjectItem(block, "input");
+            if (!name || !cJSON_IsString(name)) continue;
+
+            jw_begin_object(w);
+            if (id && cJSON_IsString(id)) {
+                jw_key(w, "id");
+                jw_string(w, id->valuestring);
+            }
+            jw_key(w, "type");
+            jw_string(w, "function");
+            jw_key(w, "function");
+            jw_begin_object(w);
+            jw_key(w, "name");
+            jw_string(w, name->valuestring);
+            if (input) {
+                jw_key(w, "arguments");
+                jw_cjson_as_string(w, input);
+            }
+            jw_end_object(w);
+            jw_end_object(w);
         }
-    } else {
-        esp_http_client_set_header(client, "x-api-key", s_api_key);
-        esp_http_client_set_header(client, "anthropic-version", MIMI_LLM_API_VERSION);
+        jw_end_array(w);
     }
-    esp_http_client_set_post_field(client, post_data, strlen(post_data));
-
-    esp_err_t err = esp_http_client_perform(client);
-    *out_status = esp_http_client_get_status_code(client);
-    esp_http_client_cleanup(client);
-    return err;
+    jw_end_object(w);
 }
 
-/* ── Proxy path: manual HTTP over CONNECT tunnel ────────────── */
-
-static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *out_status)
+/* tool_result blocks become role=tool messages, any text a user message */
+static void write_user_openai(json_writer_t *w, const cJSON *content)
 {
-    proxy_conn_t *conn = proxy_conn_open(llm_api_host(), 443, 30000);
-    if (!conn) return ESP_ERR_HTTP_CONNECT;
-
-    int body_len = strlen(post_data);
-    char header[512];
-    int hlen = 0;
-    if (provider_is_openai()) {
-        hlen = snprintf(header, sizeof(header),
-            "POST %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Content-Type: application/json\r\n"
-            "Authorization: Bearer %s\r\n"
-            "Content-Length: %d\r\n"
-            "Connection: close\r\n\r\n",
-            llm_api_path(), llm_api_host(), s_api_key, body_len);
-    } else {
-        hlen = snprintf(header, sizeof(header),
-            "POST %s HTTP/1.1\r\n"
-            "Host: %s\r\n"
-            "Content-Type: application/json\r\n"
-            "x-api-key: %s\r\n"
-            "anthropic-version: %s\r\n"
-            "Content-Length: %d\r\n"
-            "Connection: close\r\n\r\n",
-            llm_api_path(), llm_api_host(), s_api_key, MIMI_LLM_API_VERSION, body_len);
+    bool has_user_text = false;
+    const cJSON *block;
+    cJSON_ArrayForEach(block, content) {
+        if (block_is(block, "tool_result")) {
+            cJSON *tool_id = cJSON_GetObjectItem(block, "tool_use_id");
+            cJSON *tcontent = cJSON_GetObjectItem(block, "content");
+            if (!tool_id || !cJSON_IsString(tool_id)) continue;
+
+            jw_begin_object(w);
+            jw_key(w, "role");
+            jw_string(w, "tool");
+            jw_key(w, "tool_call_id");
+            jw_string(w, tool_id->valuestring);
+            jw_key(w, "content");
+            jw_string(w, cJSON_IsString(tcontent) ? tcontent->valuestring : "");
+            jw_end_object(w);
+        } else if (block_is(block, "text") &&
+                   cJSON_IsString(cJSON_GetObjectItem(block, "text"))) {
+            has_user_text = true;
+        }
     }
 
-    if (proxy_conn_write(conn, header, hlen) < 0 ||
-        proxy_conn_write(conn, post_data, body_len) < 0) {
-        proxy_conn_close(conn);
-        return ESP_ERR_HTTP_WRITE_DATA;
+    if (has_user_text) {
+        jw_begin_object(w);
+        jw_key(w, "role");
+        jw_string(w, "user");
+        jw_key(w, "content");
+        write_joined_text(w, content);
+        jw_end_object(w);
     }
+}
 
-    /* Read full response into buffer */
-    char tmp[4096];
-    while (1) {
-        int n = proxy_conn_read(conn, tmp, sizeof(tmp), 120000);
-        if (n <= 0) break;
-        if (resp_buf_append(rb, tmp, n) != ESP_OK) break;
+static void write_messages_openai(json_writer_t *w, const char *system_prompt,
+                                  const cJSON *messages)
+{
+    jw_begin_array(w);
+    if (system_prompt && system_prompt[0]) {
+        jw_begin_object(w);
+        jw_key(w, "role");
+        jw_string(w, "system");
+        jw_key(w, "content");
+        jw_string(w, system_prompt);
+        jw_end_object(w);
     }
-    proxy_conn_close(conn);
 
-    /* Parse status line */
-    *out_status = 0;
-    if (rb->len > 5 && strncmp(rb->data, "HTTP/", 5) == 0) {
-        const char *sp = strchr(rb->data, ' ');
-        if (sp) *out_status = atoi(sp + 1);
-    }
+    const cJSON *msg;
+    cJSON_ArrayForEach(msg, messages) {
+        cJSON *role = cJSON_GetObjectItem(msg, "role");
+        cJSON *content = cJSON_GetObjectItem(msg, "content");
+        if (!role || !cJSON_IsString(role)) continue;
 
-    /* Strip HTTP headers, keep body only */
-    char *body = strstr(rb->data, "\r\n\r\n");
-    if (body) {
-        body += 4;
-        size_t blen = rb->len - (body - rb->data);
-        memmove(rb->data, body, blen);
-        rb->len = blen;
-        rb->data[rb->len] = '\0';
+        if (content && cJSON_IsString(content)) {
+            jw_begin_object(w);
+            jw_key(w, "role");
+            jw_string(w, role->valuestring);
+            jw_key(w, "content");
+            jw_string(w, content->valuestring);
+            jw_end_object(w);
+        } else if (content && cJSON_IsArray(content)) {
+            if (strcmp(role->valuestring, "assistant") == 0) {
+                write_assistant_openai(w, content);
+            } else if (strcmp(role->valuestring, "user") == 0) {
+                write_user_openai(w, content);
+            }
+        }
     }
-
-    return ESP_OK;
+    jw_end_array(w);
 }
 
-/* ── Shared HTTP dispatch ─────────────────────────────────────── */
+/* ── Anthropic prompt caching ─────────────────────────────────── */
 
-static esp_err_t llm_http_call(const char *post_data, resp_buf_t *rb, int *out_status)
+/*
+ * The cache prefix runs tools -> system -> messages. Breakpoints go after
+ * the stable system part (which also covers the tools), after memory,
+ * after the notes, and on the last message: four, the API maximum. The
+ * last one moves forward each ReAct iteration and the previous position
+ * is still found by the provider's lookback, so history is read from cache.
+ */
+static void write_cache_control(json_writer_t *w)
 {
-    if (http_proxy_is_enabled()) {
-        return llm_http_via_proxy(post_data, rb, out_status);
-    } else {
-        return llm_http_direct(post_data, rb, out_status);
-    }
+    if (!MIMI_LLM_PROMPT_CACHE) return;
+    jw_key(w, "cache_control");
+    jw_begin_object(w);
+    jw_key(w, "type");
+    jw_string(w, "ephemeral");
+    jw_end_object(w);
 }
 
-/* ── Parse text from JSON response ────────────────────────────── */
-
-static void extract_text_anthropic(cJSON *root, char *buf, size_t size)
+static void write_system_anthropic(json_writer_t *w, const llm_system_prompt_t *sys)
 {
-    buf[0] = '\0';
-    cJSON *content = cJSON_GetObjectItem(root, "content");
-    if (!content || !cJSON_IsArray(content)) return;
-
-    size_t off = 0;
-    cJSON *block;
-    cJSON_ArrayForEach(block, content) {
-        cJSON *btype = cJSON_GetObjectItem(block, "type");
-        if (!btype || strcmp(btype->valuestring, "text") != 0) continue;
-        cJSON *text = cJSON_GetObjectItem(block, "text");
-        if (!text || !cJSON_IsString(text)) continue;
-        size_t tlen = strlen(text->valuestring);
-        size_t copy = (tlen < size - off - 1) ? tlen : size - off - 1;
-        memcpy(buf + off, text->valuestring, copy);
-        off += copy;
-    }
-    buf[off] = '\0';
+    size_t total = sys->text ? strlen(sys->text) : 0;
+    size_t ends[3] = { sys->stable_len, sys->stable_len + sys->memory_len, total };
+
+    jw_begin_array(w);
+    size_t start = 0;
+    for (int i = 0; i < 3; i++) {
+        size_t end = ends[i] < total ? ends[i] : total;
+        if (end <= start) continue;    /* empty text blocks are rejected */
+        jw_begin_object(w);
+        jw_key(w, "type");
+        jw_string(w, "text");
+        jw_key(w, "text");
+        jw_string_n(w, sys->text + start, end - start);
+        write_cache_control(w);
+        jw_end_object(w);
+        start = end;
+    }
+    jw_end_array(w);
 }
 
-static void extract_text_openai(cJSON *root, char *buf, size_t size)
+/* A content block with a breakpoint added (any existing one replaced) */
+static void write_block_cached(json_writer_t *w, const cJSON *block)
 {
-    buf[0] = '\0';
-    cJSON *choices = cJSON_GetObjectItem(root, "choices");
-    if (!choices || !cJSON_IsArray(choices)) return;
-    cJSON *choice0 = cJSON_GetArrayItem(choices, 0);
-    if (!choice0) return;
-    cJSON *message = cJSON_GetObjectItem(choice0, "message");
-    if (!message) return;
-    cJSON *content = cJSON_GetObjectItem(message, "content");
-    if (!content || !cJSON_IsString(content)) return;
-    strncpy(buf, content->valuestring, size - 1);
-    buf[size - 1] = '\0';
+    jw_begin_object(w);
+    for (const cJSON *f = block->child; f; f = f->next) {
+        if (f->string && strcmp(f->string, "cache_control") == 0) continue;
+        jw_key(w, f->string ? f->string : "");
+        jw_cjson(w, f);
+    }
+    write_cache_control(w);
+    jw_end_object(w);
 }
 
-static cJSON *convert_tools_openai(const char *tools_json)
+/* The last message, with a breakpoint on its final content block */
+static void write_message_cached(json_writer_t *w, const cJSON *msg)
 {
-    if (!tools_json) return NULL;
-    cJSON *arr = cJSON_Parse(tools_json);
-    if (!arr || !cJSON_IsArray(arr)) {
-        cJSON_Delete(arr);
-        return NULL;
-    }
-    cJSON *out = cJSON_CreateArray();
-    cJSON *tool;
-    cJSON_ArrayForEach(tool, arr) {
-        cJSON *name = cJSON_GetObjectItem(tool, "name");
-        cJSON *desc = cJSON_GetObjectItem(tool, "description");
-        cJSON *schema = cJSON_GetObjectItem(tool, "input_schema");
-        if (!name || !cJSON_IsString(name)) continue;
-
-        cJSON *func = cJSON_CreateObject();
-        cJSON_AddStringToObject(func, "name", name->valuestring);
-        if (desc && cJSON_IsString(desc)) {
-            cJSON_AddStringToObject(func, "description", desc->valuestring);
-        }
-        if (schema) {
-            cJSON_AddItemToObject(func, "parameters", cJSON_Duplicate(schema, 1));
+    jw_begin_object(w);
+    for (const cJSON *f = msg->child; f; f = f->next) {
+        jw_key(w, f->string ? f->string : "");
+        bool is_content = f->string && strcmp(f->string, "content") == 0;
+
+        if (is_content && cJSON_IsString(f) && f->valuestring[0]) {
+            /* Plain string content becomes a single text block */
+            jw_begin_array(w);
+            jw_begin_object(w);
+            jw_key(w, "type");
+            jw_string(w, "text");
+            jw_key(w, "text");
+            jw_string(w, f->valuestring);
+            write_cache_control(w);
+            jw_end_object(w);
+            jw_end_array(w);
+        } else if (is_content && cJSON_IsArray(f) && f->child) {
+            jw_begin_array(w);
+            for (const cJSON *block = f->child; block; block = block->next) {
+                if (!block->next && cJSON_IsObject(block)) {
+                    write_block_cached(w, block);
+                } else {
+                    jw_cjson(w, block);
+                }
+            }
+            jw_end_array(w);
+        } else {
+            jw_cjson(w, f);
         }
+    }
+    jw_end_object(w);
+}
 
-        cJSON *wrap = cJSON_CreateObject();
-        cJSON_AddStringToObject(wrap, "type", "function");
-        cJSON_AddItemToObject(wrap, "function", func);
-        cJSON_AddItemToArray(out, wrap);
+static void write_messages_anthropic(json_writer_t *w, const cJSON *messages)
+{
+    jw_begin_array(w);
+    const cJSON *msg;
+    cJSON_ArrayForEach(msg, messages) {
+        if (MIMI_LLM_PROMPT_CACHE && !msg->next && cJSON_IsObject(msg)) {
+            write_message_cached(w, msg);
+        } else {
+            jw_cjson(w, msg);
+        }
     }
-    cJSON_Delete(arr);
-    return out;
+    jw_end_array(w);
 }
 
-static cJSON *convert_messages_openai(const char *system_prompt, cJSON *messages)
+static void write_request_body(json_writer_t *w, const llm_body_t *b)
 {
-    cJSON *out = cJSON_CreateArray();
-    if (system_prompt && system_prompt[0]) {
-        cJSON *sys = cJSON_CreateObject();
-        cJSON_AddStringToObject(sys, "role", "system");
-        cJSON_AddStringToObject(sys, "content", system_prompt);
-        cJSON_AddItemToArray(out, sys);
+    jw_begin_object(w);
+    jw_key(w, "model");
+    jw_string(w, s_model);
+    jw_key(w, "max_tokens");
+    jw_int(w, MIMI_LLM_MAX_TOKENS);
+    if (b->stream) {
+        jw_key(w, "stream");
+        jw_bool(w, true);
+    }
+
+    if (provider_is_openai()) {
+        jw_key(w, "messages");
+        write_messages_openai(w, b->system->text, b->messages);
+        if (b->tools && b->tools->openai) {
+            jw_key(w, "tools");
+            jw_raw_n(w, b->tools->openai, b->tools->openai_len);
+            jw_key(w, "tool_choice");
+            jw_string(w, "auto");
+        }
+    } else {
+        jw_key(w, "system");
+        write_system_anthropic(w, b->system);
+        jw_key(w, "messages");
+        write_messages_anthropic(w, b->messages);
+        if (b->tools && b->tools->anthropic) {
+            jw_key(w, "tools");
+            jw_raw_n(w, b->tools->anthropic, b->tools->anthropic_len);
+        }
     }
+    jw_end_object(w);
+}
 
-    if (!messages || !cJSON_IsArray(messages)) return out;
+static size_t llm_body_length(const llm_body_t *b)
+{
+    json_writer_t w;
+    jw_init(&w, NULL, NULL);
+    write_request_body(&w, b);
+    jw_finish(&w);
+    return w.total;
+}
 
-    cJSON *msg;
-    cJSON_ArrayForEach(msg, messages) {
-        cJSON *role = cJSON_GetObjectItem(msg, "role");
-        cJSON *content = cJSON_GetObjectItem(msg, "content");
-        if (!role || !cJSON_IsString(role)) continue;
+static esp_err_t llm_body_writer(http_write_t write, void *wctx, void *ctx)
+{
+    json_writer_t w;
+    jw_init(&w, write, wctx);
+    write_request_body(&w, (const llm_body_t *)ctx);
+    return jw_finish(&w);
+}
 
-        if (content && cJSON_IsString(content)) {
-            cJSON *m = cJSON_CreateObject();
-            cJSON_AddStringToObject(m, "role", role->valuestring);
-            cJSON_AddStringToObject(m, "content", content->valuestring);
-            cJSON_AddItemToArray(out, m);
-            continue;
-        }
+/* ── HTTP transport ───────────────────────────────────────────── */
 
-        if (!content || !cJSON_IsArray(content)) continue;
-
-        if (strcmp(role->valuestring, "assistant") == 0) {
-            cJSON *m = cJSON_CreateObject();
-            cJSON_AddStringToObject(m, "role", "assistant");
-
-            /* collect text */
-            char *text_buf = NULL;
-            size_t off = 0;
-            cJSON *block;
-            cJSON *tool_calls = NULL;
-            cJSON_ArrayForEach(block, content) {
-                cJSON *btype = cJSON_GetObjectItem(block, "type");
-                if (btype && cJSON_IsString(btype) && strcmp(btype->valuestring, "text") == 0) {
-                    cJSON *text = cJSON_GetObjectItem(block, "text");
-                    if (text && cJSON_IsString(text)) {
-                        size_t tlen = strlen(text->valuestring);
-                        char *tmp = realloc(text_buf, off + tlen + 1);
-                        if (tmp) {
-                            text_buf = tmp;
-                            memcpy(text_buf + off, text->valuestring, tlen);
-                            off += tlen;
-                            text_buf[off] = '\0';
-                        }
-                    }
-                } else if (btype && cJSON_IsString(btype) && strcmp(btype->valuestring, "tool_use") == 0) {
-                    if (!tool_calls) tool_calls = cJSON_CreateArray();
-                    cJSON *id = cJSON_GetObjectItem(block, "id");
-                    cJSON *name = cJSON_GetObjectItem(block, "name");
-                    cJSON *input = cJSON_GetObjectItem(block, "input");
-                    if (!name || !cJSON_IsString(name)) continue;
-
-                    cJSON *tc = cJSON_CreateObject();
-                    if (id && cJSON_IsString(id)) {
-                        cJSON_AddStringToObject(tc, "id", id->valuestring);
-                    }
-                    cJSON_AddStringToObject(tc, "type", "function");
-                    cJSON *func = cJSON_CreateObject();
-                    cJSON_AddStringToObject(func, "name", name->valuestring);
-                    if (input) {
-                        char *args = cJSON_PrintUnformatted(input);
-                        if (args) {
-                            cJSON_AddStringToObject(func, "arguments", args);
-                            free(args);
-                        }
-                    }
-                    cJSON_AddItemToObject(tc, "function", func);
-                    cJSON_AddItemToArray(tool_calls, tc);
-                }
-            }
-            if (text_buf) {
-                cJSON_AddStringToObject(m, "content", text_buf);
-            } else {
-                cJSON_AddStringToObject(m, "content", "");
-            }
-            if (tool_calls) {
-                cJSON_AddItemToObject(m, "tool_calls", tool_calls);
-            }
-            cJSON_AddItemToArray(out, m);
-            free(text_buf);
-        } else if (strcmp(role->valuestring, "user") == 0) {
-            /* tool_result blocks become role=tool */
-            cJSON *block;
-            bool has_user_text = false;
-            char *text_buf = NULL;
-            size_t off = 0;
-            cJSON_ArrayForEach(block, content) {
-                cJSON *btype = cJSON_GetObjectItem(block, "type");
-                if (btype && cJSON_IsString(btype) && strcmp(btype->valuestring, "tool_result") == 0) {
-                    cJSON *tool_id = cJSON_GetObjectItem(block, "tool_use_id");
-                    cJSON *tcontent = cJSON_GetObjectItem(block, "content");
-                    if (!tool_id || !cJSON_IsString(tool_id)) continue;
-                    cJSON *tm = cJSON_CreateObject();
-                    cJSON_AddStringToObject(tm, "role", "tool");
-                    cJSON_AddStringToObject(tm, "tool_call_id", tool_id->valuestring);
-                    if (tcontent && cJSON_IsString(tcontent)) {
-                        cJSON_AddStringToObject(tm, "content", tcontent->valuestring);
-                    } else {
-                        cJSON_AddStringToObject(tm, "content", "");
-                    }
-                    cJSON_AddItemToArray(out, tm);
-                } else if (btype && cJSON_IsString(btype) && strcmp(btype->valuestring, "text") == 0) {
-                    cJSON *text = cJSON_GetObjectItem(block, "text");
-                    if (text && cJSON_IsString(text)) {
-                        size_t tlen = strlen(text->valuestring);
-                        char *tmp = realloc(text_buf, off + tlen + 1);
-                        if (tmp) {
-                            text_buf = tmp;
-                            memcpy(text_buf + off, text->valuestring, tlen);
-                            off += tlen;
-                            text_buf[off] = '\0';
-                        }
-                        has_user_text = true;
-                    }
-                }
-            }
-            if (has_user_text) {
-                cJSON *um = cJSON_CreateObject();
-                cJSON_AddStringToObject(um, "role", "user");
-                cJSON_AddStringToObject(um, "content", text_buf);
-                cJSON_AddItemToArray(out, um);
-            }
-            free(text_buf);
+static esp_err_t llm_http_call(llm_body_t *body, size_t body_len, llm_sink_t *sink)
+{
+    http_header_t headers[3];
+    int n = 0;
+    char auth[192];
+    headers[n++] = (http_header_t){ "Content-Type", "application/json" };
+    if (provider_is_openai()) {
+        if (s_api_key[0]) {
+            snprintf(auth, sizeof(auth), "Bearer %s", s_api_key);
+            headers[n++] = (http_header_t){ "Authorization", auth };
         }
+    } else {
+        headers[n++] = (http_header_t){ "x-api-key", s_api_key };
+        headers[n++] = (http_header_t){ "anthropic-version", MIMI_LLM_API_VERSION };
     }
 
-    return out;
+    http_request_t req = {
+        .method = "POST",
+        .url = llm_api_url(),
+        .headers = headers,
+        .header_count = n,
+        .body_len = body_len,
+        .body_writer = llm_body_writer,
+        .body_ctx = body,
+        .timeout_ms = MIMI_LLM_TIMEOUT_MS,
+        .on_body = llm_sink_write,
+        .ctx = sink,
+    };
+
+    /* Body is de-chunked and handed to the sink as it arrives */
+    http_response_t http;
+    sink->http = &http;
+    esp_err_t err = http_client_perform(s_session, &req, &http);
+    sink->status = http.status;
+    sink->http = NULL;
+    return err;
 }
 
 /* ── Public: simple chat (backward compat) ────────────────────── */
@@ -475,90 +509,66 @@ esp_err_t llm_chat(const char *system_prompt, const char *messages_json,
         return ESP_ERR_INVALID_STATE;
     }
 
-    /* Build request body (non-streaming) */
-    cJSON *body = cJSON_CreateObject();
-    cJSON_AddStringToObject(body, "model", s_model);
-    cJSON_AddNumberToObject(body, "max_tokens", MIMI_LLM_MAX_TOKENS);
-
-    if (provider_is_openai()) {
-        cJSON *messages = cJSON_Parse(messages_json);
-        if (!messages) {
-            messages = cJSON_CreateArray();
-            cJSON *msg = cJSON_CreateObject();
-            cJSON_AddStringToObject(msg, "role", "user");
-            cJSON_AddStringToObject(msg, "content", messages_json);
-            cJSON_AddItemToArray(messages, msg);
-        }
-        cJSON *openai_msgs = convert_messages_openai(system_prompt, messages);
+    /* Plain text is sent as a single user message */
+    cJSON *messages = cJSON_Parse(messages_json);
+    if (!messages || !cJSON_IsArray(messages)) {
         cJSON_Delete(messages);
-        cJSON_AddItemToObject(body, "messages", openai_msgs);
-    } else {
-        cJSON_AddStringToObject(body, "system", system_prompt);
-        cJSON *messages = cJSON_Parse(messages_json);
-        if (messages) {
-            cJSON_AddItemToObject(body, "messages", messages);
-        } else {
-            cJSON *arr = cJSON_CreateArray();
-            cJSON *msg = cJSON_CreateObject();
-            cJSON_AddStringToObject(msg, "role", "user");
-            cJSON_AddStringToObject(msg, "content", messages_json);
-            cJSON_AddItemToArray(arr, msg);
-            cJSON_AddItemToObject(body, "messages", arr);
-        }
+        messages = cJSON_CreateArray();
+        cJSON *msg = cJSON_CreateObject();
+        cJSON_AddStringToObject(msg, "role", "user");
+        cJSON_AddStringToObject(msg, "content", messages_json);
+        cJSON_AddItemToArray(messages, msg);
     }
 
-    char *post_data = cJSON_PrintUnformatted(body);
-    cJSON_Delete(body);
-    if (!post_data) {
-        snprintf(response_buf, buf_size, "Error: Failed to build request");
-        return ESP_ERR_NO_MEM;
-    }
+    llm_system_prompt_t system = { .text = system_prompt };
+    llm_body_t body = { .system = &system, .messages = messages };
+    size_t body_len = llm_body_length(&body);
 
     ESP_LOGI(TAG, "Calling LLM API (provider: %s, model: %s, body: %d bytes)",
-             s_provider, s_model, (int)strlen(post_data));
+             s_provider, s_model, (int)body_len);
 
+    /* Only error bodies are buffered; a 200 body is decoded as it arrives */
     resp_buf_t rb;
-    if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
-        free(post_data);
+    if (resp_buf_init(&rb, 1024) != ESP_OK) {
+        cJSON_Delete(messages);
         snprintf(response_buf, buf_size, "Error: Out of memory");
         return ESP_ERR_NO_MEM;
     }
 
-    int status = 0;
-    esp_err_t err = llm_http_call(post_data, &rb, &status);
-    free(post_data);
+    llm_response_t resp = {0};
+    llm_decoder_t decoder;
+    llm_decode_init(&decoder, llm_format(), &resp);
+
+    llm_sink_t sink = { .rb = &rb, .decoder = &decoder };
+    esp_err_t err = llm_http_call(&body, body_len, &sink);
+    cJSON_Delete(messages);
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
         resp_buf_free(&rb);
+        llm_response_free(&resp);
         snprintf(response_buf, buf_size, "Error: HTTP request failed (%s)",
                  esp_err_to_name(err));
         return err;
     }
 
-    if (status != 200) {
-        ESP_LOGE(TAG, "API returned status %d", status);
+    if (sink.status != 200) {
+        ESP_LOGE(TAG, "API returned status %d", sink.status);
         snprintf(response_buf, buf_size, "API error (HTTP %d): %.200s",
-                 status, rb.data ? rb.data : "");
+                 sink.status, rb.data ? rb.data : "");
         resp_buf_free(&rb);
         return ESP_FAIL;
     }
-
-    /* Parse JSON response */
-    cJSON *root = cJSON_Parse(rb.data);
     resp_buf_free(&rb);
 
-    if (!root) {
+    if (llm_decode_finish(&decoder) != ESP_OK) {
+        llm_response_free(&resp);
         snprintf(response_buf, buf_size, "Error: Failed to parse response");
         return ESP_FAIL;
     }
 
-    if (provider_is_openai()) {
-        extract_text_openai(root, response_buf, buf_size);
-    } else {
-        extract_text_anthropic(root, response_buf, buf_size);
-    }
-    cJSON_Delete(root);
+    snprintf(response_buf, buf_size, "%s", resp.text ? resp.text : "");
+    llm_response_free(&resp);
 
     if (response_buf[0] == '\0') {
         snprintf(response_buf, buf_size, "No response from LLM API");
@@ -584,214 +594,110 @@ void llm_response_free(llm_response_t *resp)
     resp->tool_use = false;
 }
 
-esp_err_t llm_chat_tools(const char *system_prompt,
+esp_err_t llm_chat_tools(const llm_system_prompt_t *system,
                          cJSON *messages,
-                         const char *tools_json,
+                         const llm_tools_t *tools,
                          llm_response_t *resp)
 {
     memset(resp, 0, sizeof(*resp));
 
     if (s_api_key[0] == '\0') return ESP_ERR_INVALID_STATE;
 
-    /* Build request body (non-streaming) */
-    cJSON *body = cJSON_CreateObject();
-    cJSON_AddStringToObject(body, "model", s_model);
-    cJSON_AddNumberToObject(body, "max_tokens", MIMI_LLM_MAX_TOKENS);
-
-    if (provider_is_openai()) {
-        cJSON *openai_msgs = convert_messages_openai(system_prompt, messages);
-        cJSON_AddItemToObject(body, "messages", openai_msgs);
-
-        if (tools_json) {
-            cJSON *tools = convert_tools_openai(tools_json);
-            if (tools) {
-                cJSON_AddItemToObject(body, "tools", tools);
-                cJSON_AddStringToObject(body, "tool_choice", "auto");
-            }
-        }
-    } else {
-        cJSON_AddStringToObject(body, "system", system_prompt);
-
-        /* Deep-copy messages so caller keeps ownership */
-        cJSON *msgs_copy = cJSON_Duplicate(messages, 1);
-        cJSON_AddItemToObject(body, "messages", msgs_copy);
-
-        /* Add tools array if provided */
-        if (tools_json) {
-            cJSON *tools = cJSON_Parse(tools_json);
-            if (tools) {
-                cJSON_AddItemToObject(body, "tools", tools);
-            }
-        }
-    }
-
-    char *post_data = cJSON_PrintUnformatted(body);
-    cJSON_Delete(body);
-    if (!post_data) return ESP_ERR_NO_MEM;
+    llm_body_t body = {
+        .system = system,
+        .messages = messages,
+        .tools = tools,
+    };
+    size_t body_len = llm_body_length(&body);
 
     ESP_LOGI(TAG, "Calling LLM API with tools (provider: %s, model: %s, body: %d bytes)",
-             s_provider, s_model, (int)strlen(post_data));
+             s_provider, s_model, (int)body_len);
 
-    /* HTTP call */
+    /* Only error bodies are buffered; a 200 body is decoded as it arrives */
     resp_buf_t rb;
-    if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
-        free(post_data);
-        return ESP_ERR_NO_MEM;
-    }
+    if (resp_buf_init(&rb, 1024) != ESP_OK) return ESP_ERR_NO_MEM;
 
-    int status = 0;
-    esp_err_t err = llm_http_call(post_data, &rb, &status);
-    free(post_data);
+    llm_decoder_t decoder;
+    llm_decode_init(&decoder, llm_format(), resp);
+
+    llm_sink_t sink = { .rb = &rb, .decoder = &decoder };
+    esp_err_t err = llm_http_call(&body, body_len, &sink);
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
-        resp_buf_free(&rb);
-        return err;
-    }
-
-    if (status != 200) {
-        ESP_LOGE(TAG, "API error %d: %.500s", status, rb.data ? rb.data : "");
-        resp_buf_free(&rb);
-        return ESP_FAIL;
+    } else if (sink.status != 200) {
+        ESP_LOGE(TAG, "API error %d: %.500s", sink.status, rb.data ? rb.data : "");
+        err = ESP_FAIL;
+    } else {
+        err = llm_decode_finish(&decoder);
     }
 
-    /* Parse full JSON response */
-    cJSON *root = cJSON_Parse(rb.data);
     resp_buf_free(&rb);
 
-    if (!root) {
-        ESP_LOGE(TAG, "Failed to parse API response JSON");
-        return ESP_FAIL;
+    if (err != ESP_OK) {
+        llm_response_free(resp);
+        return err;
     }
 
-    if (provider_is_openai()) {
-        cJSON *choices = cJSON_GetObjectItem(root, "choices");
-        cJSON *choice0 = choices && cJSON_IsArray(choices) ? cJSON_GetArrayItem(choices, 0) : NULL;
-        if (choice0) {
-            cJSON *finish = cJSON_GetObjectItem(choice0, "finish_reason");
-            if (finish && cJSON_IsString(finish)) {
-                resp->tool_use = (strcmp(finish->valuestring, "tool_calls") == 0);
-            }
+    ESP_LOGI(TAG, "Response: %d bytes text, %d tool calls, stop=%s",
+             (int)resp->text_len, resp->call_count,
+             resp->tool_use ? "tool_use" : "end_turn");
 
-            cJSON *message = cJSON_GetObjectItem(choice0, "message");
-            if (message) {
-                cJSON *content = cJSON_GetObjectItem(message, "content");
-                if (content && cJSON_IsString(content)) {
-                    size_t tlen = strlen(content->valuestring);
-                    resp->text = calloc(1, tlen + 1);
-                    if (resp->text) {
-                        memcpy(resp->text, content->valuestring, tlen);
-                        resp->text_len = tlen;
-                    }
-                }
+    return ESP_OK;
+}
 
-                cJSON *tool_calls = cJSON_GetObjectItem(message, "tool_calls");
-                if (tool_calls && cJSON_IsArray(tool_calls)) {
-                    cJSON *tc;
-                    cJSON_ArrayForEach(tc, tool_calls) {
-                        if (resp->call_count >= MIMI_MAX_TOOL_CALLS) break;
-                        llm_tool_call_t *call = &resp->calls[resp->call_count];
-                        cJSON *id = cJSON_GetObjectItem(tc, "id");
-                        cJSON *func = cJSON_GetObjectItem(tc, "function");
-                        if (id && cJSON_IsString(id)) {
-                            strncpy(call->id, id->valuestring, sizeof(call->id) - 1);
-                        }
-                        if (func) {
-                            cJSON *name = cJSON_GetObjectItem(func, "name");
-                            cJSON *args = cJSON_GetObjectItem(func, "arguments");
-                            if (name && cJSON_IsString(name)) {
-                                strncpy(call->name, name->valuestring, sizeof(call->name) - 1);
-                            }
-                            if (args && cJSON_IsString(args)) {
-                                call->input = strdup(args->valuestring);
-                                if (call->input) {
-                                    call->input_len = strlen(call->input);
-                                }
-                            }
-                        }
-                        resp->call_count++;
-                    }
-                    if (resp->call_count > 0) {
-                        resp->tool_use = true;
-                    }
-                }
-            }
-        }
-    } else {
-        /* stop_reason */
-        cJSON *stop_reason = cJSON_GetObjectItem(root, "stop_reason");
-        if (stop_reason && cJSON_IsString(stop_reason)) {
-            resp->tool_use = (strcmp(stop_reason->valuestring, "tool_use") == 0);
-        }
+/* ── Public: chat with tools (streaming) ──────────────────────── */
 
-        /* Iterate content blocks */
-        cJSON *content = cJSON_GetObjectItem(root, "content");
-        if (content && cJSON_IsArray(content)) {
-            /* Accumulate total text length first */
-            size_t total_text = 0;
-            cJSON *block;
-            cJSON_ArrayForEach(block, content) {
-                cJSON *btype = cJSON_GetObjectItem(block, "type");
-                if (btype && strcmp(btype->valuestring, "text") == 0) {
-                    cJSON *text = cJSON_GetObjectItem(block, "text");
-                    if (text && cJSON_IsString(text)) {
-                        total_text += strlen(text->valuestring);
-                    }
-                }
-            }
+esp_err_t llm_chat_tools_stream(const llm_system_prompt_t *system,
+                                cJSON *messages,
+                                const llm_tools_t *tools,
+                                llm_response_t *resp,
+                                llm_token_cb_t on_token,
+                                void *cb_ctx)
+{
+    memset(resp, 0, sizeof(*resp));
 
-            /* Allocate and copy text */
-            if (total_text > 0) {
-                resp->text = calloc(1, total_text + 1);
-                if (resp->text) {
-                    cJSON_ArrayForEach(block, content) {
-                        cJSON *btype = cJSON_GetObjectItem(block, "type");
-                        if (!btype || strcmp(btype->valuestring, "text") != 0) continue;
-                        cJSON *text = cJSON_GetObjectItem(block, "text");
-                        if (!text || !cJSON_IsString(text)) continue;
-                        size_t tlen = strlen(text->valuestring);
-                        memcpy(resp->text + resp->text_len, text->valuestring, tlen);
-                        resp->text_len += tlen;
-                    }
-                    resp->text[resp->text_len] = '\0';
-                }
-            }
+    if (s_api_key[0] == '\0') return ESP_ERR_INVALID_STATE;
 
-            /* Extract tool_use blocks */
-            cJSON_ArrayForEach(block, content) {
-                cJSON *btype = cJSON_GetObjectItem(block, "type");
-                if (!btype || strcmp(btype->valuestring, "tool_use") != 0) continue;
-                if (resp->call_count >= MIMI_MAX_TOOL_CALLS) break;
+    llm_body_t body = {
+        .system = system,
+        .messages = messages,
+        .tools = tools,
+        .stream = true,
+    };
+    size_t body_len = llm_body_length(&body);
 
-                llm_tool_call_t *call = &resp->calls[resp->call_count];
+    ESP_LOGI(TAG, "Streaming LLM API with tools (provider: %s, model: %s, body: %d bytes)",
+             s_provider, s_model, (int)body_len);
 
-                cJSON *id = cJSON_GetObjectItem(block, "id");
-                if (id && cJSON_IsString(id)) {
-                    strncpy(call->id, id->valuestring, sizeof(call->id) - 1);
-                }
+    /* Only error bodies are buffered; a 200 stream goes straight to the decoder */
+    resp_buf_t rb;
+    if (resp_buf_init(&rb, 1024) != ESP_OK) return ESP_ERR_NO_MEM;
 
-                cJSON *name = cJSON_GetObjectItem(block, "name");
-                if (name && cJSON_IsString(name)) {
-                    strncpy(call->name, name->valuestring, sizeof(call->name) - 1);
-                }
+    llm_stream_t stream;
+    llm_stream_init(&stream, llm_format(), resp, on_token, cb_ctx);
 
-                cJSON *input = cJSON_GetObjectItem(block, "input");
-                if (input) {
-                    char *input_str = cJSON_PrintUnformatted(input);
-                    if (input_str) {
-                        call->input = input_str;
-                        call->input_len = strlen(input_str);
-                    }
-                }
+    llm_sink_t sink = { .rb = &rb, .stream = &stream };
+    esp_err_t err = llm_http_call(&body, body_len, &sink);
 
-                resp->call_count++;
-            }
-        }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
+    } else if (sink.status != 200) {
+        ESP_LOGE(TAG, "API error %d: %.500s", sink.status, rb.data ? rb.data : "");
+        err = ESP_FAIL;
+    } else {
+        err = llm_stream_finish(&stream);
     }
 
-    cJSON_Delete(root);
+    llm_stream_free(&stream);
+    resp_buf_free(&rb);
+
+    if (err != ESP_OK) {
+        llm_response_free(resp);
+        return err;
+    }
 
-    ESP_LOGI(TAG, "Response: %d bytes text, %d tool calls, stop=%s",
+    ESP_LOGI(TAG, "Stream complete: %d bytes text, %d tool calls, stop=%s",
              (int)resp->text_len, resp->call_count,
              resp->tool_use ? "tool_use" : "end_turn");
 
@@ -41,6 +41,30 @@ esp_err_t llm_chat(const char *system_prompt, const char *messages_json,
 
 /* ── Tool Use Support ──────────────────────────────────────────── */
 
+/**
+ * System prompt laid out from least to most frequently changing. The parts
+ * are consecutive ranges of text: stable instructions, then memory, then
+ * the remainder (recent notes). Anthropic requests send each part as its
+ * own system block with a cache breakpoint; other providers get the text
+ * as one string, which keeps the stable prefix for automatic caching.
+ */
+typedef struct {
+    const char *text;           /* whole prompt */
+    size_t      stable_len;     /* instructions, tool guide, SOUL.md, USER.md; 0 = unsplit */
+    size_t      memory_len;     /* MEMORY.md section following the stable part */
+} llm_system_prompt_t;
+
+/**
+ * Tool definitions serialized once per wire format (see tool_registry) and
+ * copied into each request as-is.
+ */
+typedef struct {
+    const char *anthropic;      /* [{"name","description","input_schema"},...] */
+    size_t      anthropic_len;
+    const char *openai;         /* [{"type":"function","function":{...}},...] */
+    size_t      openai_len;
+} llm_tools_t;
+
 typedef struct {
     char id[64];        /* "toolu_xxx" */
     char name[32];      /* "web_search" */
@@ -58,16 +82,39 @@ typedef struct {
 
 void llm_response_free(llm_response_t *resp);
 
+/**
+ * Token callback for streaming calls. Invoked with each text fragment as it
+ * is decoded; text is not NUL-terminated.
+ */
+typedef void (*llm_token_cb_t)(const char *text, size_t len, void *ctx);
+
 /**
  * Send a chat completion request with tools to the configured LLM API (non-streaming).
  *
- * @param system_prompt  System prompt string
+ * @param system         System prompt and its cacheable parts
  * @param messages       cJSON array of messages (caller owns)
- * @param tools_json     Pre-built JSON string of tools array, or NULL for no tools
+ * @param tools          Pre-serialized tool arrays, or NULL for no tools
  * @param resp           Output: structured response with text and tool calls
  * @return ESP_OK on success
  */
-esp_err_t llm_chat_tools(const char *system_prompt,
+esp_err_t llm_chat_tools(const llm_system_prompt_t *system,
                          cJSON *messages,
-                         const char *tools_json,
+                         const llm_tools_t *tools,
                          llm_response_t *resp);
+
+/**
+ * Streaming variant of llm_chat_tools(): sends "stream": true and decodes the
+ * server-sent events incrementally into the same llm_response_t, so text is
+ * available before the completion finishes. Handles both Anthropic events
+ * and OpenAI-compatible chat.completion.chunk streams.
+ *
+ * @param on_token  Optional callback for each text delta (may be NULL)
+ * @param cb_ctx    Passed through to on_token
+ * @return ESP_OK on success; on failure resp holds no allocations
+ */
+esp_err_t llm_chat_tools_stream(const llm_system_prompt_t *system,
+                                cJSON *messages,
+                                const llm_tools_t *tools,
+                                llm_response_t *resp,
+                                llm_token_cb_t on_token,
+                                void *cb_ctx);
@@ -0,0 +1,308 @@
+#include "llm_stream.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "cJSON.h"
+
+static const char *TAG = "llm_stream";
+
+/* Largest single line / event payload we are willing to buffer */
+#define SSE_MAX_EVENT  MIMI_LLM_STREAM_BUF_SIZE
+
+/* ── Growable buffers ─────────────────────────────────────────── */
+
+static bool buf_append(char **buf, size_t *len, size_t *cap,
+                       const char *data, size_t n)
+{
+    if (*len + n + 1 > *cap) {
+        size_t new_cap = *cap ? *cap : 256;
+        while (*len + n + 1 > new_cap) new_cap *= 2;
+        char *tmp = realloc(*buf, new_cap);
+        if (!tmp) return false;
+        *buf = tmp;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+    return true;
+}
+
+static void append_text(llm_stream_t *s, const char *text, size_t len)
+{
+    if (len == 0) return;
+    llm_response_t *resp = s->resp;
+    if (!buf_append(&resp->text, &resp->text_len, &s->text_cap, text, len)) {
+        ESP_LOGE(TAG, "Out of memory for response text");
+        s->failed = true;
+        return;
+    }
+    if (s->on_token) s->on_token(text, len, s->cb_ctx);
+}
+
+static void append_input(llm_stream_t *s, int slot, const char *json, size_t len)
+{
+    llm_tool_call_t *call = &s->resp->calls[slot];
+    if (!buf_append(&call->input, &call->input_len, &s->input_cap[slot], json, len)) {
+        ESP_LOGE(TAG, "Out of memory for tool input");
+        s->failed = true;
+    }
+}
+
+/* ── Anthropic event handling ─────────────────────────────────── */
+
+static void handle_anthropic_event(llm_stream_t *s, cJSON *data)
+{
+    llm_response_t *resp = s->resp;
+    const char *type = cJSON_GetStringValue(cJSON_GetObjectItem(data, "type"));
+    if (!type) type = s->event;
+
+    if (strcmp(type, "content_block_start") == 0) {
+        cJSON *block = cJSON_GetObjectItem(data, "content_block");
+        const char *btype = cJSON_GetStringValue(cJSON_GetObjectItem(block, "type"));
+        s->cur_call = -1;
+        if (!btype || strcmp(btype, "tool_use") != 0) return;
+
+        if (resp->call_count >= MIMI_MAX_TOOL_CALLS) {
+            ESP_LOGW(TAG, "Too many tool calls, ignoring extra tool_use block");
+            return;
+        }
+        s->cur_call = resp->call_count++;
+        llm_tool_call_t *call = &resp->calls[s->cur_call];
+        const char *id = cJSON_GetStringValue(cJSON_GetObjectItem(block, "id"));
+        const char *name = cJSON_GetStringValue(cJSON_GetObjectItem(block, "name"));
+        if (id) strncpy(call->id, id, sizeof(call->id) - 1);
+        if (name) strncpy(call->name, name, sizeof(call->name) - 1);
+
+    } else if (strcmp(type, "content_block_delta") == 0) {
+        cJSON *delta = cJSON_GetObjectItem(data, "delta");
+        const char *dtype = cJSON_GetStringValue(cJSON_GetObjectItem(delta, "type"));
+        if (!dtype) return;
+
+        if (strcmp(dtype, "text_delta") == 0) {
+            const char *text = cJSON_GetStringValue(cJSON_GetObjectItem(delta, "text"));
+            if (text) append_text(s, text, strlen(text));
+        } else if (strcmp(dtype, "input_json_delta") == 0 && s->cur_call >= 0) {
+            const char *part = cJSON_GetStringValue(cJSON_GetObjectItem(delta, "partial_json"));
+            if (part) append_input(s, s->cur_call, part, strlen(part));
+        }
+
+    } else if (strcmp(type, "content_block_stop") == 0) {
+        if (s->cur_call >= 0 && resp->calls[s->cur_call].input_len == 0) {
+            /* Tool called without arguments */
+            append_input(s, s->cur_call, "{}", 2);
+        }
+        s->cur_call = -1;
+
+    } else if (strcmp(type, "message_delta") == 0) {
+        cJSON *delta = cJSON_GetObjectItem(data, "delta");
+        const char *stop = cJSON_GetStringValue(cJSON_GetObjectItem(delta, "stop_reason"));
+        if (stop) resp->tool_use = (strcmp(stop, "tool_use") == 0);
+
+    } else if (strcmp(type, "message_stop") == 0) {
+        s->done = true;
+
+    } else if (strcmp(type, "error") == 0) {
+        cJSON *err = cJSON_GetObjectItem(data, "error");
+        const char *msg = cJSON_GetStringValue(cJSON_GetObjectItem(err, "message"));
+        ESP_LOGE(TAG, "Stream error event: %s", msg ? msg : "(no message)");
+        s->failed = true;
+    }
+    /* message_start, ping: nothing to do */
+}
+
+/* ── OpenAI chunk handling ────────────────────────────────────── */
+
+/* Map a tool_calls[].index onto a call slot, allocating on first sight */
+static int openai_call_slot(llm_stream_t *s, int index)
+{
+    llm_response_t *resp = s->resp;
+    for (int i = 0; i < resp->call_count; i++) {
+        if (s->call_index[i] == index) return i;
+    }
+    if (resp->call_count >= MIMI_MAX_TOOL_CALLS) {
+        ESP_LOGW(TAG, "Too many tool calls, ignoring tool_calls[%d]", index);
+        return -1;
+    }
+    s->call_index[resp->call_count] = index;
+    return resp->call_count++;
+}
+
+static void handle_openai_chunk(llm_stream_t *s, cJSON *data)
+{
+    llm_response_t *resp = s->resp;
+
+    cJSON *err = cJSON_GetObjectItem(data, "error");
+    if (err) {
+        const char *msg = cJSON_GetStringValue(cJSON_GetObjectItem(err, "message"));
+        ESP_LOGE(TAG, "Stream error chunk: %s", msg ? msg : "(no message)");
+        s->failed = true;
+        return;
+    }
+
+    cJSON *choice0 = cJSON_GetArrayItem(cJSON_GetObjectItem(data, "choices"), 0);
+    if (!choice0) return;   /* e.g. trailing usage-only chunk */
+
+    cJSON *delta = cJSON_GetObjectItem(choice0, "delta");
+    const char *content = cJSON_GetStringValue(cJSON_GetObjectItem(delta, "content"));
+    if (content) append_text(s, content, strlen(content));
+
+    cJSON *tc;
+    cJSON_ArrayForEach(tc, cJSON_GetObjectItem(delta, "tool_calls")) {
+        cJSON *index = cJSON_GetObjectItem(tc, "index");
+        int slot = openai_call_slot(s, cJSON_IsNumber(index) ? index->valueint : 0);
+        if (slot < 0) continue;
+
+        llm_tool_call_t *call = &resp->calls[slot];
+        const char *id = cJSON_GetStringValue(cJSON_GetObjectItem(tc, "id"));
+        if (id) strncpy(call->id, id, sizeof(call->id) - 1);
+
+        cJSON *func = cJSON_GetObjectItem(tc, "function");
+        const char *name = cJSON_GetStringValue(cJSON_GetObjectItem(func, "name"));
+        if (name) strncpy(call->name, name, sizeof(call->name) - 1);
+        const char *args = cJSON_GetStringValue(cJSON_GetObjectItem(func, "arguments"));
+        if (args && args[0]) append_input(s, slot, args, strlen(args));
+    }
+
+    const char *finish = cJSON_GetStringValue(cJSON_GetObjectItem(choice0, "finish_reason"));
+    if (finish) {
+        /* Some compatible backends close the stream without [DONE] */
+        if (strcmp(finish, "tool_calls") == 0) resp->tool_use = true;
+        s->done = true;
+    }
+}
+
+/* ── SSE framing ──────────────────────────────────────────────── */
+
+static void sse_dispatch(llm_stream_t *s)
+{
+    if (s->format == LLM_STREAM_OPENAI && s->data_len > 0 &&
+        strcmp(s->data, "[DONE]") == 0) {
+        s->done = true;
+    } else if (s->data_len > 0) {
+        cJSON *data = cJSON_Parse(s->data);
+        if (data) {
+            if (s->format == LLM_STREAM_OPENAI) {
+                handle_openai_chunk(s, data);
+            } else {
+                handle_anthropic_event(s, data);
+            }
+            cJSON_Delete(data);
+        } else {
+            ESP_LOGW(TAG, "Unparseable event data: %.80s", s->data);
+        }
+    }
+    s->event[0] = '\0';
+    s->data_len = 0;
+    if (s->data) s->data[0] = '\0';
+}
+
+static void sse_line(llm_stream_t *s, char *line, size_t len)
+{
+    if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+
+    if (len == 0) {
+        sse_dispatch(s);
+        return;
+    }
+    if (line[0] == ':') return;     /* comment / keep-alive */
+
+    char *colon = memchr(line, ':', len);
+    size_t field_len = colon ? (size_t)(colon - line) : len;
+    const char *value = colon ? colon + 1 : line + len;
+    if (*value == ' ') value++;
+    size_t value_len = len - (value - line);
+
+    if (field_len == 5 && strncmp(line, "event", 5) == 0) {
+        size_t n = value_len < sizeof(s->event) - 1 ? value_len : sizeof(s->event) - 1;
+        memcpy(s->event, value, n);
+        s->event[n] = '\0';
+    } else if (field_len == 4 && strncmp(line, "data", 4) == 0) {
+        if (s->data_len + value_len + 1 > SSE_MAX_EVENT) {
+            ESP_LOGE(TAG, "Event payload exceeds %d bytes", SSE_MAX_EVENT);
+            s->failed = true;
+            return;
+        }
+        bool ok = true;
+        if (s->data_len > 0) ok = buf_append(&s->data, &s->data_len, &s->data_cap, "\n", 1);
+        if (ok) ok = buf_append(&s->data, &s->data_len, &s->data_cap, value, value_len);
+        if (!ok) s->failed = true;
+    }
+    /* id:, retry: and unknown fields are ignored */
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+void llm_stream_init(llm_stream_t *s, llm_stream_format_t format, llm_response_t *resp,
+                     llm_token_cb_t on_token, void *cb_ctx)
+{
+    memset(s, 0, sizeof(*s));
+    s->format = format;
+    s->resp = resp;
+    s->on_token = on_token;
+    s->cb_ctx = cb_ctx;
+    s->cur_call = -1;
+}
+
+esp_err_t llm_stream_feed(llm_stream_t *s, const char *data, size_t len)
+{
+    while (len > 0 && !s->failed) {
+        const char *nl = memchr(data, '\n', len);
+        size_t seg = nl ? (size_t)(nl - data) : len;
+
+        if (s->line_len + seg + 1 > SSE_MAX_EVENT) {
+            ESP_LOGE(TAG, "SSE line exceeds %d bytes", SSE_MAX_EVENT);
+            s->failed = true;
+            break;
+        }
+        if (!buf_append(&s->line, &s->line_len, &s->line_cap, data, seg)) {
+            s->failed = true;
+            break;
+        }
+
+        if (!nl) break;
+        sse_line(s, s->line, s->line_len);
+        s->line_len = 0;
+        data += seg + 1;
+        len -= seg + 1;
+    }
+    return s->failed ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t llm_stream_finish(llm_stream_t *s)
+{
+    if (!s->failed && s->line_len > 0) {
+        sse_line(s, s->line, s->line_len);
+        s->line_len = 0;
+    }
+    if (!s->failed) sse_dispatch(s);
+
+    if (s->failed) return ESP_FAIL;
+    if (!s->done) {
+        ESP_LOGE(TAG, "Stream ended before completion");
+        return ESP_FAIL;
+    }
+
+    if (s->format == LLM_STREAM_OPENAI) {
+        llm_response_t *resp = s->resp;
+        for (int i = 0; i < resp->call_count; i++) {
+            if (resp->calls[i].input_len == 0) {
+                append_input(s, i, "{}", 2);
+            }
+        }
+        if (resp->call_count > 0) resp->tool_use = true;
+    }
+    return s->failed ? ESP_FAIL : ESP_OK;
+}
+
+void llm_stream_free(llm_stream_t *s)
+{
+    free(s->line);
+    free(s->data);
+    s->line = NULL;
+    s->data = NULL;
+    s->line_len = s->line_cap = 0;
+    s->data_len = s->data_cap = 0;
+}
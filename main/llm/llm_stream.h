@@ -0,0 +1,66 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "llm/llm_proxy.h"
+
+/** Wire format of the event stream */
+typedef enum {
+    LLM_STREAM_ANTHROPIC,   /* typed events: content_block_delta, message_delta, ... */
+    LLM_STREAM_OPENAI,      /* chat.completion.chunk objects, terminated by [DONE] */
+} llm_stream_format_t;
+
+/**
+ * Incremental server-sent-events decoder for streaming LLM responses.
+ *
+ * Bytes are fed in whatever slices the transport delivers; complete events
+ * are decoded as soon as their terminating blank line arrives and folded
+ * into an llm_response_t. Has no transport dependencies, so a captured
+ * stream (or a local stand-in server) can be replayed through it directly.
+ */
+typedef struct {
+    /* SSE framing */
+    char   *line;               /* current, not yet terminated line */
+    size_t  line_len;
+    size_t  line_cap;
+    char    event[32];          /* "event:" field of the pending event */
+    char   *data;               /* joined "data:" fields of the pending event */
+    size_t  data_len;
+    size_t  data_cap;
+
+    /* Response assembly */
+    llm_stream_format_t format;
+    llm_response_t *resp;
+    llm_token_cb_t  on_token;
+    void           *cb_ctx;
+    size_t          text_cap;
+    size_t          input_cap[MIMI_MAX_TOOL_CALLS];
+    int             cur_call;   /* call slot of the open tool_use block, or -1 */
+    int             call_index[MIMI_MAX_TOOL_CALLS];  /* OpenAI tool_calls[].index per slot */
+    bool            done;       /* message_stop / [DONE] seen */
+    bool            failed;     /* error event or decode failure */
+} llm_stream_t;
+
+/**
+ * Prepare a decoder that fills resp (which must be zeroed by the caller).
+ * on_token is optional and receives each text delta as it is decoded.
+ */
+void llm_stream_init(llm_stream_t *s, llm_stream_format_t format, llm_response_t *resp,
+                     llm_token_cb_t on_token, void *cb_ctx);
+
+/**
+ * Feed raw response body bytes. Events completed by this slice are applied
+ * to the response before returning.
+ */
+esp_err_t llm_stream_feed(llm_stream_t *s, const char *data, size_t len);
+
+/**
+ * Flush any trailing event after the body ends.
+ * @return ESP_OK if the stream completed normally, ESP_FAIL otherwise
+ */
+esp_err_t llm_stream_finish(llm_stream_t *s);
+
+/** Release decoder buffers (the response keeps its own allocations). */
+void llm_stream_free(llm_stream_t *s);
@@ -1,5 +1,6 @@
 #include "memory_store.h"
 #include "mimi_config.h"
+#include "agent/context_builder.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -50,6 +51,7 @@ esp_err_t memory_write_long_term(const char *content)
     }
     fputs(content, f);
     fclose(f);
+    context_invalidate_file(MIMI_MEMORY_FILE);
     ESP_LOGI(TAG, "Long-term memory updated (%d bytes)", (int)strlen(content));
     return ESP_OK;
 }
@@ -75,6 +77,7 @@ esp_err_t memory_append_today(const char *note)
 
     fprintf(f, "%s\n", note);
     fclose(f);
+    context_invalidate_file(path);
     return ESP_OK;
 }
 
@@ -0,0 +1,399 @@
+#include "session_log.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+static const char *TAG = "session_log";
+
+/*
+ * Layout: the partition is a ring of MIMI_SESSION_LOG_BLOCK-sized blocks.
+ * Each block starts with a header carrying a sequence number that grows by
+ * one per block written, so block seq lives at index seq % block_count and
+ * the highest valid seq on flash is the head. Records follow back to back
+ * (4-byte aligned) and never span blocks:
+ *
+ *   u16 magic | u16 payload len | u32 crc32(payload)
+ *   payload:  u8 role len | u8 chat id len | u32 ts | role | chat id | content
+ *
+ * A record with an empty role clears its chat. Erased flash (0xFF) marks the
+ * end of a block; a record whose CRC does not match was torn by a power cut,
+ * and the rest of its block is abandoned.
+ */
+
+#define BLOCK_MAGIC     0x424C534DU     /* "MSLB" */
+#define RECORD_MAGIC    0x5A4D
+#define BLOCK_HDR_SIZE  8
+#define REC_HDR_SIZE    8
+#define PAYLOAD_FIXED   6               /* role len, chat id len, ts */
+#define ALIGN4(n)       (((n) + 3) & ~(size_t)3)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+} block_hdr_t;
+
+typedef struct {
+    uint16_t magic;
+    uint16_t len;
+    uint32_t crc;
+} rec_hdr_t;
+
+/* ── Index ────────────────────────────────────────────────────── */
+
+typedef struct {
+    uint32_t seq;                   /* block sequence number */
+    uint16_t off;                   /* record offset within the block */
+} log_pos_t;
+
+typedef struct {
+    char      chat_id[32];
+    log_pos_t recent[MIMI_SESSION_MAX_MSGS];    /* ring, oldest at head */
+    uint8_t   head;
+    uint8_t   count;
+} log_chat_t;
+
+static const esp_partition_t *s_part;
+static uint32_t  s_blocks;          /* blocks in the partition */
+static uint32_t  s_head_seq;        /* block being appended to */
+static uint32_t  s_oldest_seq;      /* oldest block still on flash */
+static uint32_t  s_write_off;       /* next free offset in the head block */
+static uint8_t  *s_buf;             /* one block, PSRAM */
+
+static log_chat_t *s_chats;         /* PSRAM, grown on demand */
+static int s_chat_count;
+static int s_chat_cap;
+
+static log_chat_t *index_find(const char *chat_id, bool create)
+{
+    for (int i = 0; i < s_chat_count; i++) {
+        if (strcmp(s_chats[i].chat_id, chat_id) == 0) return &s_chats[i];
+    }
+    if (!create) return NULL;
+
+    if (s_chat_count == s_chat_cap) {
+        int cap = s_chat_cap ? s_chat_cap * 2 : 16;
+        log_chat_t *grown = heap_caps_realloc(s_chats, cap * sizeof(*grown), MALLOC_CAP_SPIRAM);
+        if (!grown) {
+            ESP_LOGW(TAG, "Out of PSRAM indexing chat %s", chat_id);
+            return NULL;
+        }
+        s_chats = grown;
+        s_chat_cap = cap;
+    }
+    log_chat_t *c = &s_chats[s_chat_count++];
+    memset(c, 0, sizeof(*c));
+    strncpy(c->chat_id, chat_id, sizeof(c->chat_id) - 1);
+    return c;
+}
+
+static void index_apply(const char *chat_id, bool clear, log_pos_t pos)
+{
+    log_chat_t *c = index_find(chat_id, !clear);
+    if (!c) return;
+    if (clear) {
+        c->head = 0;
+        c->count = 0;
+        return;
+    }
+    if (c->count == MIMI_SESSION_MAX_MSGS) {
+        c->head = (c->head + 1) % MIMI_SESSION_MAX_MSGS;
+        c->count--;
+    }
+    c->recent[(c->head + c->count) % MIMI_SESSION_MAX_MSGS] = pos;
+    c->count++;
+}
+
+/* ── Records ──────────────────────────────────────────────────── */
+
+static size_t block_addr(uint32_t seq)
+{
+    return (size_t)(seq % s_blocks) * MIMI_SESSION_LOG_BLOCK;
+}
+
+/*
+ * Validate the record at buf[off] within a block of `avail` bytes.
+ * @return total aligned record size, 0 at the erased end, -1 if corrupt
+ */
+static int record_check(const uint8_t *buf, size_t off, size_t avail)
+{
+    if (off + REC_HDR_SIZE > avail) return 0;
+    rec_hdr_t hdr;
+    memcpy(&hdr, buf + off, sizeof(hdr));
+    if (hdr.magic == 0xFFFF) return 0;
+    if (hdr.magic != RECORD_MAGIC || hdr.len < PAYLOAD_FIXED ||
+        off + REC_HDR_SIZE + hdr.len > avail) {
+        return -1;
+    }
+
+    const uint8_t *p = buf + off + REC_HDR_SIZE;
+    if (esp_rom_crc32_le(0, p, hdr.len) != hdr.crc) return -1;
+    if (PAYLOAD_FIXED + p[0] + p[1] > hdr.len) return -1;
+    return (int)ALIGN4(REC_HDR_SIZE + hdr.len);
+}
+
+/* Split a checked payload; role and chat id are copied to be terminated */
+static const char *record_fields(const uint8_t *payload, uint16_t len,
+                                 char *role, size_t role_size,
+                                 char *chat_id, size_t chat_size, size_t *content_len)
+{
+    uint8_t role_len = payload[0], chat_len = payload[1];
+    const uint8_t *p = payload + PAYLOAD_FIXED;
+
+    size_t n = role_len < role_size - 1 ? role_len : role_size - 1;
+    memcpy(role, p, n);
+    role[n] = '\0';
+    n = chat_len < chat_size - 1 ? chat_len : chat_size - 1;
+    memcpy(chat_id, p + role_len, n);
+    chat_id[n] = '\0';
+
+    *content_len = len - PAYLOAD_FIXED - role_len - chat_len;
+    return (const char *)p + role_len + chat_len;
+}
+
+/* ── Recovery ─────────────────────────────────────────────────── */
+
+static bool read_block_hdr(uint32_t index, block_hdr_t *hdr)
+{
+    if (esp_partition_read(s_part, (size_t)index * MIMI_SESSION_LOG_BLOCK,
+                           hdr, sizeof(*hdr)) != ESP_OK) {
+        return false;
+    }
+    return hdr->magic == BLOCK_MAGIC && hdr->seq % s_blocks == index;
+}
+
+/* Replay one block into the index; returns the end of its valid records */
+static uint32_t replay_block(uint32_t seq)
+{
+    if (esp_partition_read(s_part, block_addr(seq), s_buf, MIMI_SESSION_LOG_BLOCK) != ESP_OK) {
+        ESP_LOGE(TAG, "Read failed in block %lu", (unsigned long)seq);
+        return MIMI_SESSION_LOG_BLOCK;
+    }
+
+    size_t off = BLOCK_HDR_SIZE;
+    int size;
+    while ((size = record_check(s_buf, off, MIMI_SESSION_LOG_BLOCK)) > 0) {
+        rec_hdr_t hdr;
+        memcpy(&hdr, s_buf + off, sizeof(hdr));
+        char role[12], chat_id[32];
+        size_t content_len;
+        record_fields(s_buf + off + REC_HDR_SIZE, hdr.len, role, sizeof(role),
+                      chat_id, sizeof(chat_id), &content_len);
+        index_apply(chat_id, role[0] == '\0', (log_pos_t){ .seq = seq, .off = (uint16_t)off });
+        off += size;
+    }
+
+    if (size < 0) {
+        ESP_LOGW(TAG, "Torn record at block %lu offset %u, skipping rest of block",
+                 (unsigned long)seq, (unsigned)off);
+        return MIMI_SESSION_LOG_BLOCK;  /* never append behind it */
+    }
+    return off;
+}
+
+static esp_err_t start_block(uint32_t seq)
+{
+    esp_err_t err = esp_partition_erase_range(s_part, block_addr(seq), MIMI_SESSION_LOG_BLOCK);
+    if (err != ESP_OK) return err;
+
+    block_hdr_t hdr = { .magic = BLOCK_MAGIC, .seq = seq };
+    err = esp_partition_write(s_part, block_addr(seq), &hdr, sizeof(hdr));
+    if (err != ESP_OK) return err;
+
+    /* The ring is full: the block just erased held the oldest records */
+    if (seq - s_oldest_seq >= s_blocks) s_oldest_seq = seq - s_blocks + 1;
+    s_head_seq = seq;
+    s_write_off = BLOCK_HDR_SIZE;
+    return ESP_OK;
+}
+
+esp_err_t session_log_mount(const char *label)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!s_part) return ESP_ERR_NOT_FOUND;
+
+    if (MIMI_SESSION_LOG_BLOCK % s_part->erase_size != 0 ||
+        s_part->size < 2 * MIMI_SESSION_LOG_BLOCK) {
+        ESP_LOGE(TAG, "Partition %s too small or misaligned for %d-byte blocks",
+                 label, MIMI_SESSION_LOG_BLOCK);
+        s_part = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_blocks = s_part->size / MIMI_SESSION_LOG_BLOCK;
+
+    s_buf = heap_caps_malloc(MIMI_SESSION_LOG_BLOCK, MALLOC_CAP_SPIRAM);
+    if (!s_buf) {
+        s_part = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Find the live range of blocks */
+    bool found = false;
+    uint32_t oldest = 0, head = 0;
+    for (uint32_t i = 0; i < s_blocks; i++) {
+        block_hdr_t hdr;
+        if (!read_block_hdr(i, &hdr)) continue;
+        if (!found || hdr.seq < oldest) oldest = hdr.seq;
+        if (!found || hdr.seq > head) head = hdr.seq;
+        found = true;
+    }
+
+    if (!found) {
+        ESP_LOGI(TAG, "No log on %s, formatting", label);
+        s_oldest_seq = 1;
+        esp_err_t err = start_block(1);
+        if (err != ESP_OK) {
+            free(s_buf);
+            s_buf = NULL;
+            s_part = NULL;
+        }
+        return err;
+    }
+
+    s_oldest_seq = oldest;
+    s_head_seq = head;
+    for (uint32_t seq = oldest; seq <= head; seq++) {
+        block_hdr_t hdr;
+        if (!read_block_hdr(seq % s_blocks, &hdr) || hdr.seq != seq) continue;
+        s_write_off = replay_block(seq);
+    }
+
+    ESP_LOGI(TAG, "Session log on %s: %lu blocks live, %d chats indexed",
+             label, (unsigned long)(head - oldest + 1), s_chat_count);
+    return ESP_OK;
+}
+
+void session_log_unmount(void)
+{
+    free(s_buf);
+    free(s_chats);
+    s_buf = NULL;
+    s_chats = NULL;
+    s_chat_count = s_chat_cap = 0;
+    s_part = NULL;
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
+static esp_err_t log_append(const char *chat_id, const char *role,
+                            const char *content, uint32_t ts)
+{
+    if (!s_part) return ESP_ERR_INVALID_STATE;
+
+    size_t role_len = strlen(role), chat_len = strlen(chat_id);
+    if (role_len > 255 || chat_len > 255) return ESP_ERR_INVALID_ARG;
+
+    size_t max_content = MIMI_SESSION_LOG_BLOCK - BLOCK_HDR_SIZE - REC_HDR_SIZE -
+                         PAYLOAD_FIXED - role_len - chat_len;
+    size_t content_len = strlen(content);
+    if (content_len > max_content) {
+        ESP_LOGW(TAG, "Truncating %u-byte message for chat %s",
+                 (unsigned)content_len, chat_id);
+        content_len = max_content;
+    }
+
+    size_t len = PAYLOAD_FIXED + role_len + chat_len + content_len;
+    size_t size = ALIGN4(REC_HDR_SIZE + len);
+    if (s_write_off + size > MIMI_SESSION_LOG_BLOCK) {
+        esp_err_t err = start_block(s_head_seq + 1);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Cannot start block %lu: %s",
+                     (unsigned long)(s_head_seq + 1), esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    uint8_t *p = s_buf + REC_HDR_SIZE;
+    p[0] = (uint8_t)role_len;
+    p[1] = (uint8_t)chat_len;
+    memcpy(p + 2, &ts, sizeof(ts));
+    memcpy(p + PAYLOAD_FIXED, role, role_len);
+    memcpy(p + PAYLOAD_FIXED + role_len, chat_id, chat_len);
+    memcpy(p + PAYLOAD_FIXED + role_len + chat_len, content, content_len);
+    memset(s_buf + REC_HDR_SIZE + len, 0xFF, size - REC_HDR_SIZE - len);
+
+    rec_hdr_t hdr = {
+        .magic = RECORD_MAGIC,
+        .len   = (uint16_t)len,
+        .crc   = esp_rom_crc32_le(0, p, len),
+    };
+    memcpy(s_buf, &hdr, sizeof(hdr));
+
+    log_pos_t pos = { .seq = s_head_seq, .off = (uint16_t)s_write_off };
+    esp_err_t err = esp_partition_write(s_part, block_addr(s_head_seq) + s_write_off, s_buf, size);
+    if (err != ESP_OK) {
+        /* Whatever reached flash fails its CRC; continue in a fresh block */
+        s_write_off = MIMI_SESSION_LOG_BLOCK;
+        return err;
+    }
+    s_write_off += size;
+
+    index_apply(chat_id, role_len == 0, pos);
+    return ESP_OK;
+}
+
+esp_err_t session_log_append(const char *chat_id, const char *role,
+                             const char *content, uint32_t ts)
+{
+    if (!role[0]) return ESP_ERR_INVALID_ARG;   /* empty role is the clear marker */
+    return log_append(chat_id, role, content, ts);
+}
+
+esp_err_t session_log_clear(const char *chat_id)
+{
+    log_chat_t *c = index_find(chat_id, false);
+    if (!c || c->count == 0) return ESP_ERR_NOT_FOUND;
+    return log_append(chat_id, "", "", 0);
+}
+
+int session_log_history(const char *chat_id, int max_msgs,
+                        session_log_visit_t visit, void *ctx)
+{
+    log_chat_t *c = s_part ? index_find(chat_id, false) : NULL;
+    if (!c) return 0;
+
+    int n = c->count < max_msgs ? c->count : max_msgs;
+    int visited = 0;
+    for (int i = c->count - n; i < c->count; i++) {
+        log_pos_t pos = c->recent[(c->head + i) % MIMI_SESSION_MAX_MSGS];
+        if (pos.seq < s_oldest_seq) continue;   /* erased by wrap-around */
+
+        /* Header first, then exactly the record */
+        size_t addr = block_addr(pos.seq) + pos.off;
+        rec_hdr_t hdr;
+        if (esp_partition_read(s_part, addr, &hdr, sizeof(hdr)) != ESP_OK ||
+            hdr.magic != RECORD_MAGIC ||
+            pos.off + REC_HDR_SIZE + hdr.len > MIMI_SESSION_LOG_BLOCK ||
+            esp_partition_read(s_part, addr, s_buf, REC_HDR_SIZE + hdr.len) != ESP_OK ||
+            record_check(s_buf, 0, REC_HDR_SIZE + hdr.len) <= 0) {
+            ESP_LOGW(TAG, "Unreadable record for chat %s", chat_id);
+            continue;
+        }
+
+        char role[12], id[32];
+        size_t content_len;
+        const char *content = record_fields(s_buf + REC_HDR_SIZE, hdr.len, role, sizeof(role),
+                                            id, sizeof(id), &content_len);
+        /* A record never fills its block, so there is room to terminate */
+        s_buf[REC_HDR_SIZE + hdr.len] = '\0';
+        visit(role, content, ctx);
+        visited++;
+    }
+    return visited;
+}
+
+void session_log_list(void (*fn)(const char *chat_id, int records, void *ctx), void *ctx)
+{
+    for (int i = 0; i < s_chat_count; i++) {
+        const log_chat_t *c = &s_chats[i];
+        int live = 0;
+        for (int j = 0; j < c->count; j++) {
+            if (c->recent[(c->head + j) % MIMI_SESSION_MAX_MSGS].seq >= s_oldest_seq) live++;
+        }
+        if (live) fn(c->chat_id, live, ctx);
+    }
+}
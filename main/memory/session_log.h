@@ -0,0 +1,50 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Log-structured session store on a raw flash partition.
+ *
+ * All chats share one append-only circular log of length-prefixed, CRC-
+ * checked binary records, written in blocks of MIMI_SESSION_LOG_BLOCK bytes.
+ * When the log wraps, the oldest block is erased. An in-memory index keeps
+ * the positions of each chat's latest records. It is rebuilt on mount by
+ * scanning the log, and records torn by a power cut are dropped.
+ *
+ * Only esp_partition_* calls touch flash, so the module also runs on the
+ * IDF linux target against its file-backed partition emulation.
+ * Not thread-safe: callers serialize access (session_mgr holds its lock).
+ */
+
+/** Receives one history record; strings are only valid during the call. */
+typedef void (*session_log_visit_t)(const char *role, const char *content, void *ctx);
+
+/**
+ * Mount the log on the data partition with the given label and rebuild the
+ * index. Formats the partition if it holds no log yet.
+ * @return ESP_ERR_NOT_FOUND if there is no such partition
+ */
+esp_err_t session_log_mount(const char *label);
+
+/** Drop the index and release the buffers; the log can be mounted again. */
+void session_log_unmount(void);
+
+/** Append one message record. */
+esp_err_t session_log_append(const char *chat_id, const char *role,
+                             const char *content, uint32_t ts);
+
+/**
+ * Visit the last max_msgs records of a chat, oldest first.
+ * @return number of records visited
+ */
+int session_log_history(const char *chat_id, int max_msgs,
+                        session_log_visit_t visit, void *ctx);
+
+/** Forget a chat's history (appends a clear marker). */
+esp_err_t session_log_clear(const char *chat_id);
+
+/** Call fn for every chat that still has records in the log. */
+void session_log_list(void (*fn)(const char *chat_id, int records, void *ctx), void *ctx);
@@ -1,4 +1,5 @@
 #include "session_mgr.h"
+#include "session_log.h"
 #include "mimi_config.h"
 
 #include <stdio.h>
@@ -6,7 +7,11 @@
 #include <stdlib.h>
 #include <dirent.h>
 #include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 
 static const char *TAG = "session";
@@ -16,23 +21,269 @@ static void session_path(const char *chat_id, char *buf, size_t size)
     snprintf(buf, size, "%s/tg_%s.jsonl", MIMI_SPIFFS_SESSION_DIR, chat_id);
 }
 
+/* Older records moved out by rotation */
+static void archive_path(const char *chat_id, char *buf, size_t size)
+{
+    snprintf(buf, size, "%s/tg_%s.old", MIMI_SPIFFS_SESSION_DIR, chat_id);
+}
+
+/* ── History cache ────────────────────────────────────────────── */
+
+/*
+ * The last MIMI_SESSION_MAX_MSGS messages of recently active chats are kept
+ * as rings in PSRAM. A chat's file is scanned once, on its first use (or
+ * after eviction); session_append() writes through to flash and pushes onto
+ * the ring, so later turns never touch the file.
+ */
+typedef struct {
+    char  role[12];
+    char *content;                  /* PSRAM */
+} cached_msg_t;
+
+typedef struct {
+    char         chat_id[32];
+    cached_msg_t msgs[MIMI_SESSION_MAX_MSGS];   /* ring, oldest at head */
+    int          head;
+    int          count;
+    uint32_t     last_used;         /* LRU stamp */
+    bool         used;
+} session_cache_t;
+
+static session_cache_t s_cache[MIMI_SESSION_CACHE_CHATS];
+static uint32_t s_use_clock;
+static SemaphoreHandle_t s_lock;
+static bool s_use_log;              /* records live in the flash log, not SPIFFS */
+
+static char *psram_strdup(const char *s)
+{
+    size_t len = strlen(s);
+    char *copy = heap_caps_malloc(len + 1, MALLOC_CAP_SPIRAM);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+static void cache_reset(session_cache_t *c)
+{
+    for (int i = 0; i < MIMI_SESSION_MAX_MSGS; i++) {
+        free(c->msgs[i].content);
+    }
+    memset(c, 0, sizeof(*c));
+}
+
+static void cache_push(session_cache_t *c, const char *role, const char *content)
+{
+    char *copy = psram_strdup(content);
+    if (!copy) {
+        ESP_LOGW(TAG, "Out of PSRAM caching history for %s", c->chat_id);
+        return;
+    }
+
+    if (c->count == MIMI_SESSION_MAX_MSGS) {
+        free(c->msgs[c->head].content);
+        c->msgs[c->head].content = NULL;
+        c->head = (c->head + 1) % MIMI_SESSION_MAX_MSGS;
+        c->count--;
+    }
+    cached_msg_t *m = &c->msgs[(c->head + c->count) % MIMI_SESSION_MAX_MSGS];
+    strncpy(m->role, role, sizeof(m->role) - 1);
+    m->role[sizeof(m->role) - 1] = '\0';
+    m->content = copy;
+    c->count++;
+}
+
+static session_cache_t *cache_find(const char *chat_id)
+{
+    for (int i = 0; i < MIMI_SESSION_CACHE_CHATS; i++) {
+        if (s_cache[i].used && strcmp(s_cache[i].chat_id, chat_id) == 0) {
+            s_cache[i].last_used = ++s_use_clock;
+            return &s_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/* ── Tail reader ──────────────────────────────────────────────── */
+
+#define TAIL_BLOCK  1024
+
+/*
+ * Offset of the first of the last n records. Blocks are read backwards from
+ * the end counting newlines, so the cost depends on n and the record size,
+ * not on how long the file has grown.
+ */
+static long tail_offset(FILE *f, int n)
+{
+    if (fseek(f, 0, SEEK_END) != 0) return 0;
+    long end = ftell(f);
+    if (end <= 0) return 0;
+
+    char block[TAIL_BLOCK];
+    long pos = end;
+    int newlines = 0;
+    while (pos > 0) {
+        long len = pos < TAIL_BLOCK ? pos : TAIL_BLOCK;
+        pos -= len;
+        if (fseek(f, pos, SEEK_SET) != 0 || fread(block, 1, len, f) != (size_t)len) {
+            return 0;
+        }
+        for (long i = len - 1; i >= 0; i--) {
+            if (block[i] != '\n' || pos + i == end - 1) continue;  /* skip final newline */
+            if (++newlines == n) return pos + i + 1;
+        }
+    }
+    return 0;
+}
+
+/* Push the last MIMI_SESSION_MAX_MSGS records of a session file onto c */
+static void read_tail(FILE *f, session_cache_t *c)
+{
+    fseek(f, tail_offset(f, MIMI_SESSION_MAX_MSGS), SEEK_SET);
+
+    char line[2048];
+    while (fgets(line, sizeof(line), f)) {
+        cJSON *obj = cJSON_Parse(line);
+        if (!obj) continue;
+        const char *role = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "role"));
+        const char *content = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "content"));
+        if (role && content) cache_push(c, role, content);
+        cJSON_Delete(obj);
+    }
+}
+
+static void log_visit(const char *role, const char *content, void *ctx)
+{
+    cache_push(ctx, role, content);
+}
+
+/* Fill a free (or the least recently used) slot from the session store */
+static session_cache_t *cache_load(const char *chat_id)
+{
+    session_cache_t *c = &s_cache[0];
+    for (int i = 0; i < MIMI_SESSION_CACHE_CHATS; i++) {
+        if (!s_cache[i].used) {
+            c = &s_cache[i];
+            break;
+        }
+        if (s_cache[i].last_used < c->last_used) c = &s_cache[i];
+    }
+    if (c->used) ESP_LOGI(TAG, "Evicting cached session %s", c->chat_id);
+
+    cache_reset(c);
+    strncpy(c->chat_id, chat_id, sizeof(c->chat_id) - 1);
+    c->used = true;
+    c->last_used = ++s_use_clock;
+
+    if (s_use_log) {
+        session_log_history(chat_id, MIMI_SESSION_MAX_MSGS, log_visit, c);
+        return c;
+    }
+
+    char path[64];
+    session_path(chat_id, path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) return c;   /* No history yet */
+    read_tail(f, c);
+    fclose(f);
+
+    ESP_LOGI(TAG, "Session %s loaded into cache (%d messages)", chat_id, c->count);
+    return c;
+}
+
+/* ── Rotation ─────────────────────────────────────────────────── */
+
+/*
+ * Once a session file passes MIMI_SESSION_ROTATE_BYTES, the whole file
+ * becomes the archive (replacing the previous one) and a fresh file starts
+ * with just the records history still needs. The tail is written to a
+ * temporary file first, so a power cut never leaves the chat without one.
+ */
+static void session_rotate(const char *chat_id, const char *path)
+{
+    char tmp[64], archive[64];
+    snprintf(tmp, sizeof(tmp), "%s/tg_%s.tmp", MIMI_SPIFFS_SESSION_DIR, chat_id);
+    archive_path(chat_id, archive, sizeof(archive));
+
+    FILE *in = fopen(path, "r");
+    if (!in) return;
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        fclose(in);
+        ESP_LOGE(TAG, "Cannot create %s", tmp);
+        return;
+    }
+
+    fseek(in, tail_offset(in, MIMI_SESSION_MAX_MSGS), SEEK_SET);
+    char block[TAIL_BLOCK];
+    size_t n;
+    bool ok = true;
+    while ((n = fread(block, 1, sizeof(block), in)) > 0) {
+        if (fwrite(block, 1, n, out) != n) {
+            ok = false;
+            break;
+        }
+    }
+    fclose(in);
+    fclose(out);
+
+    if (!ok) {
+        ESP_LOGE(TAG, "Session rotation failed for %s, keeping file", chat_id);
+        remove(tmp);
+        return;
+    }
+
+    remove(archive);
+    if (rename(path, archive) != 0) {
+        ESP_LOGE(TAG, "Session rotation rename failed for %s, keeping file", chat_id);
+        remove(tmp);
+        return;
+    }
+    if (rename(tmp, path) != 0) {
+        /* Put the full file back rather than leave the chat without one */
+        ESP_LOGE(TAG, "Session rotation rename failed for %s, keeping file", chat_id);
+        if (rename(archive, path) != 0) {
+            ESP_LOGE(TAG, "Cannot restore %s, history is in %s", path, archive);
+        }
+        remove(tmp);
+        return;
+    }
+    ESP_LOGI(TAG, "Session %s rotated into %s", chat_id, archive);
+}
+
+/* ── Public API ───────────────────────────────────────────────── */
+
 esp_err_t session_mgr_init(void)
 {
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+
+#if MIMI_SESSION_STORE_LOG
+    esp_err_t err = session_log_mount(MIMI_SESSION_LOG_PARTITION);
+    if (err == ESP_OK) {
+        s_use_log = true;
+        ESP_LOGI(TAG, "Session manager initialized on partition %s", MIMI_SESSION_LOG_PARTITION);
+        return ESP_OK;
+    }
+    ESP_LOGW(TAG, "Session log unavailable (%s), using SPIFFS files", esp_err_to_name(err));
+#endif
+
     ESP_LOGI(TAG, "Session manager initialized at %s", MIMI_SPIFFS_SESSION_DIR);
     return ESP_OK;
 }
 
 esp_err_t session_append(const char *chat_id, const char *role, const char *content)
 {
+    if (s_use_log) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        esp_err_t err = session_log_append(chat_id, role, content, (uint32_t)time(NULL));
+        session_cache_t *c = err == ESP_OK ? cache_find(chat_id) : NULL;
+        if (c) cache_push(c, role, content);
+        xSemaphoreGive(s_lock);
+        return err;
+    }
+
     char path[64];
     session_path(chat_id, path, sizeof(path));
 
-    FILE *f = fopen(path, "a");
-    if (!f) {
-        ESP_LOGE(TAG, "Cannot open session file %s", path);
-        return ESP_FAIL;
-    }
-
     cJSON *obj = cJSON_CreateObject();
     cJSON_AddStringToObject(obj, "role", role);
     cJSON_AddStringToObject(obj, "content", content);
@@ -41,75 +292,56 @@ esp_err_t session_append(const char *chat_id, const char *role, const char *cont
     char *line = cJSON_PrintUnformatted(obj);
     cJSON_Delete(obj);
 
-    if (line) {
-        fprintf(f, "%s\n", line);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    FILE *f = fopen(path, "a");
+    if (!f) {
+        xSemaphoreGive(s_lock);
         free(line);
+        ESP_LOGE(TAG, "Cannot open session file %s", path);
+        return ESP_FAIL;
     }
-
+    if (line) fprintf(f, "%s\n", line);
+    long size = ftell(f);
     fclose(f);
-    return ESP_OK;
-}
 
-esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size, int max_msgs)
-{
-    char path[64];
-    session_path(chat_id, path, sizeof(path));
-
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        /* No history yet */
-        snprintf(buf, size, "[]");
-        return ESP_OK;
-    }
+    if (size > MIMI_SESSION_ROTATE_BYTES) session_rotate(chat_id, path);
 
-    /* Read all lines into a ring buffer of cJSON objects */
-    cJSON *messages[MIMI_SESSION_MAX_MSGS];
-    int count = 0;
-    int write_idx = 0;
+    /* Write-through: an uncached chat picks this up when it is loaded */
+    session_cache_t *c = cache_find(chat_id);
+    if (c) cache_push(c, role, content);
 
-    char line[2048];
-    while (fgets(line, sizeof(line), f)) {
-        /* Strip newline */
-        size_t len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
-        if (line[0] == '\0') continue;
+    xSemaphoreGive(s_lock);
+    free(line);
+    return ESP_OK;
+}
 
-        cJSON *obj = cJSON_Parse(line);
-        if (!obj) continue;
+esp_err_t session_get_history(const char *chat_id, cJSON *messages, int max_msgs)
+{
+    if (!messages) return ESP_ERR_INVALID_ARG;
 
-        /* Ring buffer: overwrite oldest if full */
-        if (count >= max_msgs) {
-            cJSON_Delete(messages[write_idx]);
-        }
-        messages[write_idx] = obj;
-        write_idx = (write_idx + 1) % max_msgs;
-        if (count < max_msgs) count++;
-    }
-    fclose(f);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
 
-    /* Build JSON array with only role + content */
-    cJSON *arr = cJSON_CreateArray();
-    int start = (count < max_msgs) ? 0 : write_idx;
-    for (int i = 0; i < count; i++) {
-        int idx = (start + i) % max_msgs;
-        cJSON *src = messages[idx];
+    session_cache_t *c = cache_find(chat_id);
+    if (!c) c = cache_load(chat_id);
 
+    int n = c->count < max_msgs ? c->count : max_msgs;
+    for (int i = c->count - n; i < c->count; i++) {
+        const cached_msg_t *m = &c->msgs[(c->head + i) % MIMI_SESSION_MAX_MSGS];
         cJSON *entry = cJSON_CreateObject();
-        cJSON *role = cJSON_GetObjectItem(src, "role");
-        cJSON *content = cJSON_GetObjectItem(src, "content");
-        if (role && content) {
-            cJSON_AddStringToObject(entry, "role", role->valuestring);
-            cJSON_AddStringToObject(entry, "content", content->valuestring);
-        }
-        cJSON_AddItemToArray(arr, entry);
+        cJSON_AddStringToObject(entry, "role", m->role);
+        cJSON_AddStringToObject(entry, "content", m->content);
+        cJSON_AddItemToArray(messages, entry);
     }
 
-    /* Cleanup ring buffer */
-    int cleanup_start = (count < max_msgs) ? 0 : write_idx;
-    for (int i = 0; i < count; i++) {
-        int idx = (cleanup_start + i) % max_msgs;
-        cJSON_Delete(messages[idx]);
-    }
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size, int max_msgs)
+{
+    cJSON *arr = cJSON_CreateArray();
+    session_get_history(chat_id, arr, max_msgs);
 
     char *json_str = cJSON_PrintUnformatted(arr);
     cJSON_Delete(arr);
@@ -130,15 +362,43 @@ esp_err_t session_clear(const char *chat_id)
     char path[64];
     session_path(chat_id, path, sizeof(path));
 
-    if (remove(path) == 0) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    session_cache_t *c = cache_find(chat_id);
+    if (c) cache_reset(c);
+    int ret;
+    if (s_use_log) {
+        ret = session_log_clear(chat_id) == ESP_OK ? 0 : -1;
+    } else {
+        ret = remove(path);
+        archive_path(chat_id, path, sizeof(path));
+        remove(path);
+    }
+    xSemaphoreGive(s_lock);
+
+    if (ret == 0) {
         ESP_LOGI(TAG, "Session %s cleared", chat_id);
         return ESP_OK;
     }
     return ESP_ERR_NOT_FOUND;
 }
 
+static void log_list_one(const char *chat_id, int records, void *ctx)
+{
+    ESP_LOGI(TAG, "  Session: %s (%d recent records)", chat_id, records);
+    (*(int *)ctx)++;
+}
+
 void session_list(void)
 {
+    if (s_use_log) {
+        int count = 0;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        session_log_list(log_list_one, &count);
+        xSemaphoreGive(s_lock);
+        if (count == 0) ESP_LOGI(TAG, "  No sessions found");
+        return;
+    }
+
     DIR *dir = opendir(MIMI_SPIFFS_SESSION_DIR);
     if (!dir) {
         /* SPIFFS is flat, so list all files matching pattern */
@@ -163,3 +423,50 @@ void session_list(void)
         ESP_LOGI(TAG, "  No sessions found");
     }
 }
+
+/* ── Benchmark ────────────────────────────────────────────────── */
+
+void session_bench(int max_records)
+{
+    char path[64];
+    session_path("bench", path, sizeof(path));
+    remove(path);
+
+    session_cache_t *c = calloc(1, sizeof(*c));
+    if (!c) return;
+    strcpy(c->chat_id, "bench");
+
+    printf("%10s %10s %10s\n", "records", "bytes", "load_us");
+    int written = 0;
+    for (int target = 100; target <= max_records; target *= 10) {
+        /* Grow the file to the next checkpoint (rotation bypassed) */
+        FILE *f = fopen(path, "a");
+        if (!f) {
+            printf("Cannot write %s\n", path);
+            break;
+        }
+        for (; written < target; written++) {
+            fprintf(f, "{\"role\":\"%s\",\"content\":\"benchmark message %d\",\"ts\":%d}\n",
+                    (written & 1) ? "assistant" : "user", written, written);
+        }
+        long bytes = ftell(f);
+        fclose(f);
+
+        /* Same path a cache miss takes */
+        int64_t start = esp_timer_get_time();
+        f = fopen(path, "r");
+        if (f) {
+            read_tail(f, c);
+            fclose(f);
+        }
+        int64_t elapsed = esp_timer_get_time() - start;
+
+        printf("%10d %10ld %10lld%s\n", written, bytes, (long long)elapsed,
+               c->count == MIMI_SESSION_MAX_MSGS ? "" : "  (short read)");
+        cache_reset(c);
+        strcpy(c->chat_id, "bench");
+    }
+
+    free(c);
+    remove(path);
+}
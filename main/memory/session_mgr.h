@@ -2,6 +2,7 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include "cJSON.h"
 
 /**
  * Initialize session manager.
@@ -16,6 +17,18 @@ esp_err_t session_mgr_init(void);
  */
 esp_err_t session_append(const char *chat_id, const char *role, const char *content);
 
+/**
+ * Append the last max_msgs messages of a session to a messages array as
+ * {"role","content"} objects. Served from the in-PSRAM history cache; the
+ * session file is only read the first time a chat is seen (or after it
+ * was evicted).
+ *
+ * @param chat_id   Session identifier
+ * @param messages  cJSON array to append to (caller owns)
+ * @param max_msgs  Maximum number of messages (at most MIMI_SESSION_MAX_MSGS)
+ */
+esp_err_t session_get_history(const char *chat_id, cJSON *messages, int max_msgs);
+
 /**
  * Load session history as a JSON array string suitable for LLM messages.
  * Returns the last max_msgs messages as:
@@ -37,3 +50,10 @@ esp_err_t session_clear(const char *chat_id);
  * List all session files (prints to log).
  */
 void session_list(void);
+
+/**
+ * Time loading the last MIMI_SESSION_MAX_MSGS records from a scratch
+ * session file as it grows from 100 records in steps of 10x up to
+ * max_records. Prints a table to stdout and deletes the file afterwards.
+ */
+void session_bench(int max_records);
@@ -11,16 +11,20 @@
 
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "bus/channel_dispatch.h"
 #include "wifi/wifi_manager.h"
 #include "telegram/telegram_bot.h"
 #include "llm/llm_proxy.h"
 #include "agent/agent_loop.h"
+#include "agent/context_builder.h"
+#include "clock/clock_service.h"
 #include "memory/memory_store.h"
 #include "memory/session_mgr.h"
 #include "gateway/ws_server.h"
 #include "cli/serial_cli.h"
 #include "proxy/http_proxy.h"
 #include "tools/tool_registry.h"
+#include "tools/tool_executor.h"
 #include "display/display_manager.h"
 
 static const char *TAG = "mimi";
@@ -58,28 +62,6 @@ static esp_err_t init_spiffs(void)
     return ESP_OK;
 }
 
-static void outbound_dispatch_task(void *arg)
-{
-    ESP_LOGI(TAG, "Outbound dispatch started");
-
-    while (1) {
-        mimi_msg_t msg;
-        if (message_bus_pop_outbound(&msg, UINT32_MAX) != ESP_OK) continue;
-
-        ESP_LOGI(TAG, "Dispatching response to %s:%s", msg.channel, msg.chat_id);
-
-        if (strcmp(msg.channel, MIMI_CHAN_TELEGRAM) == 0) {
-            telegram_send_message(msg.chat_id, msg.content);
-        } else if (strcmp(msg.channel, MIMI_CHAN_WEBSOCKET) == 0) {
-            ws_server_send(msg.chat_id, msg.content);
-        } else {
-            ESP_LOGW(TAG, "Unknown channel: %s", msg.channel);
-        }
-
-        free(msg.content);
-    }
-}
-
 void app_main(void)
 {
     esp_log_level_set("esp-x509-crt-bundle", ESP_LOG_WARN);
@@ -99,13 +81,17 @@ void app_main(void)
 
     /* Initialize subsystems */
     ESP_ERROR_CHECK(message_bus_init());
+    ESP_ERROR_CHECK(channel_dispatch_init());
     ESP_ERROR_CHECK(memory_store_init());
+    ESP_ERROR_CHECK(context_builder_init());
     ESP_ERROR_CHECK(session_mgr_init());
     ESP_ERROR_CHECK(wifi_manager_init());
+    ESP_ERROR_CHECK(clock_service_init());
     ESP_ERROR_CHECK(http_proxy_init());
     ESP_ERROR_CHECK(telegram_bot_init());
     ESP_ERROR_CHECK(llm_proxy_init());
     ESP_ERROR_CHECK(tool_registry_init());
+    ESP_ERROR_CHECK(tool_executor_init());
     ESP_ERROR_CHECK(agent_loop_init());
 
     /* Start Serial CLI first (works without WiFi) */
@@ -119,18 +105,29 @@ void app_main(void)
             ESP_LOGI(TAG, "WiFi connected: %s", wifi_manager_get_ip());
             display_manager_update(true, false, "WiFi Connected");
 
+            /* Outbound dispatch: one task per channel */
+            static const channel_ops_t tg_ops = {
+                .send = telegram_send_message,
+                .status = telegram_send_typing,
+                .status_refresh_ms = MIMI_TG_TYPING_REFRESH_MS,
+                .draft = telegram_send_draft,
+                .stack = MIMI_OUTBOUND_STACK,
+            };
+            static const channel_ops_t ws_ops = {
+                .send = ws_server_send,
+                .status = ws_server_send_status,
+                .event = ws_server_send_event,
+                .stack = MIMI_OUTBOUND_WS_STACK,
+            };
+            ESP_ERROR_CHECK(channel_dispatch_register(MIMI_CHAN_TELEGRAM, &tg_ops));
+            ESP_ERROR_CHECK(channel_dispatch_register(MIMI_CHAN_WEBSOCKET, &ws_ops));
+
             /* Start network-dependent services */
+            ESP_ERROR_CHECK(ws_server_start());
             ESP_ERROR_CHECK(telegram_bot_start());
             ESP_ERROR_CHECK(agent_loop_start());
-            ESP_ERROR_CHECK(ws_server_start());
             display_manager_update(true, true, "System Ready");
 
-            /* Outbound dispatch task */
-            xTaskCreatePinnedToCore(
-                outbound_dispatch_task, "outbound",
-                MIMI_OUTBOUND_STACK, NULL,
-                MIMI_OUTBOUND_PRIO, NULL, MIMI_OUTBOUND_CORE);
-
             ESP_LOGI(TAG, "All services started!");
         } else {
             display_manager_update(false, false, "WiFi Timeout");
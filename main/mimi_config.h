@@ -16,6 +16,12 @@
 #ifndef MIMI_SECRET_TG_TOKEN
 #define MIMI_SECRET_TG_TOKEN        ""
 #endif
+#ifndef MIMI_SECRET_TG_WEBHOOK_URL
+#define MIMI_SECRET_TG_WEBHOOK_URL  ""
+#endif
+#ifndef MIMI_SECRET_TG_WEBHOOK_SECRET
+#define MIMI_SECRET_TG_WEBHOOK_SECRET ""
+#endif
 #ifndef MIMI_SECRET_API_KEY
 #define MIMI_SECRET_API_KEY         ""
 #endif
@@ -42,7 +48,16 @@
 
 /* Telegram Bot */
 #define MIMI_TG_POLL_TIMEOUT_S       30
-#define MIMI_TG_MAX_MSG_LEN          4096
+#define MIMI_TG_CONN_IDLE_MS         (50 * 1000)    /* per connection (poll, send) */
+#define MIMI_TG_SEND_TIMEOUT_MS      (15 * 1000)
+#define MIMI_TG_BACKOFF_MIN_MS       1000           /* poll retry after a failure, doubling */
+#define MIMI_TG_BACKOFF_MAX_MS       (60 * 1000)
+#define MIMI_TG_WEBHOOK_PATH         "/telegram"    /* on the WebSocket server's port */
+#define MIMI_TG_WEBHOOK_MAX_BODY     (16 * 1024)
+#define MIMI_TG_EDIT_MIN_MS          1000           /* progressive reply: fastest edit rate per chat */
+#define MIMI_TG_EDIT_MAX_MS          5000           /* slowest, unless Telegram asks for more */
+#define MIMI_TG_ROLLOVER_LEN         3072           /* Markdown bytes per progressive message */
+#define MIMI_TG_MAX_MSG_LEN          4096           /* bytes of HTML per sendMessage */
 #define MIMI_TG_POLL_STACK           (12 * 1024)
 #define MIMI_TG_POLL_PRIO            5
 #define MIMI_TG_POLL_CORE            0
@@ -51,42 +66,99 @@
 #define MIMI_AGENT_STACK             (12 * 1024)
 #define MIMI_AGENT_PRIO              6
 #define MIMI_AGENT_CORE              1
+#define MIMI_AGENT_WORKERS           3              /* chats processed in parallel */
+#define MIMI_AGENT_INTERACTIVE_RESERVE 1            /* workers kept free for WS / CLI */
+#define MIMI_AGENT_PENDING           16             /* messages waiting for a worker */
+#define MIMI_AGENT_PSRAM_RESERVE     (512 * 1024)   /* free PSRAM left when starting workers */
+#define MIMI_AGENT_SCHED_STACK       (3 * 1024)
 #define MIMI_AGENT_MAX_HISTORY       20
 #define MIMI_AGENT_MAX_TOOL_ITER     10
 #define MIMI_MAX_TOOL_CALLS          4
+#define MIMI_TOOL_WORKERS            2              /* tasks running tool calls concurrently */
+#define MIMI_TOOL_STACK              (10 * 1024)
+#define MIMI_TOOL_PRIO               6
+#define MIMI_TOOL_CORE               1
 
 /* Timezone (POSIX TZ format) */
 #define MIMI_TIMEZONE                "PST8PDT,M3.2.0,M11.1.0"
 
+/* Clock */
+#define MIMI_CLOCK_SNTP              1              /* sync via SNTP too, not only HTTP Date headers */
+#define MIMI_CLOCK_SNTP_SERVER       "pool.ntp.org"
+#define MIMI_CLOCK_RESYNC_S          (60 * 60)      /* take a Date header again after this */
+
 /* LLM */
 #define MIMI_LLM_DEFAULT_MODEL       "claude-opus-4-5"
 #define MIMI_LLM_PROVIDER_DEFAULT    "anthropic"
 #define MIMI_LLM_MAX_TOKENS          4096
+/* API URLs can be overridden in mimi_secrets.h, e.g. to point the direct
+ * path at a local stand-in server: "http://192.168.1.10:8080/v1/messages" */
+#ifndef MIMI_LLM_API_URL
 #define MIMI_LLM_API_URL             "https://api.anthropic.com/v1/messages"
+#endif
+#ifndef MIMI_OPENAI_API_URL
 #define MIMI_OPENAI_API_URL          "https://api.openai.com/v1/chat/completions"
+#endif
 #define MIMI_LLM_API_VERSION         "2023-06-01"
 #define MIMI_LLM_STREAM_BUF_SIZE     (32 * 1024)
+#define MIMI_LLM_TIMEOUT_MS          (120 * 1000)
+#define MIMI_LLM_CONN_IDLE_MS        (45 * 1000)   /* drop kept-alive connection after this */
+#define MIMI_TLS_CONN_PSRAM          (60 * 1024)   /* one open TLS connection: records + client buffers */
+#define MIMI_LLM_PROMPT_CACHE        1             /* Anthropic cache_control breakpoints */
+
+/* Proxy tunnels */
+#define MIMI_PROXY_POOL_SIZE         4              /* idle CONNECT tunnels kept for reuse */
+#define MIMI_PROXY_IDLE_MS           (55 * 1000)
+
+/* Web Search */
+#define MIMI_SEARCH_CACHE_SLOTS      64             /* cached queries, PSRAM hash table */
+#define MIMI_SEARCH_CACHE_TTL_S      (30 * 60)
+#define MIMI_SEARCH_CACHE_PERSIST    1              /* spill results to SPIFFS, reload on boot */
+#define MIMI_SEARCH_CACHE_FILE       "/spiffs/cache/search.jsonl"
+#define MIMI_SEARCH_CACHE_FILE_MAX   (128 * 1024)   /* compact the spill file past this */
 
 /* Message Bus */
-#define MIMI_BUS_QUEUE_LEN           8
-#define MIMI_OUTBOUND_STACK          (8 * 1024)
+#define MIMI_BUS_QUEUE_LEN           16
+#define MIMI_BUS_PUSH_TIMEOUT_MS     1000           /* full queue: drop after this */
+#define MIMI_BUS_MAX_SUBS            4              /* outbound subscriptions */
+#define MIMI_BUS_SLAB_SMALL          32             /* pooled 256 B payloads (PSRAM) */
+#define MIMI_BUS_SLAB_MEDIUM         16             /* 1 KB */
+#define MIMI_BUS_SLAB_LARGE          8              /* 4 KB */
+#define MIMI_BUS_SLAB_HUGE           4              /* 16 KB; larger payloads use the heap */
+#define MIMI_OUTBOUND_STACK          (8 * 1024)     /* Telegram dispatch (TLS) */
+#define MIMI_OUTBOUND_WS_STACK       (4 * 1024)     /* WebSocket dispatch */
 #define MIMI_OUTBOUND_PRIO           5
 #define MIMI_OUTBOUND_CORE           0
+#define MIMI_STATUS_SLOTS            8              /* chats with a live status, per channel */
+#define MIMI_STATUS_MIN_INTERVAL_MS  1000           /* coalesce status changes to this rate */
+#define MIMI_SEND_RETRY_DEADLINE_MS  30000          /* stop resending a rate-limited reply after this */
+#define MIMI_SEND_HELD_MAX           4              /* replies per chat waiting behind a rate-limited one */
+#define MIMI_DRAFT_SNAPSHOT_MS       250            /* agent copies the partial reply at most this often */
+#define MIMI_TG_TYPING_REFRESH_MS    4500           /* Telegram drops "typing" after ~5 s */
 
 /* Memory / SPIFFS */
 #define MIMI_SPIFFS_BASE             "/spiffs"
 #define MIMI_SPIFFS_CONFIG_DIR       "/spiffs/config"
 #define MIMI_SPIFFS_MEMORY_DIR       "/spiffs/memory"
+#ifndef MIMI_SPIFFS_SESSION_DIR                    /* host builds point this at a local dir */
 #define MIMI_SPIFFS_SESSION_DIR      "/spiffs/sessions"
+#endif
 #define MIMI_MEMORY_FILE             "/spiffs/memory/MEMORY.md"
 #define MIMI_SOUL_FILE               "/spiffs/config/SOUL.md"
 #define MIMI_USER_FILE               "/spiffs/config/USER.md"
 #define MIMI_CONTEXT_BUF_SIZE        (16 * 1024)
 #define MIMI_SESSION_MAX_MSGS        20
+#define MIMI_SESSION_CACHE_CHATS     8              /* chats whose history stays in PSRAM */
+#define MIMI_SESSION_ROTATE_BYTES    (64 * 1024)    /* archive older records past this size */
+#define MIMI_SESSION_STORE_LOG       0              /* 1: sessions in a raw flash log (see ARCHITECTURE.md) */
+#define MIMI_SESSION_LOG_PARTITION   "sessions"
+#define MIMI_SESSION_LOG_BLOCK       (16 * 1024)    /* erase-aligned; records never span blocks */
 
 /* WebSocket Gateway */
 #define MIMI_WS_PORT                 18789
 #define MIMI_WS_MAX_CLIENTS          4
+#define MIMI_WS_CLIENT_QUEUE         32             /* frames waiting per client; events beyond are dropped */
+#define MIMI_WS_REPLY_WAIT_MS        2000           /* dispatch task waits this long for queue room */
 
 /* Serial CLI */
 #define MIMI_CLI_STACK               (4 * 1024)
@@ -12,6 +12,8 @@
 #include "nvs.h"
 #include "esp_tls.h"
 #include "esp_crt_bundle.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 static const char *TAG = "proxy";
 
@@ -24,8 +26,13 @@ __attribute__((constructor)) static void proxy_log_level(void)
 static char     s_proxy_host[64] = {0};
 static uint16_t s_proxy_port     = 0;
 
+static void pool_flush(void);
+static SemaphoreHandle_t s_pool_lock;
+
 esp_err_t http_proxy_init(void)
 {
+    s_pool_lock = xSemaphoreCreateMutex();
+
     /* Start with build-time defaults */
     if (MIMI_SECRET_PROXY_HOST[0] != '\0' && MIMI_SECRET_PROXY_PORT[0] != '\0') {
         strncpy(s_proxy_host, MIMI_SECRET_PROXY_HOST, sizeof(s_proxy_host) - 1);
@@ -64,6 +71,7 @@ esp_err_t http_proxy_set(const char *host, uint16_t port)
     ESP_ERROR_CHECK(nvs_commit(nvs));
     nvs_close(nvs);
 
+    pool_flush();
     strncpy(s_proxy_host, host, sizeof(s_proxy_host) - 1);
     s_proxy_port = port;
     ESP_LOGI(TAG, "Proxy set to %s:%d", s_proxy_host, s_proxy_port);
@@ -79,6 +87,7 @@ esp_err_t http_proxy_clear(void)
     nvs_commit(nvs);
     nvs_close(nvs);
 
+    pool_flush();
     s_proxy_host[0] = '\0';
     s_proxy_port = 0;
     ESP_LOGI(TAG, "Proxy cleared");
@@ -95,24 +104,34 @@ bool http_proxy_is_enabled(void)
 struct proxy_conn {
     int         sock;   /* raw TCP socket (for timeout control) */
     esp_tls_t  *tls;    /* esp_tls handle owns TLS + socket lifecycle */
+    char        host[64];
+    int         port;
+    bool        reused;     /* taken from the pool */
+    TickType_t  idle_since;
 };
 
-/* Read a line from socket (up to CR-LF). Returns length or -1. */
-static int sock_read_line(int fd, char *buf, int max, int timeout_ms)
+/* Read the proxy's reply to CONNECT (status line + headers) into buf.
+ * Nothing follows it until we start the TLS handshake, so reading in
+ * blocks cannot swallow tunnel data. Returns the head length or -1. */
+static int sock_read_head(int fd, char *buf, int max, int timeout_ms)
 {
-    int pos = 0;
+    int len = 0;
     struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
     setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 
-    while (pos < max - 1) {
-        char c;
-        int r = recv(fd, &c, 1, 0);
+    while (len < max - 1) {
+        int r = recv(fd, buf + len, max - 1 - len, 0);
         if (r <= 0) return -1;
-        if (c == '\n') { buf[pos] = '\0'; return pos; }
-        if (c != '\r') buf[pos++] = c;
+        int scan_from = len > 3 ? len - 3 : 0;
+        len += r;
+        buf[len] = '\0';
+        char *end = strstr(buf + scan_from, "\r\n\r\n");
+        if (end) {
+            end[2] = '\0';
+            return end - buf;
+        }
     }
-    buf[pos] = '\0';
-    return pos;
+    return -1;
 }
 
 /* Open TCP + CONNECT tunnel, returns socket fd or -1 */
@@ -150,21 +169,102 @@ static int open_connect_tunnel(const char *host, int port, int timeout_ms)
         ESP_LOGE(TAG, "Failed to send CONNECT"); close(sock); return -1;
     }
 
-    char line[256];
-    if (sock_read_line(sock, line, sizeof(line), timeout_ms) < 0) {
+    char head[512];
+    if (sock_read_head(sock, head, sizeof(head), timeout_ms) < 0) {
         ESP_LOGE(TAG, "No response from proxy"); close(sock); return -1;
     }
-    if (strstr(line, "200") == NULL) {
-        ESP_LOGE(TAG, "CONNECT rejected: %s", line); close(sock); return -1;
+    char *eol = strstr(head, "\r\n");
+    if (eol) *eol = '\0';
+    const char *sp = strchr(head, ' ');
+    if (!sp || atoi(sp + 1) != 200) {
+        ESP_LOGE(TAG, "CONNECT rejected: %s", head); close(sock); return -1;
     }
 
-    /* Consume remaining response headers */
-    while (sock_read_line(sock, line, sizeof(line), timeout_ms) > 0) { }
-
     ESP_LOGI(TAG, "CONNECT tunnel established to %s:%d", host, port);
     return sock;
 }
 
+/* ── Tunnel pool ──────────────────────────────────────────────── */
+
+static proxy_conn_t *s_pool[MIMI_PROXY_POOL_SIZE];
+
+/* An idle tunnel is usable only if nothing has arrived on it since the last
+ * response: EOF means the server closed it, data is most likely a TLS alert. */
+static bool conn_idle_ok(proxy_conn_t *conn)
+{
+    if (esp_tls_get_bytes_avail(conn->tls) > 0) return false;
+    char c;
+    int r = recv(conn->sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static proxy_conn_t *pool_take(const char *host, int port)
+{
+    if (!s_pool_lock) return NULL;
+
+    proxy_conn_t *found = NULL;
+    proxy_conn_t *stale[MIMI_PROXY_POOL_SIZE];
+    int stale_count = 0;
+    TickType_t now = xTaskGetTickCount();
+
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_PROXY_POOL_SIZE; i++) {
+        proxy_conn_t *c = s_pool[i];
+        if (!c) continue;
+        if (now - c->idle_since > pdMS_TO_TICKS(MIMI_PROXY_IDLE_MS) || !conn_idle_ok(c)) {
+            s_pool[i] = NULL;
+            stale[stale_count++] = c;
+            continue;
+        }
+        if (!found && c->port == port && strcmp(c->host, host) == 0) {
+            s_pool[i] = NULL;
+            found = c;
+        }
+    }
+    xSemaphoreGive(s_pool_lock);
+
+    /* TLS teardown outside the lock, like pool_put's eviction */
+    for (int i = 0; i < stale_count; i++) {
+        ESP_LOGI(TAG, "Dropping stale tunnel to %s:%d", stale[i]->host, stale[i]->port);
+        proxy_conn_close(stale[i]);
+    }
+    return found;
+}
+
+static void pool_put(proxy_conn_t *conn)
+{
+    conn->idle_since = xTaskGetTickCount();
+
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    int slot = -1;
+    for (int i = 0; i < MIMI_PROXY_POOL_SIZE; i++) {
+        if (!s_pool[i]) { slot = i; break; }
+        /* Pool full: replace the longest idle tunnel */
+        if (slot < 0 || s_pool[i]->idle_since < s_pool[slot]->idle_since) slot = i;
+    }
+    proxy_conn_t *evicted = s_pool[slot];
+    s_pool[slot] = conn;
+    xSemaphoreGive(s_pool_lock);
+
+    proxy_conn_close(evicted);
+}
+
+static void pool_flush(void)
+{
+    if (!s_pool_lock) return;
+    proxy_conn_t *conns[MIMI_PROXY_POOL_SIZE];
+    xSemaphoreTake(s_pool_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_PROXY_POOL_SIZE; i++) {
+        conns[i] = s_pool[i];
+        s_pool[i] = NULL;
+    }
+    xSemaphoreGive(s_pool_lock);
+
+    for (int i = 0; i < MIMI_PROXY_POOL_SIZE; i++) {
+        proxy_conn_close(conns[i]);
+    }
+}
+
 proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms)
 {
     if (!http_proxy_is_enabled()) {
@@ -172,12 +272,21 @@ proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms)
         return NULL;
     }
 
+    proxy_conn_t *pooled = pool_take(host, port);
+    if (pooled) {
+        ESP_LOGI(TAG, "Reusing tunnel to %s:%d", host, port);
+        pooled->reused = true;
+        return pooled;
+    }
+
     int sock = open_connect_tunnel(host, port, timeout_ms);
     if (sock < 0) return NULL;
 
     proxy_conn_t *conn = calloc(1, sizeof(*conn));
     if (!conn) { close(sock); return NULL; }
     conn->sock = sock;
+    strncpy(conn->host, host, sizeof(conn->host) - 1);
+    conn->port = port;
 
     /* ── TLS handshake via esp_tls over tunnel ───────────────── */
     conn->tls = esp_tls_init();
@@ -248,3 +357,18 @@ void proxy_conn_close(proxy_conn_t *conn)
     }
     free(conn);
 }
+
+void proxy_conn_release(proxy_conn_t *conn, bool keep_alive)
+{
+    if (!conn) return;
+    if (keep_alive && s_pool_lock && http_proxy_is_enabled()) {
+        pool_put(conn);
+    } else {
+        proxy_conn_close(conn);
+    }
+}
+
+bool proxy_conn_reused(const proxy_conn_t *conn)
+{
+    return conn && conn->reused;
+}
@@ -30,6 +30,8 @@ typedef struct proxy_conn proxy_conn_t;
 
 /**
  * Open an HTTPS connection through the configured proxy.
+ * An idle tunnel to the same host:port is taken from the pool if one is
+ * still alive; otherwise a new one is set up:
  * 1) TCP connect to proxy
  * 2) Send HTTP CONNECT to target host:port
  * 3) TLS handshake over the tunnel
@@ -38,6 +40,9 @@ typedef struct proxy_conn proxy_conn_t;
  */
 proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms);
 
+/** True if the connection came from the pool rather than a fresh handshake. */
+bool proxy_conn_reused(const proxy_conn_t *conn);
+
 /** Write raw bytes through the TLS tunnel. Returns bytes written or -1. */
 int proxy_conn_write(proxy_conn_t *conn, const char *data, int len);
 
@@ -46,3 +51,10 @@ int proxy_conn_read(proxy_conn_t *conn, char *buf, int len, int timeout_ms);
 
 /** Close and free the connection. */
 void proxy_conn_close(proxy_conn_t *conn);
+
+/**
+ * Done with the connection. With keep_alive (the last response was read to
+ * its end and the server allows it) the tunnel goes back to the pool;
+ * otherwise it is closed. Use proxy_conn_close() on any error path.
+ */
+void proxy_conn_release(proxy_conn_t *conn, bool keep_alive);
@@ -1,13 +1,18 @@
 #include "telegram_bot.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
-#include "proxy/http_proxy.h"
+#include "http/http_client.h"
+#include "tg_html.h"
+#include "gateway/ws_server.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "esp_log.h"
-#include "esp_http_client.h"
-#include "esp_crt_bundle.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
 #include "nvs.h"
 #include "cJSON.h"
 
@@ -16,155 +21,97 @@ static const char *TAG = "telegram";
 static char s_bot_token[128] = MIMI_SECRET_TG_TOKEN;
 static int64_t s_update_offset = 0;
 
-/* HTTP response accumulator */
-typedef struct {
-    char *buf;
-    size_t len;
-    size_t cap;
-} http_resp_t;
-
-static esp_err_t http_event_handler(esp_http_client_event_t *evt)
-{
-    http_resp_t *resp = (http_resp_t *)evt->user_data;
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
-        if (resp->len + evt->data_len >= resp->cap) {
-            size_t new_cap = resp->cap * 2;
-            if (new_cap < resp->len + evt->data_len + 1) {
-                new_cap = resp->len + evt->data_len + 1;
-            }
-            char *tmp = realloc(resp->buf, new_cap);
-            if (!tmp) return ESP_ERR_NO_MEM;
-            resp->buf = tmp;
-            resp->cap = new_cap;
-        }
-        memcpy(resp->buf + resp->len, evt->data, evt->data_len);
-        resp->len += evt->data_len;
-        resp->buf[resp->len] = '\0';
-    }
-    return ESP_OK;
-}
-
-/* ── Proxy path: manual HTTP over CONNECT tunnel ────────────── */
-
-static char *tg_api_call_via_proxy(const char *path, const char *post_data)
+/*
+ * Two kept-alive connections: the poll task parks one on getUpdates, the
+ * outbound dispatch task sends on the other, so neither waits for (or
+ * falls back to a one-shot handshake because of) the other.
+ */
+static http_session_t *s_poll_session;
+static http_session_t *s_send_session;
+
+static unsigned s_polls;
+static unsigned s_poll_errors;
+static unsigned s_updates;
+static unsigned s_hook_posts;
+static unsigned s_hook_rejected;
+
+/* A webhook without a secret would take updates from anyone who finds the URL */
+static bool webhook_mode(void)
 {
-    proxy_conn_t *conn = proxy_conn_open("api.telegram.org", 443,
-                                          (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000);
-    if (!conn) return NULL;
-
-    /* Build HTTP request */
-    char header[512];
-    int hlen;
-    if (post_data) {
-        hlen = snprintf(header, sizeof(header),
-            "POST /bot%s/%s HTTP/1.1\r\n"
-            "Host: api.telegram.org\r\n"
-            "Content-Type: application/json\r\n"
-            "Content-Length: %d\r\n"
-            "Connection: close\r\n\r\n",
-            s_bot_token, path, (int)strlen(post_data));
-    } else {
-        hlen = snprintf(header, sizeof(header),
-            "GET /bot%s/%s HTTP/1.1\r\n"
-            "Host: api.telegram.org\r\n"
-            "Connection: close\r\n\r\n",
-            s_bot_token, path);
-    }
-
-    if (proxy_conn_write(conn, header, hlen) < 0) {
-        proxy_conn_close(conn);
-        return NULL;
-    }
-    if (post_data && proxy_conn_write(conn, post_data, strlen(post_data)) < 0) {
-        proxy_conn_close(conn);
-        return NULL;
-    }
-
-    /* Read response — accumulate until connection close */
-    size_t cap = 4096, len = 0;
-    char *buf = calloc(1, cap);
-    if (!buf) { proxy_conn_close(conn); return NULL; }
-
-    int timeout = (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000;
-    while (1) {
-        if (len + 1024 >= cap) {
-            cap *= 2;
-            char *tmp = realloc(buf, cap);
-            if (!tmp) break;
-            buf = tmp;
-        }
-        int n = proxy_conn_read(conn, buf + len, cap - len - 1, timeout);
-        if (n <= 0) break;
-        len += n;
-    }
-    buf[len] = '\0';
-    proxy_conn_close(conn);
-
-    /* Skip HTTP headers — find \r\n\r\n */
-    char *body = strstr(buf, "\r\n\r\n");
-    if (!body) { free(buf); return NULL; }
-    body += 4;
-
-    /* Return just the body */
-    char *result = strdup(body);
-    free(buf);
-    return result;
+    return MIMI_SECRET_TG_WEBHOOK_URL[0] != '\0' && MIMI_SECRET_TG_WEBHOOK_SECRET[0] != '\0';
 }
 
-/* ── Direct path: esp_http_client ───────────────────────────── */
-
-static char *tg_api_call_direct(const char *method, const char *post_data)
+/* Returns the response body (caller frees), or NULL on transport failure */
+static char *tg_api_call(http_session_t *session, const char *method, const char *post_data)
 {
     char url[256];
     snprintf(url, sizeof(url), "https://api.telegram.org/bot%s/%s", s_bot_token, method);
 
-    http_resp_t resp = {
-        .buf = calloc(1, 4096),
-        .len = 0,
-        .cap = 4096,
+    static const http_header_t json_hdr[] = {
+        { "Content-Type", "application/json" },
     };
-    if (!resp.buf) return NULL;
-
-    esp_http_client_config_t config = {
+    http_request_t req = {
+        .method = post_data ? "POST" : "GET",
         .url = url,
-        .event_handler = http_event_handler,
-        .user_data = &resp,
-        .timeout_ms = (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000,
-        .buffer_size = 2048,
-        .buffer_size_tx = 2048,
-        .crt_bundle_attach = esp_crt_bundle_attach,
+        .headers = post_data ? json_hdr : NULL,
+        .header_count = post_data ? 1 : 0,
+        .body = post_data,
+        .body_len = post_data ? strlen(post_data) : 0,
+        .timeout_ms = session == s_poll_session ? (MIMI_TG_POLL_TIMEOUT_S + 5) * 1000
+                                                : MIMI_TG_SEND_TIMEOUT_MS,
     };
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) {
-        free(resp.buf);
+    http_response_t resp;
+    esp_err_t err = http_client_perform(session, &req, &resp);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
         return NULL;
     }
+    return resp.body;
+}
 
-    if (post_data) {
-        esp_http_client_set_method(client, HTTP_METHOD_POST);
-        esp_http_client_set_header(client, "Content-Type", "application/json");
-        esp_http_client_set_post_field(client, post_data, strlen(post_data));
+/* One Update object, from getUpdates or pushed to the webhook */
+static void process_update(cJSON *update)
+{
+    /* Track offset */
+    cJSON *update_id = cJSON_GetObjectItem(update, "update_id");
+    if (cJSON_IsNumber(update_id)) {
+        int64_t uid = (int64_t)update_id->valuedouble;
+        if (uid < s_update_offset) {
+            /* Webhook redelivery of an update already handled */
+            ESP_LOGD(TAG, "Skipping duplicate update %" PRId64, uid);
+            return;
+        }
+        s_update_offset = uid + 1;
+        s_updates++;
     }
 
-    esp_err_t err = esp_http_client_perform(client);
-    esp_http_client_cleanup(client);
+    /* Extract message */
+    cJSON *message = cJSON_GetObjectItem(update, "message");
+    if (!message) return;
 
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
-        free(resp.buf);
-        return NULL;
-    }
+    cJSON *text = cJSON_GetObjectItem(message, "text");
+    if (!text || !cJSON_IsString(text)) return;
 
-    return resp.buf;
-}
+    cJSON *chat = cJSON_GetObjectItem(message, "chat");
+    if (!chat) return;
 
-static char *tg_api_call(const char *method, const char *post_data)
-{
-    if (http_proxy_is_enabled()) {
-        return tg_api_call_via_proxy(method, post_data);
+    cJSON *chat_id = cJSON_GetObjectItem(chat, "id");
+    if (!chat_id) return;
+
+    char chat_id_str[32];
+    snprintf(chat_id_str, sizeof(chat_id_str), "%.0f", chat_id->valuedouble);
+
+    ESP_LOGI(TAG, "Message from chat %s: %.40s...", chat_id_str, text->valuestring);
+
+    /* Push to inbound bus */
+    mimi_msg_t msg = {0};
+    strncpy(msg.channel, MIMI_CHAN_TELEGRAM, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, chat_id_str, sizeof(msg.chat_id) - 1);
+    msg.content = message_bus_strdup(text->valuestring);
+    if (msg.content) {
+        message_bus_push_inbound(&msg);
     }
-    return tg_api_call_direct(method, post_data);
 }
 
 static void process_updates(const char *json_str)
@@ -186,49 +133,117 @@ static void process_updates(const char *json_str)
 
     cJSON *update;
     cJSON_ArrayForEach(update, result) {
-        /* Track offset */
-        cJSON *update_id = cJSON_GetObjectItem(update, "update_id");
-        if (cJSON_IsNumber(update_id)) {
-            int64_t uid = (int64_t)update_id->valuedouble;
-            if (uid >= s_update_offset) {
-                s_update_offset = uid + 1;
-            }
-        }
+        process_update(update);
+    }
 
-        /* Extract message */
-        cJSON *message = cJSON_GetObjectItem(update, "message");
-        if (!message) continue;
+    cJSON_Delete(root);
+}
 
-        cJSON *text = cJSON_GetObjectItem(message, "text");
-        if (!text || !cJSON_IsString(text)) continue;
+/* ── Webhook ──────────────────────────────────────────────────── */
 
-        cJSON *chat = cJSON_GetObjectItem(message, "chat");
-        if (!chat) continue;
+/*
+ * Telegram POSTs each Update to MIMI_SECRET_TG_WEBHOOK_URL; a reverse proxy
+ * terminates TLS there and forwards plain HTTP to MIMI_TG_WEBHOOK_PATH on
+ * the WebSocket server's httpd. Runs in the httpd task.
+ */
+static bool secret_matches(const char *token)
+{
+    /* Time depends only on the secret's length, not on where they differ */
+    const char *secret = MIMI_SECRET_TG_WEBHOOK_SECRET;
+    size_t n = strlen(secret);
+    unsigned char diff = strlen(token) != n;
+    for (size_t i = 0; i < n; i++) {
+        diff |= (unsigned char)token[i] ^ (unsigned char)secret[i];
+    }
+    return diff == 0;
+}
 
-        cJSON *chat_id = cJSON_GetObjectItem(chat, "id");
-        if (!chat_id) continue;
+static esp_err_t webhook_handler(httpd_req_t *req)
+{
+    /* Telegram's secret_token is at most 256 chars; longer headers fail as truncated */
+    char token[257] = {0};
+    if (httpd_req_get_hdr_value_str(req, "X-Telegram-Bot-Api-Secret-Token",
+                                    token, sizeof(token)) != ESP_OK ||
+        !secret_matches(token)) {
+        s_hook_rejected++;
+        ESP_LOGW(TAG, "Webhook: bad secret token");
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, NULL);
+    }
 
-        char chat_id_str[32];
-        snprintf(chat_id_str, sizeof(chat_id_str), "%.0f", chat_id->valuedouble);
+    size_t len = req->content_len;
+    if (len == 0 || len > MIMI_TG_WEBHOOK_MAX_BODY) {
+        s_hook_rejected++;
+        ESP_LOGW(TAG, "Webhook: rejected body of %d bytes", (int)len);
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+    }
 
-        ESP_LOGI(TAG, "Message from chat %s: %.40s...", chat_id_str, text->valuestring);
+    char *body = heap_caps_malloc(len + 1, MALLOC_CAP_SPIRAM);
+    if (!body) return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
 
-        /* Push to inbound bus */
-        mimi_msg_t msg = {0};
-        strncpy(msg.channel, MIMI_CHAN_TELEGRAM, sizeof(msg.channel) - 1);
-        strncpy(msg.chat_id, chat_id_str, sizeof(msg.chat_id) - 1);
-        msg.content = strdup(text->valuestring);
-        if (msg.content) {
-            message_bus_push_inbound(&msg);
+    size_t got = 0;
+    while (got < len) {
+        int n = httpd_req_recv(req, body + got, len - got);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) {
+            free(body);
+            return ESP_FAIL;    /* closes the connection */
         }
+        got += n;
+    }
+    body[len] = '\0';
+
+    cJSON *update = cJSON_Parse(body);
+    free(body);
+    if (!update) {
+        s_hook_rejected++;
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+    }
+
+    s_hook_posts++;
+    process_update(update);
+    cJSON_Delete(update);
+
+    /* Any 2xx acknowledges the update */
+    return httpd_resp_send(req, NULL, 0);
+}
+
+/* setWebhook / deleteWebhook; true once Telegram answered ok */
+static bool set_webhook(bool enable)
+{
+    char *json_str = NULL;
+    if (enable) {
+        if (!webhook_mode()) return false;
+        cJSON *body = cJSON_CreateObject();
+        cJSON_AddStringToObject(body, "url", MIMI_SECRET_TG_WEBHOOK_URL);
+        cJSON_AddStringToObject(body, "secret_token", MIMI_SECRET_TG_WEBHOOK_SECRET);
+        cJSON *allowed = cJSON_AddArrayToObject(body, "allowed_updates");
+        cJSON_AddItemToArray(allowed, cJSON_CreateString("message"));
+        json_str = cJSON_PrintUnformatted(body);
+        cJSON_Delete(body);
+        if (!json_str) return false;
     }
 
+    char *resp = tg_api_call(s_send_session, enable ? "setWebhook" : "deleteWebhook", json_str);
+    free(json_str);
+    if (!resp) return false;
+
+    cJSON *root = cJSON_Parse(resp);
+    free(resp);
+    bool ok = root && cJSON_IsTrue(cJSON_GetObjectItem(root, "ok"));
+    if (!ok) {
+        cJSON *desc = root ? cJSON_GetObjectItem(root, "description") : NULL;
+        ESP_LOGE(TAG, "%s failed: %s", enable ? "setWebhook" : "deleteWebhook",
+                 cJSON_IsString(desc) ? desc->valuestring : "no response");
+    }
     cJSON_Delete(root);
+    return ok;
 }
 
 static void telegram_poll_task(void *arg)
 {
-    ESP_LOGI(TAG, "Telegram polling task started");
+    ESP_LOGI(TAG, "Telegram %s task started", webhook_mode() ? "webhook" : "polling");
+    uint32_t backoff_ms = MIMI_TG_BACKOFF_MIN_MS;
+    bool hook_set = false;
 
     while (1) {
         if (s_bot_token[0] == '\0') {
@@ -237,18 +252,43 @@ static void telegram_poll_task(void *arg)
             continue;
         }
 
+        if (!hook_set) {
+            /* Webhook mode: register and let updates arrive. Polling mode:
+             * drop a webhook left from an earlier build, or getUpdates
+             * answers 409 Conflict. */
+            hook_set = set_webhook(webhook_mode());
+            if (hook_set && webhook_mode()) {
+                ESP_LOGI(TAG, "Webhook registered: %s", MIMI_SECRET_TG_WEBHOOK_URL);
+                vTaskDelete(NULL);
+            }
+            if (!hook_set) {
+                vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+                backoff_ms = backoff_ms * 2 > MIMI_TG_BACKOFF_MAX_MS ? MIMI_TG_BACKOFF_MAX_MS
+                                                                    : backoff_ms * 2;
+                continue;
+            }
+            backoff_ms = MIMI_TG_BACKOFF_MIN_MS;
+        }
+
         char params[128];
         snprintf(params, sizeof(params),
                  "getUpdates?offset=%" PRId64 "&timeout=%d",
                  s_update_offset, MIMI_TG_POLL_TIMEOUT_S);
 
-        char *resp = tg_api_call(params, NULL);
+        s_polls++;
+        char *resp = tg_api_call(s_poll_session, params, NULL);
         if (resp) {
             process_updates(resp);
             free(resp);
+            backoff_ms = MIMI_TG_BACKOFF_MIN_MS;
         } else {
-            /* Back off on error */
-            vTaskDelay(pdMS_TO_TICKS(3000));
+            /* The session reconnects on the next call; back off while the
+             * network or Telegram stays unreachable */
+            s_poll_errors++;
+            ESP_LOGW(TAG, "Poll failed, retrying in %lu ms", (unsigned long)backoff_ms);
+            vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+            backoff_ms = backoff_ms * 2 > MIMI_TG_BACKOFF_MAX_MS ? MIMI_TG_BACKOFF_MAX_MS
+                                                                : backoff_ms * 2;
         }
     }
 }
@@ -257,6 +297,9 @@ static void telegram_poll_task(void *arg)
 
 esp_err_t telegram_bot_init(void)
 {
+    s_poll_session = http_session_create("tg_poll", MIMI_TG_CONN_IDLE_MS);
+    s_send_session = http_session_create("tg_send", MIMI_TG_CONN_IDLE_MS);
+
     /* NVS overrides take highest priority (set via CLI) */
     nvs_handle_t nvs;
     if (nvs_open(MIMI_NVS_TG, NVS_READONLY, &nvs) == ESP_OK) {
@@ -280,6 +323,22 @@ esp_err_t telegram_bot_init(void)
 
 esp_err_t telegram_bot_start(void)
 {
+    if (MIMI_SECRET_TG_WEBHOOK_URL[0] && !webhook_mode()) {
+        ESP_LOGE(TAG, "Webhook URL set without MIMI_SECRET_TG_WEBHOOK_SECRET, using long polling");
+    }
+    if (webhook_mode()) {
+        static const httpd_uri_t hook_uri = {
+            .uri = MIMI_TG_WEBHOOK_PATH,
+            .method = HTTP_POST,
+            .handler = webhook_handler,
+        };
+        esp_err_t err = ws_server_register_uri(&hook_uri);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Webhook handler not registered: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+
     BaseType_t ret = xTaskCreatePinnedToCore(
         telegram_poll_task, "tg_poll",
         MIMI_TG_POLL_STACK, NULL,
@@ -288,89 +347,367 @@ esp_err_t telegram_bot_start(void)
     return (ret == pdPASS) ? ESP_OK : ESP_FAIL;
 }
 
-esp_err_t telegram_send_message(const char *chat_id, const char *text)
+/* ── Sending ──────────────────────────────────────────────────── */
+
+/*
+ * Post one HTML chunk: sendMessage, or editMessageText when edit_id is set.
+ * src is the Markdown the chunk was converted from, sent as plain text
+ * instead should the HTML fail validation. *message_id receives the new
+ * message's id; *retry_ms Telegram's retry_after when rate-limited (429).
+ * Both may be NULL.
+ */
+static esp_err_t post_html(const char *chat_id, int64_t edit_id, const char *html, size_t len,
+                           const char *src, size_t src_len,
+                           int64_t *message_id, uint32_t *retry_ms)
 {
-    if (s_bot_token[0] == '\0') {
-        ESP_LOGW(TAG, "Cannot send: no bot token");
-        return ESP_ERR_INVALID_STATE;
+    /* The converter escapes everything it doesn't emit as a tag, so this
+     * only trips on a converter bug; the source is still one request */
+    char *plain = NULL;
+    bool valid = tg_html_validate(html, len);
+    if (!valid) {
+        ESP_LOGE(TAG, "Converted HTML failed validation, sending the source as plain text");
+        if (src_len > MIMI_TG_MAX_MSG_LEN) {
+            src_len = MIMI_TG_MAX_MSG_LEN;
+            while (src_len > 0 && ((unsigned char)src[src_len] & 0xC0) == 0x80) src_len--;
+        }
+        plain = heap_caps_malloc(src_len + 1, MALLOC_CAP_SPIRAM);
+        if (!plain) return ESP_ERR_NO_MEM;
+        memcpy(plain, src, src_len);
+        plain[src_len] = '\0';
     }
 
-    /* Split long messages at 4096-char boundary */
-    size_t text_len = strlen(text);
-    size_t offset = 0;
+    const char *method = edit_id ? "editMessageText" : "sendMessage";
+    cJSON *body = cJSON_CreateObject();
+    cJSON_AddStringToObject(body, "chat_id", chat_id);
+    if (edit_id) cJSON_AddNumberToObject(body, "message_id", (double)edit_id);
+    cJSON_AddStringToObject(body, "text", valid ? html : plain);
+    if (valid) cJSON_AddStringToObject(body, "parse_mode", "HTML");
+    char *json_str = cJSON_PrintUnformatted(body);
+    cJSON_Delete(body);
+    free(plain);
+    if (!json_str) return ESP_ERR_NO_MEM;
+
+    char *resp = tg_api_call(s_send_session, method, json_str);
+    free(json_str);
+    if (!resp) return ESP_FAIL;
+
+    esp_err_t err = ESP_OK;
+    cJSON *root = cJSON_Parse(resp);
+    free(resp);
+    if (root && cJSON_IsTrue(cJSON_GetObjectItem(root, "ok"))) {
+        cJSON *id = cJSON_GetObjectItem(cJSON_GetObjectItem(root, "result"), "message_id");
+        if (message_id && cJSON_IsNumber(id)) *message_id = (int64_t)id->valuedouble;
+    } else {
+        cJSON *desc = root ? cJSON_GetObjectItem(root, "description") : NULL;
+        const char *why = cJSON_IsString(desc) ? desc->valuestring : "unparseable response";
+        cJSON *retry = root ? cJSON_GetObjectItem(cJSON_GetObjectItem(root, "parameters"),
+                                                  "retry_after") : NULL;
+        if (retry_ms && cJSON_IsNumber(retry)) *retry_ms = (uint32_t)retry->valueint * 1000;
+
+        if (edit_id && strstr(why, "message is not modified")) {
+            /* Same text as shown: nothing to do */
+        } else {
+            ESP_LOGW(TAG, "%s rejected: %s", method, why);
+            err = ESP_FAIL;
+        }
+    }
+    cJSON_Delete(root);
+    return err;
+}
+
+typedef struct {
+    const char *chat_id;
+    int         index;
+    esp_err_t   err;
+    uint32_t    retry_ms;
+} send_ctx_t;
+
+/* One converted chunk → one sendMessage */
+static esp_err_t send_chunk(const char *html, size_t len, const char *src, size_t src_len,
+                            void *ctx)
+{
+    send_ctx_t *sc = (send_ctx_t *)ctx;
+    bool first = sc->index++ == 0;
+    if (post_html(sc->chat_id, 0, html, len, src, src_len, NULL,
+                  first ? &sc->retry_ms : NULL) != ESP_OK) {
+        sc->err = ESP_FAIL;
+        /* Nothing shown yet: stop, the whole reply is sent again later */
+        if (first && sc->retry_ms) return ESP_FAIL;
+    }
+    return ESP_OK;      /* still try the remaining chunks */
+}
+
+/* ── Progressive replies ──────────────────────────────────────── */
+
+/*
+ * A reply being generated is shown in one message that is edited as text
+ * arrives. Past MIMI_TG_ROLLOVER_LEN bytes the message is finished at a line
+ * break and a new one continues from there. Only the out_telegram dispatch
+ * task touches this table.
+ */
+typedef struct {
+    char     chat_id[32];
+    bool     active;
+    int64_t  message_id;    /* message showing the reply from offset on; 0: none yet */
+    size_t   offset;        /* where that message starts in the reply */
+    size_t   shown;         /* reply length it shows */
+    bool     fence;         /* a code fence is open at offset */
+    uint32_t interval_ms;   /* adaptive edit interval */
+    size_t   drafted;       /* reply bytes shown so far, over all its messages */
+    uint32_t drafted_crc;   /* crc32 of those bytes */
+} tg_draft_t;
+
+static tg_draft_t s_drafts[MIMI_STATUS_SLOTS];
+static unsigned s_edits;
+static unsigned s_rollovers;
+
+static tg_draft_t *draft_get(const char *chat_id, bool create)
+{
+    tg_draft_t *free_slot = NULL;
+    for (int i = 0; i < MIMI_STATUS_SLOTS; i++) {
+        tg_draft_t *d = &s_drafts[i];
+        if (d->active && strcmp(d->chat_id, chat_id) == 0) return d;
+        if (!d->active && !free_slot) free_slot = d;
+    }
+    if (!create || !free_slot) return NULL;
+
+    memset(free_slot, 0, sizeof(*free_slot));
+    strncpy(free_slot->chat_id, chat_id, sizeof(free_slot->chat_id) - 1);
+    free_slot->interval_ms = MIMI_TG_EDIT_MIN_MS;
+    free_slot->active = true;
+    return free_slot;
+}
 
-    while (offset < text_len) {
-        size_t chunk = text_len - offset;
-        if (chunk > MIMI_TG_MAX_MSG_LEN) {
-            chunk = MIMI_TG_MAX_MSG_LEN;
+typedef struct {
+    tg_draft_t *d;
+    bool        final;
+    int         index;
+    esp_err_t   err;
+    uint32_t    retry_ms;
+} draft_ctx_t;
+
+/* First chunk goes into the draft message; the rest only once final */
+static esp_err_t draft_chunk(const char *html, size_t len, const char *src, size_t src_len,
+                             void *ctx)
+{
+    draft_ctx_t *dc = (draft_ctx_t *)ctx;
+    tg_draft_t *d = dc->d;
+
+    if (dc->index++ > 0) {
+        if (!dc->final) return ESP_ERR_INVALID_SIZE;   /* shown once it is final */
+        if (post_html(d->chat_id, 0, html, len, src, src_len, NULL, NULL) != ESP_OK) {
+            dc->err = ESP_FAIL;
         }
+        return ESP_OK;
+    }
 
-        /* Build JSON body */
-        cJSON *body = cJSON_CreateObject();
-        cJSON_AddStringToObject(body, "chat_id", chat_id);
+    int64_t id = 0;
+    if (post_html(d->chat_id, d->message_id, html, len, src, src_len, &id,
+                  &dc->retry_ms) != ESP_OK) {
+        dc->err = ESP_FAIL;
+    } else if (!d->message_id) {
+        d->message_id = id;
+    } else {
+        s_edits++;
+    }
+    return ESP_OK;
+}
 
-        /* Create null-terminated chunk */
-        char *segment = malloc(chunk + 1);
-        if (!segment) {
-            cJSON_Delete(body);
-            return ESP_ERR_NO_MEM;
+/* Show reply[offset, end) in the draft message */
+static esp_err_t draft_show(tg_draft_t *d, const char *reply, size_t end, bool final,
+                            uint32_t *retry_ms)
+{
+    if (!final && d->message_id && end == d->offset + d->shown) return ESP_OK;
+
+    /* Reopen a code block cut by the previous rollover */
+    size_t seg = end - d->offset;
+    size_t pre = d->fence ? 4 : 0;
+    char *md = heap_caps_malloc(pre + seg + 1, MALLOC_CAP_SPIRAM);
+    if (!md) return ESP_ERR_NO_MEM;
+    memcpy(md, "```\n", pre);
+    memcpy(md + pre, reply + d->offset, seg);
+    md[pre + seg] = '\0';
+
+    draft_ctx_t dc = { .d = d, .final = final };
+    tg_html_from_markdown(md, pre + seg, MIMI_TG_MAX_MSG_LEN, draft_chunk, &dc);
+    free(md);
+
+    if (dc.retry_ms && retry_ms) *retry_ms = dc.retry_ms;
+    if (dc.err == ESP_OK) d->shown = seg;
+    return dc.err;
+}
+
+/* Where to finish a message that has grown past the rollover length */
+static size_t rollover_cut(const char *s, size_t max)
+{
+    for (size_t i = max; i > max / 2; i--) {
+        if (s[i - 1] == '\n') return i;
+    }
+    for (size_t i = max; i > max / 2; i--) {
+        if (s[i - 1] == ' ') return i;
+    }
+    size_t cut = max;
+    while (cut > 0 && ((unsigned char)s[cut] & 0xC0) == 0x80) cut--;
+    return cut;
+}
+
+static bool toggles_fence(const char *s, size_t len)
+{
+    bool odd = false;
+    for (size_t i = 0; i < len; i++) {
+        if ((i == 0 || s[i - 1] == '\n') && len - i >= 3 && strncmp(s + i, "```", 3) == 0) {
+            odd = !odd;
         }
-        memcpy(segment, text + offset, chunk);
-        segment[chunk] = '\0';
+    }
+    return odd;
+}
 
-        cJSON_AddStringToObject(body, "text", segment);
-        cJSON_AddStringToObject(body, "parse_mode", "Markdown");
+/* Bring the chat's draft messages up to reply */
+static esp_err_t draft_update(tg_draft_t *d, const char *reply, bool final, uint32_t *retry_ms)
+{
+    size_t len = strlen(reply);
+    esp_err_t err = ESP_OK;
+    while (len - d->offset > MIMI_TG_ROLLOVER_LEN) {
+        size_t cut = rollover_cut(reply + d->offset, MIMI_TG_ROLLOVER_LEN);
+        err = draft_show(d, reply, d->offset + cut, true, retry_ms);
+        if (err != ESP_OK) return err;
+        if (toggles_fence(reply + d->offset, cut)) d->fence = !d->fence;
+        d->offset += cut;
+        d->message_id = 0;
+        d->shown = 0;
+        s_rollovers++;
+    }
+    if (len != d->offset) err = draft_show(d, reply, len, final, retry_ms);
 
-        char *json_str = cJSON_PrintUnformatted(body);
-        cJSON_Delete(body);
-        free(segment);
-
-        if (json_str) {
-            char *resp = tg_api_call("sendMessage", json_str);
-            free(json_str);
-            if (resp) {
-                /* Check for Markdown parse error, retry as plain text */
-                cJSON *root = cJSON_Parse(resp);
-                if (root) {
-                    cJSON *ok_field = cJSON_GetObjectItem(root, "ok");
-                    if (!cJSON_IsTrue(ok_field)) {
-                        ESP_LOGW(TAG, "Markdown send failed, retrying plain");
-                        cJSON_Delete(root);
-                        free(resp);
-
-                        /* Retry without parse_mode */
-                        cJSON *body2 = cJSON_CreateObject();
-                        cJSON_AddStringToObject(body2, "chat_id", chat_id);
-                        char *seg2 = malloc(chunk + 1);
-                        if (seg2) {
-                            memcpy(seg2, text + offset, chunk);
-                            seg2[chunk] = '\0';
-                            cJSON_AddStringToObject(body2, "text", seg2);
-                            free(seg2);
-                        }
-                        char *json2 = cJSON_PrintUnformatted(body2);
-                        cJSON_Delete(body2);
-                        if (json2) {
-                            char *resp2 = tg_api_call("sendMessage", json2);
-                            free(json2);
-                            free(resp2);
-                        }
-                    } else {
-                        cJSON_Delete(root);
-                        free(resp);
-                    }
-                } else {
-                    free(resp);
-                }
-            }
+    /* Remember what is on screen, to tell whether the final reply extends it */
+    size_t drafted = d->offset + d->shown;
+    if (drafted != d->drafted) {
+        d->drafted = drafted;
+        d->drafted_crc = esp_rom_crc32_le(0, (const uint8_t *)reply, drafted);
+    }
+    return err;
+}
+
+/* Whether reply continues the text the draft shows */
+static bool draft_extends(const tg_draft_t *d, const char *reply)
+{
+    if (d->drafted == 0) return true;
+    if (strlen(reply) < d->drafted) return false;
+    return esp_rom_crc32_le(0, (const uint8_t *)reply, d->drafted) == d->drafted_crc;
+}
+
+esp_err_t telegram_send_draft(const char *chat_id, const char *text, uint32_t *next_ms)
+{
+    *next_ms = MIMI_TG_EDIT_MIN_MS;
+    if (s_bot_token[0] == '\0') return ESP_ERR_INVALID_STATE;
+
+    if (!text) {
+        /* Next agent iteration: leave the messages shown, start a new one */
+        tg_draft_t *d = draft_get(chat_id, false);
+        if (d) {
+            d->message_id = 0;
+            d->offset = 0;
+            d->shown = 0;
+            d->fence = false;
+            d->drafted = 0;
         }
+        return ESP_OK;
+    }
 
-        offset += chunk;
+    tg_draft_t *d = draft_get(chat_id, true);
+    if (!d) return ESP_ERR_NO_MEM;
+
+    uint32_t start = (uint32_t)(esp_timer_get_time() / 1000);
+    uint32_t retry_ms = 0;
+    esp_err_t err = draft_update(d, text, false, &retry_ms);
+    uint32_t rtt = (uint32_t)(esp_timer_get_time() / 1000) - start;
+
+    /* Telegram allows about one message per second per chat. Edit no faster
+     * than that, nor faster than twice the round trip, back off as told on
+     * 429 and ease back toward the minimum afterwards. */
+    uint32_t interval = d->interval_ms * 3 / 4;
+    if (interval < MIMI_TG_EDIT_MIN_MS) interval = MIMI_TG_EDIT_MIN_MS;
+    if (interval < 2 * rtt) interval = 2 * rtt;
+    if (retry_ms > interval) interval = retry_ms;
+    if (interval > MIMI_TG_EDIT_MAX_MS && !retry_ms) interval = MIMI_TG_EDIT_MAX_MS;
+    d->interval_ms = interval;
+    *next_ms = interval;
+    return err;
+}
+
+esp_err_t telegram_send_message(const char *chat_id, const char *text, uint32_t *retry_ms)
+{
+    if (s_bot_token[0] == '\0') {
+        ESP_LOGW(TAG, "Cannot send: no bot token");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* A draft was shown: finish it in place instead of sending anew, unless
+     * the reply is something else (an error after a partial answer) */
+    tg_draft_t *d = draft_get(chat_id, false);
+    if (d && !draft_extends(d, text)) {
+        ESP_LOGI(TAG, "Reply to %s does not continue its draft, sending it apart", chat_id);
+        d->active = false;
+        d = NULL;
+    }
+    if (d) {
+        esp_err_t err = draft_update(d, text, true, retry_ms);
+        /* Rate-limited by the preceding edits: keep the draft, the dispatch
+         * task calls again with the same text once Telegram allows it */
+        if (err == ESP_OK || !*retry_ms) d->active = false;
+        return err;
     }
 
+    /* Convert to HTML and send each chunk as soon as it is cut */
+    send_ctx_t sc = { .chat_id = chat_id, .err = ESP_OK };
+    esp_err_t err = tg_html_from_markdown(text, strlen(text), MIMI_TG_MAX_MSG_LEN, send_chunk, &sc);
+    *retry_ms = sc.retry_ms;
+    return sc.err != ESP_OK ? sc.err : err;
+}
+
+esp_err_t telegram_send_typing(const char *chat_id, const char *status)
+{
+    if (s_bot_token[0] == '\0') return ESP_ERR_INVALID_STATE;
+
+    cJSON *body = cJSON_CreateObject();
+    cJSON_AddStringToObject(body, "chat_id", chat_id);
+    cJSON_AddStringToObject(body, "action", "typing");
+    char *json_str = cJSON_PrintUnformatted(body);
+    cJSON_Delete(body);
+    if (!json_str) return ESP_ERR_NO_MEM;
+
+    char *resp = tg_api_call(s_send_session, "sendChatAction", json_str);
+    free(json_str);
+    if (!resp) return ESP_FAIL;
+    free(resp);
     return ESP_OK;
 }
 
+static void print_session(const char *label, const http_session_t *session, unsigned calls)
+{
+    http_session_stats_t st;
+    http_session_get_stats(session, &st);
+    printf("  %-5s calls %-6u connects %-4u one-shot %-4u handshakes/call %.2f\n",
+           label, calls, st.connects, st.fallbacks,
+           calls ? (double)(st.connects + st.fallbacks) / calls : 0.0);
+}
+
+void telegram_print_stats(void)
+{
+    http_session_stats_t send;
+    http_session_get_stats(s_send_session, &send);
+
+    printf("Telegram (%s):\n", webhook_mode() ? "webhook" : "long poll");
+    if (webhook_mode()) {
+        printf("  hook  posts %-6u rejected %u\n", s_hook_posts, s_hook_rejected);
+    } else {
+        print_session("poll", s_poll_session, s_polls);
+    }
+    print_session("send", s_send_session, send.requests + send.fallbacks);
+    printf("  updates %u  poll errors %u  draft edits %u  rollovers %u\n",
+           s_updates, s_poll_errors, s_edits, s_rollovers);
+}
+
 esp_err_t telegram_set_token(const char *token)
 {
     nvs_handle_t nvs;
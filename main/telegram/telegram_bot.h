@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stdint.h>
 
 /**
  * Initialize the Telegram bot.
@@ -8,17 +9,52 @@
 esp_err_t telegram_bot_init(void);
 
 /**
- * Start the Telegram polling task (long polling on Core 0).
+ * Start receiving updates. Long polling on Core 0 by default; with
+ * MIMI_SECRET_TG_WEBHOOK_URL set, registers the webhook with Telegram and
+ * the update handler on the WebSocket server, which must be running.
  */
 esp_err_t telegram_bot_start(void);
 
 /**
  * Send a text message to a Telegram chat.
- * Automatically splits messages longer than 4096 chars.
- * @param chat_id  Telegram chat ID (numeric string)
- * @param text     Message text (supports Markdown)
+ * Markdown is converted to Telegram HTML, so every chunk is accepted on the
+ * first request. Messages longer than 4096 bytes are split at line breaks
+ * or spaces, with formatting carried across the cut. Never waits out a
+ * rate limit: if Telegram refuses before anything new is shown, *retry_ms
+ * gets its retry_after and the outbound dispatch task calls again later.
+ * @param chat_id   Telegram chat ID (numeric string)
+ * @param text      Message text (supports Markdown)
+ * @param retry_ms  Set when the same text should be sent again that much later
  */
-esp_err_t telegram_send_message(const char *chat_id, const char *text);
+esp_err_t telegram_send_message(const char *chat_id, const char *text, uint32_t *retry_ms);
+
+/**
+ * Show a reply while it is being generated: the first call posts a
+ * message, later calls edit it with the longer text, and past
+ * MIMI_TG_ROLLOVER_LEN bytes it is finished at a line break and continued
+ * in a new message. The next telegram_send_message() to the chat finishes
+ * the draft in place instead of posting the reply again. Call from the
+ * outbound dispatch task only.
+ * @param text     The whole reply so far, or NULL when the agent starts a
+ *                 new reply: the messages shown stay and the next text
+ *                 goes into a new one
+ * @param next_ms  Set to the adaptive interval before the next edit
+ */
+esp_err_t telegram_send_draft(const char *chat_id, const char *text, uint32_t *next_ms);
+
+/**
+ * Show the "typing..." indicator in a chat (sendChatAction). Telegram
+ * clears it after about 5 seconds or when the next message arrives; the
+ * status text itself is not shown.
+ */
+esp_err_t telegram_send_typing(const char *chat_id, const char *status);
+
+/**
+ * Print poll/send request counts and TLS handshakes per connection to
+ * stdout. Handshakes are counted on the direct path only; through the
+ * proxy the tunnel pool is shared with other modules.
+ */
+void telegram_print_stats(void);
 
 /**
  * Save the Telegram bot token to NVS.
@@ -0,0 +1,582 @@
+#include "tg_html.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+
+#define MIN_TEXT_ROOM   16      /* don't open a tag with less room than this left */
+#define TAG_OPEN_MAX    (TG_HTML_MAX_URL + 16)
+#define IN_LINK         0x1
+
+/* ── Chunk writer ─────────────────────────────────────────────── */
+
+typedef struct {
+    char        open[TAG_OPEN_MAX];
+    const char *close;
+} tag_t;
+
+typedef struct {
+    char           *buf;
+    size_t          len;
+    size_t          max;
+    bool            has_text;       /* non-whitespace since the chunk began */
+    tag_t           stack[TG_HTML_MAX_DEPTH];
+    int             depth;
+    size_t          close_len;      /* reserved for closing every open tag */
+    const char     *md;             /* source, for the slice behind each chunk */
+    size_t          md_len;
+    size_t          src_start;      /* source offset the chunk being built starts at */
+    size_t          src_end;        /* source consumed into it so far */
+    tg_html_chunk_t emit;
+    void           *ctx;
+    esp_err_t       err;
+} conv_t;
+
+static void append(conv_t *c, const char *data, size_t n)
+{
+    memcpy(c->buf + c->len, data, n);
+    c->len += n;
+}
+
+/* Close open tags, hand the chunk out, optionally reopen them in the next */
+static void flush(conv_t *c, bool reopen)
+{
+    for (int i = c->depth - 1; i >= 0; i--) {
+        append(c, c->stack[i].close, strlen(c->stack[i].close));
+    }
+    if (c->has_text && c->err == ESP_OK) {
+        c->buf[c->len] = '\0';
+        c->err = c->emit(c->buf, c->len, c->md + c->src_start, c->src_end - c->src_start,
+                         c->ctx);
+        c->src_start = c->src_end;  /* a skipped chunk's source joins the next */
+    }
+    c->len = 0;
+    c->has_text = false;
+    if (!reopen) return;
+    for (int i = 0; i < c->depth; i++) {
+        append(c, c->stack[i].open, strlen(c->stack[i].open));
+    }
+}
+
+static void tag_open(conv_t *c, const char *open, const char *close)
+{
+    size_t open_len = strlen(open);
+    size_t close_len = strlen(close);
+    if (c->len + c->close_len + open_len + close_len + MIN_TEXT_ROOM > c->max) {
+        flush(c, true);
+    }
+    tag_t *t = &c->stack[c->depth++];
+    memcpy(t->open, open, open_len + 1);
+    t->close = close;
+    c->close_len += close_len;
+    append(c, open, open_len);
+}
+
+static void tag_close(conv_t *c)
+{
+    tag_t *t = &c->stack[--c->depth];
+    size_t close_len = strlen(t->close);
+    c->close_len -= close_len;
+    append(c, t->close, close_len);
+}
+
+static size_t escaped_width(char ch)
+{
+    switch (ch) {
+    case '<': case '>': return 4;
+    case '&':           return 5;
+    default:            return 1;
+    }
+}
+
+static void put_escaped(conv_t *c, const char *s, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        switch (s[i]) {
+        case '<': append(c, "&lt;", 4);  break;
+        case '>': append(c, "&gt;", 4);  break;
+        case '&': append(c, "&amp;", 5); break;
+        default:  c->buf[c->len++] = s[i]; break;
+        }
+        if (s[i] != ' ' && s[i] != '\n' && s[i] != '\t') c->has_text = true;
+    }
+}
+
+/* Source taken up to s + n, if s is in the source (not generated text) */
+static void consumed(conv_t *c, const char *s, size_t n)
+{
+    uintptr_t at = (uintptr_t)s, md = (uintptr_t)c->md;
+    if (at >= md && at + n <= md + c->md_len && at + n - md > c->src_end) {
+        c->src_end = at + n - md;
+    }
+}
+
+/* Last occurrence of ch in s[from, to), or 0 if none */
+static size_t last_break(const char *s, size_t from, size_t to, char ch)
+{
+    for (size_t i = to; i > from; i--) {
+        if (s[i - 1] == ch) return i;
+    }
+    return 0;
+}
+
+static void text(conv_t *c, const char *s, size_t n)
+{
+    while (n > 0 && c->err == ESP_OK) {
+        size_t room = c->max - c->len - c->close_len;
+        size_t fit = 0, used = 0;
+        while (fit < n && used + escaped_width(s[fit]) <= room) {
+            used += escaped_width(s[fit]);
+            fit++;
+        }
+        if (fit == n) {
+            put_escaped(c, s, n);
+            consumed(c, s, n);
+            return;
+        }
+
+        /* Cut: a line break in the second half, else a space, else any line
+         * break, else a character boundary */
+        size_t cut = fit;
+        while (cut > 0 && ((unsigned char)s[cut] & 0xC0) == 0x80) cut--;
+        size_t at = last_break(s, cut / 2, cut, '\n');
+        if (!at) at = last_break(s, 0, cut, ' ');
+        if (!at) at = last_break(s, 0, cut, '\n');
+        if (at) {
+            cut = at;
+        } else if (c->has_text) {
+            cut = 0;    /* an unbreakable run: start it on a fresh chunk */
+        }
+        if (cut == 0 && !c->has_text) {
+            c->err = ESP_ERR_INVALID_SIZE;  /* open tags leave no room */
+            return;
+        }
+
+        put_escaped(c, s, cut);
+        consumed(c, s, cut);
+        flush(c, true);
+        s += cut;
+        n -= cut;
+    }
+}
+
+/* ── Inline Markdown ──────────────────────────────────────────── */
+
+static bool is_word(const char *s, size_t n, size_t i)
+{
+    return i < n && (isalnum((unsigned char)s[i]) || ((unsigned char)s[i] & 0x80));
+}
+
+/* Closing position of a ** / __ / ~~ pair opened at i, or 0 */
+static size_t find_double(const char *s, size_t n, size_t i)
+{
+    char m = s[i];
+    if (i + 2 >= n || s[i + 2] == ' ') return 0;
+    if (m == '_' && i > 0 && is_word(s, n, i - 1)) return 0;
+    for (size_t k = i + 3; k + 1 < n; k++) {
+        if (s[k] != m || s[k + 1] != m || s[k - 1] == ' ') continue;
+        if (m == '_' && is_word(s, n, k + 2)) continue;
+        return k;
+    }
+    return 0;
+}
+
+/* Closing position of a * / _ emphasis opened at i, or 0 */
+static size_t find_single(const char *s, size_t n, size_t i)
+{
+    char m = s[i];
+    if (i + 1 >= n || s[i + 1] == ' ' || s[i + 1] == m) return 0;
+    if (m == '_' && i > 0 && is_word(s, n, i - 1)) return 0;
+    for (size_t k = i + 2; k < n; k++) {
+        if (s[k] != m || s[k - 1] == ' ' || s[k - 1] == m) continue;
+        if (k + 1 < n && s[k + 1] == m) continue;
+        if (m == '_' && is_word(s, n, k + 1)) continue;
+        return k;
+    }
+    return 0;
+}
+
+static bool url_allowed(const char *url, size_t n)
+{
+    static const char *schemes[] = { "http://", "https://", "tg://", "mailto:" };
+    bool ok = false;
+    for (size_t i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++) {
+        size_t sl = strlen(schemes[i]);
+        if (n > sl && strncmp(url, schemes[i], sl) == 0) ok = true;
+    }
+    if (!ok) return false;
+
+    size_t escaped = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (url[i] == '"' || url[i] == '<' || url[i] == '>' || url[i] == ' ') return false;
+        escaped += url[i] == '&' ? 5 : 1;
+    }
+    return escaped <= TG_HTML_MAX_URL;
+}
+
+static void inline_md(conv_t *c, const char *s, size_t n, int flags);
+
+/* [text](url) at i; returns the index after it, or 0 if not a link */
+static size_t link(conv_t *c, const char *s, size_t n, size_t i, int flags)
+{
+    if (flags & IN_LINK) return 0;
+    const char *close = memchr(s + i + 1, ']', n - i - 1);
+    if (!close) return 0;
+    size_t j = close - s;
+    if (j == i + 1 || j + 1 >= n || s[j + 1] != '(') return 0;
+    const char *end = memchr(s + j + 2, ')', n - j - 2);
+    if (!end) return 0;
+    size_t k = end - s;
+    if (!url_allowed(s + j + 2, k - j - 2)) return 0;
+
+    char open[TAG_OPEN_MAX];
+    size_t o = 0;
+    memcpy(open, "<a href=\"", 9);
+    o = 9;
+    for (size_t u = j + 2; u < k; u++) {
+        if (s[u] == '&') {
+            memcpy(open + o, "&amp;", 5);
+            o += 5;
+        } else {
+            open[o++] = s[u];
+        }
+    }
+    memcpy(open + o, "\">", 3);
+
+    tag_open(c, open, "</a>");
+    inline_md(c, s + i + 1, j - i - 1, flags | IN_LINK);
+    tag_close(c);
+    return k + 1;
+}
+
+static void inline_md(conv_t *c, const char *s, size_t n, int flags)
+{
+    size_t lit = 0, i = 0;
+
+    while (i < n) {
+        char ch = s[i];
+
+        if (ch == '\\' && i + 1 < n && ispunct((unsigned char)s[i + 1])) {
+            text(c, s + lit, i - lit);
+            lit = i + 1;            /* the escaped character starts the next run */
+            i += 2;
+            continue;
+        }
+
+        if (ch == '`' && c->depth < TG_HTML_MAX_DEPTH) {
+            const char *end = memchr(s + i + 1, '`', n - i - 1);
+            if (end && end > s + i + 1) {
+                size_t k = end - s;
+                text(c, s + lit, i - lit);
+                tag_open(c, "<code>", "</code>");
+                text(c, s + i + 1, k - i - 1);
+                tag_close(c);
+                i = lit = k + 1;
+                continue;
+            }
+        }
+
+        if (c->depth < TG_HTML_MAX_DEPTH) {
+            if ((ch == '*' || ch == '_' || ch == '~') && i + 1 < n && s[i + 1] == ch) {
+                size_t k = find_double(s, n, i);
+                if (k) {
+                    text(c, s + lit, i - lit);
+                    if (ch == '~') {
+                        tag_open(c, "<s>", "</s>");
+                    } else {
+                        tag_open(c, "<b>", "</b>");
+                    }
+                    inline_md(c, s + i + 2, k - i - 2, flags);
+                    tag_close(c);
+                    i = lit = k + 2;
+                    continue;
+                }
+                i += 2;             /* unmatched pair stays literal as a whole */
+                continue;
+            }
+            if (ch == '*' || ch == '_') {
+                size_t k = find_single(s, n, i);
+                if (k) {
+                    text(c, s + lit, i - lit);
+                    tag_open(c, "<i>", "</i>");
+                    inline_md(c, s + i + 1, k - i - 1, flags);
+                    tag_close(c);
+                    i = lit = k + 1;
+                    continue;
+                }
+            }
+            if (ch == '[') {
+                text(c, s + lit, i - lit);
+                size_t next = link(c, s, n, i, flags);
+                lit = i;
+                if (next) {
+                    i = lit = next;
+                    continue;
+                }
+            }
+        }
+        i++;
+    }
+    text(c, s + lit, n - lit);
+}
+
+/* ── Block Markdown ───────────────────────────────────────────── */
+
+static bool is_fence(const char *line, size_t n)
+{
+    size_t i = 0;
+    while (i < n && i < 3 && line[i] == ' ') i++;
+    return n - i >= 3 && strncmp(line + i, "```", 3) == 0;
+}
+
+static void code_open(conv_t *c, const char *line, size_t n)
+{
+    const char *p = memchr(line, '`', n);
+    size_t i = (p - line) + 3;
+    while (i < n && line[i] == ' ') i++;
+
+    char lang[33];
+    size_t l = 0;
+    while (i < n && l < sizeof(lang) - 1 &&
+           (isalnum((unsigned char)line[i]) || strchr("+-#_.", line[i]))) {
+        lang[l++] = line[i++];
+    }
+    lang[l] = '\0';
+
+    tag_open(c, "<pre>", "</pre>");
+    if (l) {
+        char open[64];
+        snprintf(open, sizeof(open), "<code class=\"language-%s\">", lang);
+        tag_open(c, open, "</code>");
+    } else {
+        tag_open(c, "<code>", "</code>");
+    }
+}
+
+static void line_md(conv_t *c, const char *line, size_t n)
+{
+    size_t indent = 0;
+    while (indent < n && line[indent] == ' ') indent++;
+    const char *p = line + indent;
+    size_t rest = n - indent;
+
+    /* # Heading → bold line */
+    size_t h = 0;
+    while (h < rest && h < 6 && p[h] == '#') h++;
+    if (h > 0 && h < rest && p[h] == ' ') {
+        tag_open(c, "<b>", "</b>");
+        inline_md(c, p + h + 1, rest - h - 1, 0);
+        tag_close(c);
+        return;
+    }
+
+    /* - item / * item / + item → bullet */
+    if (rest >= 2 && (p[0] == '-' || p[0] == '*' || p[0] == '+') && p[1] == ' ') {
+        text(c, line, indent);
+        text(c, "\xE2\x80\xA2 ", 4);
+        inline_md(c, p + 2, rest - 2, 0);
+        return;
+    }
+
+    inline_md(c, line, n, 0);
+}
+
+esp_err_t tg_html_from_markdown(const char *md, size_t len, size_t max_len,
+                                tg_html_chunk_t emit, void *ctx)
+{
+    conv_t *c = heap_caps_calloc(1, sizeof(conv_t), MALLOC_CAP_SPIRAM);
+    if (!c) return ESP_ERR_NO_MEM;
+    c->buf = heap_caps_malloc(max_len + 1, MALLOC_CAP_SPIRAM);
+    if (!c->buf) {
+        free(c);
+        return ESP_ERR_NO_MEM;
+    }
+    c->max = max_len;
+    c->md = md;
+    c->md_len = len;
+    c->emit = emit;
+    c->ctx = ctx;
+
+    bool in_code = false, code_first = false, in_quote = false;
+    size_t pos = 0;
+
+    while (pos < len && c->err == ESP_OK) {
+        const char *line = md + pos;
+        const char *nl = memchr(line, '\n', len - pos);
+        size_t n = nl ? (size_t)(nl - line) : len - pos;
+        pos += n + (nl ? 1 : 0);
+        if (n > 0 && line[n - 1] == '\r') n--;
+
+        if (in_code) {
+            if (is_fence(line, n)) {
+                tag_close(c);
+                tag_close(c);
+                in_code = false;
+                if (nl) text(c, nl, 1);
+            } else {
+                if (!code_first) text(c, line - 1, 1);     /* previous line's '\n' */
+                text(c, line, n);
+                code_first = false;
+            }
+            continue;
+        }
+
+        bool quote = n > 0 && line[0] == '>';
+        if (in_quote && !quote) {
+            tag_close(c);
+            in_quote = false;
+        }
+
+        if (is_fence(line, n)) {
+            code_open(c, line, n);
+            in_code = true;
+            code_first = true;
+            continue;
+        }
+
+        if (quote) {
+            if (!in_quote) {
+                tag_open(c, "<blockquote>", "</blockquote>");
+                in_quote = true;
+            }
+            line++;
+            n--;
+            if (n > 0 && line[0] == ' ') {
+                line++;
+                n--;
+            }
+        }
+
+        line_md(c, line, n);
+        if (nl) text(c, nl, 1);
+    }
+
+    while (c->depth > 0) tag_close(c);  /* unterminated fence or quote */
+    c->src_end = len;
+    flush(c, false);
+
+    esp_err_t err = c->err;
+    free(c->buf);
+    free(c);
+    return err;
+}
+
+/* ── Validator ────────────────────────────────────────────────── */
+
+static bool tag_allowed(const char *name, size_t n)
+{
+    static const char *tags[] = {
+        "b", "strong", "i", "em", "u", "ins", "s", "strike", "del",
+        "code", "pre", "a", "blockquote", "tg-spoiler", "span", "tg-emoji",
+    };
+    for (size_t i = 0; i < sizeof(tags) / sizeof(tags[0]); i++) {
+        if (strlen(tags[i]) == n && strncmp(tags[i], name, n) == 0) return true;
+    }
+    return false;
+}
+
+/* Entity at s[i] ('&'); returns its length, or 0 if malformed */
+static size_t entity_len(const char *s, size_t len, size_t i)
+{
+    static const char *named[] = { "&lt;", "&gt;", "&amp;", "&quot;" };
+    for (size_t k = 0; k < sizeof(named) / sizeof(named[0]); k++) {
+        size_t n = strlen(named[k]);
+        if (len - i >= n && strncmp(s + i, named[k], n) == 0) return n;
+    }
+    size_t j = i + 1;
+    if (j >= len || s[j] != '#') return 0;
+    j++;
+    bool hex = j < len && (s[j] == 'x' || s[j] == 'X');
+    if (hex) j++;
+    size_t digits = 0;
+    while (j < len && (hex ? isxdigit((unsigned char)s[j]) : isdigit((unsigned char)s[j]))) {
+        j++;
+        digits++;
+    }
+    if (digits == 0 || j >= len || s[j] != ';') return 0;
+    return j + 1 - i;
+}
+
+/* Length of the UTF-8 sequence at s[i], or 0 if invalid */
+static size_t utf8_len(const char *s, size_t len, size_t i)
+{
+    unsigned char b = (unsigned char)s[i];
+    size_t n = b < 0x80 ? 1 : (b >> 5) == 0x6 ? 2 : (b >> 4) == 0xE ? 3 : (b >> 3) == 0x1E ? 4 : 0;
+    if (n == 0 || len - i < n) return 0;
+    for (size_t k = 1; k < n; k++) {
+        if (((unsigned char)s[i + k] & 0xC0) != 0x80) return 0;
+    }
+    return n;
+}
+
+bool tg_html_validate(const char *html, size_t len)
+{
+    const char *stack[TG_HTML_MAX_DEPTH * 2];
+    size_t stack_len[TG_HTML_MAX_DEPTH * 2];
+    int depth = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        char ch = html[i];
+
+        if (ch == '&') {
+            size_t n = entity_len(html, len, i);
+            if (!n) return false;
+            i += n;
+            continue;
+        }
+
+        if (ch != '<') {
+            size_t n = utf8_len(html, len, i);
+            if (!n) return false;
+            i += n;
+            continue;
+        }
+
+        bool closing = i + 1 < len && html[i + 1] == '/';
+        size_t name = i + (closing ? 2 : 1);
+        size_t j = name;
+        while (j < len && (islower((unsigned char)html[j]) || html[j] == '-')) j++;
+        size_t name_len = j - name;
+        if (!tag_allowed(html + name, name_len)) return false;
+
+        if (closing) {
+            if (j >= len || html[j] != '>' || depth == 0) return false;
+            depth--;
+            if (stack_len[depth] != name_len ||
+                strncmp(stack[depth], html + name, name_len) != 0) return false;
+            i = j + 1;
+            continue;
+        }
+
+        /* Attributes: name="value" ... */
+        while (j < len && html[j] == ' ') {
+            j++;
+            while (j < len && (islower((unsigned char)html[j]) || html[j] == '-')) j++;
+            if (j + 1 >= len || html[j] != '=' || html[j + 1] != '"') return false;
+            j += 2;
+            while (j < len && html[j] != '"') {
+                if (html[j] == '<') return false;
+                if (html[j] == '&') {
+                    size_t n = entity_len(html, len, j);
+                    if (!n) return false;
+                    j += n;
+                } else {
+                    j++;
+                }
+            }
+            if (j >= len) return false;
+            j++;
+        }
+        if (j >= len || html[j] != '>') return false;
+        if (depth == (int)(sizeof(stack) / sizeof(stack[0]))) return false;
+        stack[depth] = html + name;
+        stack_len[depth] = name_len;
+        depth++;
+        i = j + 1;
+    }
+    return depth == 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+#define TG_HTML_MAX_DEPTH   8       /* nested tags; deeper markers stay literal */
+#define TG_HTML_MAX_URL     512     /* longer link targets are dropped, text kept */
+
+/**
+ * Receives one finished chunk and the slice of the Markdown it came from
+ * (not NUL-terminated). Slices are consecutive and together cover the
+ * whole input. Return non-ESP_OK to stop converting.
+ */
+typedef esp_err_t (*tg_html_chunk_t)(const char *html, size_t len,
+                                     const char *src, size_t src_len, void *ctx);
+
+/**
+ * Markdown → Telegram HTML (parse_mode "HTML").
+ *
+ * Converts the Markdown an LLM writes (bold, italic, strike, inline and
+ * fenced code, links, headings, lists, quotes) in one pass. Markers without
+ * a partner on the same line stay literal and all other text is escaped, so
+ * the output always parses. Output is cut into chunks of at most max_len
+ * bytes, preferably at a line break or space, never inside a UTF-8 sequence
+ * or an entity. Tags open at a cut are closed at the end of the chunk and
+ * reopened at the start of the next one. Each chunk goes to emit as soon as
+ * it is full, so the first one can be sent while the rest is converted,
+ * along with the Markdown it covers (to send as plain text should the
+ * HTML ever be refused). Whitespace-only chunks are skipped.
+ *
+ * @param md       Markdown text
+ * @param len      Length of md
+ * @param max_len  Chunk size limit in bytes (>= 1024)
+ * @param emit     Chunk sink
+ * @return ESP_OK, or the first error returned by emit
+ */
+esp_err_t tg_html_from_markdown(const char *md, size_t len, size_t max_len,
+                                tg_html_chunk_t emit, void *ctx);
+
+/**
+ * Check that html would be accepted by Telegram: only supported tags,
+ * properly nested and closed, quoted attributes, and no bare '<' or '&'.
+ */
+bool tg_html_validate(const char *html, size_t len);
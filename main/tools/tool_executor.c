@@ -0,0 +1,136 @@
+#include "tool_executor.h"
+#include "tool_registry.h"
+#include "mimi_config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+static const char *TAG = "tool_exec";
+
+/*
+ * A batch is a run of calls that may overlap. The caller posts up to one helper
+ * token per pool task, then claims calls itself like any helper,
+ * so a batch always completes even when the pool is busy with another
+ * agent worker's batch. Tokens may be dequeued after the batch finished;
+ * the reference count keeps it alive until the last holder lets go.
+ */
+typedef struct {
+    tool_job_t  *jobs;
+    int          count;
+    int          next;          /* first unclaimed call */
+    int          done;
+    int          refs;
+    TaskHandle_t waiter;
+} batch_t;
+
+static QueueHandle_t     s_queue;   /* batch_t * helper tokens */
+static SemaphoreHandle_t s_lock;
+static int               s_workers;
+
+static void run_job(tool_job_t *job)
+{
+    job->output[0] = '\0';
+    job->err = tool_registry_execute(job->name, job->input_json, job->output, job->output_size);
+}
+
+/* Claim and run calls of b until none are left unclaimed */
+static void batch_work(batch_t *b)
+{
+    while (1) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        int i = b->next < b->count ? b->next++ : -1;
+        xSemaphoreGive(s_lock);
+        if (i < 0) return;
+
+        run_job(&b->jobs[i]);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool last = ++b->done == b->count;
+        xSemaphoreGive(s_lock);
+        if (last) xTaskNotifyGive(b->waiter);
+    }
+}
+
+static void batch_put(batch_t *b)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int refs = --b->refs;
+    xSemaphoreGive(s_lock);
+    if (refs == 0) free(b);
+}
+
+static void tool_worker_task(void *arg)
+{
+    while (1) {
+        batch_t *b;
+        if (xQueueReceive(s_queue, &b, portMAX_DELAY) != pdTRUE) continue;
+        batch_work(b);
+        batch_put(b);
+    }
+}
+
+static void run_concurrent(tool_job_t *jobs, int count)
+{
+    int helpers = count - 1 < s_workers ? count - 1 : s_workers;
+    batch_t *b = calloc(1, sizeof(*b));
+    if (!b || helpers == 0) {
+        free(b);
+        for (int i = 0; i < count; i++) run_job(&jobs[i]);
+        return;
+    }
+    b->jobs = jobs;
+    b->count = count;
+    b->refs = 1 + helpers;
+    b->waiter = xTaskGetCurrentTaskHandle();
+
+    for (int i = 0; i < helpers; i++) {
+        if (xQueueSend(s_queue, &b, 0) != pdTRUE) batch_put(b);
+    }
+
+    batch_work(b);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    batch_put(b);
+}
+
+esp_err_t tool_executor_init(void)
+{
+    s_lock = xSemaphoreCreateMutex();
+    s_queue = xQueueCreate(MIMI_TOOL_WORKERS * MIMI_AGENT_WORKERS, sizeof(batch_t *));
+    if (!s_lock || !s_queue) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < MIMI_TOOL_WORKERS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "tool_%d", i);
+        if (xTaskCreatePinnedToCore(tool_worker_task, name, MIMI_TOOL_STACK, NULL,
+                                    MIMI_TOOL_PRIO, NULL, MIMI_TOOL_CORE) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create %s", name);
+            break;
+        }
+        s_workers++;
+    }
+
+    ESP_LOGI(TAG, "Tool executor started (%d tasks)", s_workers);
+    return ESP_OK;
+}
+
+void tool_executor_run(tool_job_t *jobs, int count)
+{
+    int i = 0;
+    while (i < count) {
+        if (tool_registry_is_serial(jobs[i].name)) {
+            run_job(&jobs[i++]);
+            continue;
+        }
+
+        int end = i + 1;
+        while (end < count && !tool_registry_is_serial(jobs[end].name)) end++;
+        run_concurrent(&jobs[i], end - i);
+        i = end;
+    }
+}
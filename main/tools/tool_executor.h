@@ -0,0 +1,26 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+
+/** One tool call of a ReAct iteration. */
+typedef struct {
+    const char *name;
+    const char *input_json;
+    char       *output;         /* owned by the caller, one per call */
+    size_t      output_size;
+    esp_err_t   err;            /* set by tool_executor_run() */
+} tool_job_t;
+
+/**
+ * Start the tool task pool (MIMI_TOOL_WORKERS tasks).
+ */
+esp_err_t tool_executor_init(void);
+
+/**
+ * Execute jobs and return once all have finished, results in place.
+ * Consecutive calls run concurrently on the pool and the calling task. A
+ * tool registered as serial runs alone, after every call before it and
+ * before any call after it.
+ */
+void tool_executor_run(tool_job_t *jobs, int count);
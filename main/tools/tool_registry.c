@@ -4,7 +4,9 @@
 #include "tools/tool_files.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 
 static const char *TAG = "tools";
@@ -13,7 +15,7 @@ static const char *TAG = "tools";
 
 static mimi_tool_t s_tools[MAX_TOOLS];
 static int s_tool_count = 0;
-static char *s_tools_json = NULL;  /* cached JSON array string */
+static llm_tools_t s_manifests;    /* per-provider tool arrays (PSRAM) */
 
 static void register_tool(const mimi_tool_t *tool)
 {
@@ -25,28 +27,59 @@ static void register_tool(const mimi_tool_t *tool)
     ESP_LOGI(TAG, "Registered tool: %s", tool->name);
 }
 
-static void build_tools_json(void)
+/* Print a cJSON tree into an exact-size PSRAM string */
+static char *print_to_psram(const cJSON *json, size_t *len)
 {
-    cJSON *arr = cJSON_CreateArray();
+    char *printed = cJSON_PrintUnformatted(json);
+    if (!printed) return NULL;
+
+    *len = strlen(printed);
+    char *out = heap_caps_malloc(*len + 1, MALLOC_CAP_SPIRAM);
+    if (out) memcpy(out, printed, *len + 1);
+    free(printed);
+    return out;
+}
+
+/* Serialize the registered tools once for each provider's request format */
+static void build_manifests(void)
+{
+    cJSON *anthropic = cJSON_CreateArray();
+    cJSON *openai = cJSON_CreateArray();
 
     for (int i = 0; i < s_tool_count; i++) {
         cJSON *tool = cJSON_CreateObject();
         cJSON_AddStringToObject(tool, "name", s_tools[i].name);
         cJSON_AddStringToObject(tool, "description", s_tools[i].description);
 
+        cJSON *func = cJSON_CreateObject();
+        cJSON_AddStringToObject(func, "name", s_tools[i].name);
+        cJSON_AddStringToObject(func, "description", s_tools[i].description);
+
         cJSON *schema = cJSON_Parse(s_tools[i].input_schema_json);
         if (schema) {
+            cJSON_AddItemToObject(func, "parameters", cJSON_Duplicate(schema, true));
             cJSON_AddItemToObject(tool, "input_schema", schema);
+        } else {
+            ESP_LOGE(TAG, "Invalid input schema for tool %s", s_tools[i].name);
         }
 
-        cJSON_AddItemToArray(arr, tool);
+        cJSON *wrapper = cJSON_CreateObject();
+        cJSON_AddStringToObject(wrapper, "type", "function");
+        cJSON_AddItemToObject(wrapper, "function", func);
+
+        cJSON_AddItemToArray(anthropic, tool);
+        cJSON_AddItemToArray(openai, wrapper);
     }
 
-    free(s_tools_json);
-    s_tools_json = cJSON_PrintUnformatted(arr);
-    cJSON_Delete(arr);
+    free((void *)s_manifests.anthropic);
+    free((void *)s_manifests.openai);
+    s_manifests.anthropic = print_to_psram(anthropic, &s_manifests.anthropic_len);
+    s_manifests.openai = print_to_psram(openai, &s_manifests.openai_len);
+    cJSON_Delete(anthropic);
+    cJSON_Delete(openai);
 
-    ESP_LOGI(TAG, "Tools JSON built (%d tools)", s_tool_count);
+    ESP_LOGI(TAG, "Tool manifests built (%d tools, anthropic %d bytes, openai %d bytes)",
+             s_tool_count, (int)s_manifests.anthropic_len, (int)s_manifests.openai_len);
 }
 
 esp_err_t tool_registry_init(void)
@@ -70,7 +103,7 @@ esp_err_t tool_registry_init(void)
     /* Register get_current_time */
     mimi_tool_t gt = {
         .name = "get_current_time",
-        .description = "Get the current date and time. Also sets the system clock. Call this when you need to know what time or date it is.",
+        .description = "Get the current date and time. Call this when you need to know what time or date it is.",
         .input_schema_json =
             "{\"type\":\"object\","
             "\"properties\":{},"
@@ -101,6 +134,7 @@ esp_err_t tool_registry_init(void)
             "\"content\":{\"type\":\"string\",\"description\":\"File content to write\"}},"
             "\"required\":[\"path\",\"content\"]}",
         .execute = tool_write_file_execute,
+        .serial = true,
     };
     register_tool(&wf);
 
@@ -115,6 +149,7 @@ esp_err_t tool_registry_init(void)
             "\"new_string\":{\"type\":\"string\",\"description\":\"Replacement text\"}},"
             "\"required\":[\"path\",\"old_string\",\"new_string\"]}",
         .execute = tool_edit_file_execute,
+        .serial = true,
     };
     register_tool(&ef);
 
@@ -130,7 +165,7 @@ esp_err_t tool_registry_init(void)
     };
     register_tool(&ld);
 
-    build_tools_json();
+    build_manifests();
 
     ESP_LOGI(TAG, "Tool registry initialized");
     return ESP_OK;
@@ -138,7 +173,21 @@ esp_err_t tool_registry_init(void)
 
 const char *tool_registry_get_tools_json(void)
 {
-    return s_tools_json;
+    return s_manifests.anthropic;
+}
+
+const llm_tools_t *tool_registry_get_manifests(void)
+{
+    if (!s_manifests.anthropic || !s_manifests.openai) return NULL;
+    return &s_manifests;
+}
+
+bool tool_registry_is_serial(const char *name)
+{
+    for (int i = 0; i < s_tool_count; i++) {
+        if (strcmp(s_tools[i].name, name) == 0) return s_tools[i].serial;
+    }
+    return false;
 }
 
 esp_err_t tool_registry_execute(const char *name, const char *input_json,
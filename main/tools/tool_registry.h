@@ -2,12 +2,15 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include <stdbool.h>
+#include "llm/llm_proxy.h"
 
 typedef struct {
     const char *name;
     const char *description;
     const char *input_schema_json;  /* JSON Schema string for input */
     esp_err_t (*execute)(const char *input_json, char *output, size_t output_size);
+    bool serial;                    /* never runs alongside other calls (mutates files) */
 } mimi_tool_t;
 
 /**
@@ -21,6 +24,19 @@ esp_err_t tool_registry_init(void);
  */
 const char *tool_registry_get_tools_json(void);
 
+/**
+ * Get the tool arrays for both providers, serialized once at registration
+ * and kept in PSRAM for splicing into every request.
+ * Returns NULL if no tools are registered.
+ */
+const llm_tools_t *tool_registry_get_manifests(void);
+
+/**
+ * Whether a tool must run on its own rather than concurrently with the
+ * other calls of an iteration. False for unknown tools.
+ */
+bool tool_registry_is_serial(const char *name);
+
 /**
  * Execute a tool by name.
  *
@@ -1,12 +1,16 @@
 #include "tool_web_search.h"
 #include "mimi_config.h"
-#include "proxy/http_proxy.h"
+#include "http/http_client.h"
+#include "clock/clock_service.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
-#include "esp_http_client.h"
-#include "esp_crt_bundle.h"
 #include "esp_heap_caps.h"
 #include "nvs.h"
 #include "cJSON.h"
@@ -14,36 +18,293 @@
 static const char *TAG = "web_search";
 
 static char s_search_key[128] = {0};
+static http_session_t *s_session;
 
 #define SEARCH_BUF_SIZE     (16 * 1024)
 #define SEARCH_RESULT_COUNT 5
-
-/* ── Response accumulator ─────────────────────────────────────── */
+#define SEARCH_IDLE_MS      (30 * 1000)
+
+/* ── Result cache ─────────────────────────────────────────────── */
+
+/*
+ * Successful results are kept in a PSRAM hash table keyed by the normalized
+ * query (lowercased, whitespace collapsed), so a lookup the model repeats
+ * within MIMI_SEARCH_CACHE_TTL_S costs a copy instead of an API round trip.
+ * With MIMI_SEARCH_CACHE_PERSIST every new result is also appended to a
+ * JSONL spill file that is replayed after boot. Entries are judged by wall
+ * clock time, so the file is neither read nor written until the clock is
+ * synced; otherwise every entry would look stale and be compacted away.
+ * File I/O runs under its own lock, never under the table's, so a slow
+ * SPIFFS write does not hold up lookups.
+ */
+#define CACHE_PROBE     4           /* slots tried per key */
+#define CACHE_KEY_SIZE  256
+#define SPILL_LINE_SIZE (16 * 1024)
+#define SPILL_KEEP      (MIMI_SEARCH_CACHE_FILE_MAX / 2)   /* compaction writes at most this */
 
 typedef struct {
-    char *data;
-    size_t len;
-    size_t cap;
-} search_buf_t;
+    uint32_t hash;
+    time_t   stored;
+    char    *query;                 /* normalized, PSRAM; NULL if free */
+    char    *result;                /* PSRAM */
+} cache_entry_t;
+
+static cache_entry_t *s_cache;      /* MIMI_SEARCH_CACHE_SLOTS entries, PSRAM */
+static SemaphoreHandle_t s_cache_lock;
+static SemaphoreHandle_t s_spill_lock;  /* the spill file; taken before s_cache_lock */
+static unsigned s_hits;
+static unsigned s_misses;
+
+static void normalize_query(const char *src, char *dst, size_t size)
+{
+    size_t pos = 0;
+    bool gap = false;
+    for (; *src && pos < size - 1; src++) {
+        unsigned char c = (unsigned char)*src;
+        if (isspace(c)) {
+            gap = pos > 0;
+            continue;
+        }
+        if (gap) {
+            if (pos >= size - 2) break;
+            dst[pos++] = ' ';
+            gap = false;
+        }
+        dst[pos++] = (char)tolower(c);
+    }
+    dst[pos] = '\0';
+}
+
+static uint32_t fnv1a(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static char *psram_strdup(const char *s)
+{
+    size_t len = strlen(s);
+    char *copy = heap_caps_malloc(len + 1, MALLOC_CAP_SPIRAM);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+static bool entry_fresh(const cache_entry_t *e, time_t now)
+{
+    return e->query && now >= e->stored && now - e->stored < MIMI_SEARCH_CACHE_TTL_S;
+}
 
-static esp_err_t http_event_handler(esp_http_client_event_t *evt)
+static void entry_free(cache_entry_t *e)
 {
-    search_buf_t *sb = (search_buf_t *)evt->user_data;
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
-        size_t needed = sb->len + evt->data_len;
-        if (needed < sb->cap) {
-            memcpy(sb->data + sb->len, evt->data, evt->data_len);
-            sb->len += evt->data_len;
-            sb->data[sb->len] = '\0';
+    free(e->query);
+    free(e->result);
+    memset(e, 0, sizeof(*e));
+}
+
+/* Entry holding key, or NULL (lock held) */
+static cache_entry_t *cache_lookup(const char *key, uint32_t hash)
+{
+    for (int i = 0; i < CACHE_PROBE; i++) {
+        cache_entry_t *e = &s_cache[(hash + i) % MIMI_SEARCH_CACHE_SLOTS];
+        if (e->query && e->hash == hash && strcmp(e->query, key) == 0) return e;
+    }
+    return NULL;
+}
+
+/* Store under key, reusing its slot, a stale one or the oldest probed (lock held) */
+static void cache_store(const char *key, uint32_t hash, const char *result, time_t stored)
+{
+    time_t now = time(NULL);
+    cache_entry_t *slot = cache_lookup(key, hash);
+    for (int i = 0; !slot && i < CACHE_PROBE; i++) {
+        cache_entry_t *e = &s_cache[(hash + i) % MIMI_SEARCH_CACHE_SLOTS];
+        if (!entry_fresh(e, now)) slot = e;
+    }
+    if (!slot) {
+        slot = &s_cache[hash % MIMI_SEARCH_CACHE_SLOTS];
+        for (int i = 1; i < CACHE_PROBE; i++) {
+            cache_entry_t *e = &s_cache[(hash + i) % MIMI_SEARCH_CACHE_SLOTS];
+            if (e->stored < slot->stored) slot = e;
         }
     }
-    return ESP_OK;
+
+    char *query = psram_strdup(key);
+    char *copy = psram_strdup(result);
+    if (!query || !copy) {
+        free(query);
+        free(copy);
+        return;
+    }
+    entry_free(slot);
+    *slot = (cache_entry_t){ .hash = hash, .stored = stored, .query = query, .result = copy };
+}
+
+#if MIMI_SEARCH_CACHE_PERSIST
+static void spill_write(FILE *f, const char *key, const char *result, time_t stored)
+{
+    cJSON *obj = cJSON_CreateObject();
+    cJSON_AddStringToObject(obj, "q", key);
+    cJSON_AddNumberToObject(obj, "ts", (double)stored);
+    cJSON_AddStringToObject(obj, "r", result);
+    char *line = cJSON_PrintUnformatted(obj);
+    cJSON_Delete(obj);
+    if (line) {
+        fprintf(f, "%s\n", line);
+        free(line);
+    }
+}
+
+/*
+ * Rewrite the spill file with the newest live entries, at most SPILL_KEEP
+ * bytes of them, so it takes another half-file of appends to get here
+ * again. The entries are copied under the table lock and written without
+ * it (spill lock held).
+ */
+static void spill_compact(void)
+{
+    cache_entry_t *keep = heap_caps_calloc(MIMI_SEARCH_CACHE_SLOTS, sizeof(cache_entry_t),
+                                           MALLOC_CAP_SPIRAM);
+    if (!keep) return;
+
+    int order[MIMI_SEARCH_CACHE_SLOTS];
+    int count = 0, kept = 0;
+    size_t bytes = 0;
+    time_t now = time(NULL);
+
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_SEARCH_CACHE_SLOTS; i++) {
+        if (!entry_fresh(&s_cache[i], now)) continue;
+        /* Newest first */
+        int at = count++;
+        while (at > 0 && s_cache[order[at - 1]].stored < s_cache[i].stored) {
+            order[at] = order[at - 1];
+            at--;
+        }
+        order[at] = i;
+    }
+    for (int n = 0; n < count; n++) {
+        const cache_entry_t *e = &s_cache[order[n]];
+        size_t line = strlen(e->query) + strlen(e->result) + 32;
+        if (bytes + line > SPILL_KEEP) continue;    /* a smaller, older one may still fit */
+        cache_entry_t *k = &keep[kept];
+        k->query = psram_strdup(e->query);
+        k->result = psram_strdup(e->result);
+        k->stored = e->stored;
+        if (!k->query || !k->result) {
+            entry_free(k);
+            continue;
+        }
+        bytes += line;
+        kept++;
+    }
+    xSemaphoreGive(s_cache_lock);
+
+    /* Oldest first, as appends would have left them */
+    FILE *f = fopen(MIMI_SEARCH_CACHE_FILE, "w");
+    for (int n = kept - 1; n >= 0; n--) {
+        if (f) spill_write(f, keep[n].query, keep[n].result, keep[n].stored);
+        entry_free(&keep[n]);
+    }
+    if (f) fclose(f);
+    free(keep);
+    ESP_LOGI(TAG, "Search spill compacted: %d of %d live results kept", kept, count);
+}
+
+/* Replay the spill file into the table; later lines win (spill lock held) */
+static void spill_load(void)
+{
+    FILE *f = fopen(MIMI_SEARCH_CACHE_FILE, "r");
+    if (!f) return;
+
+    char *line = heap_caps_malloc(SPILL_LINE_SIZE, MALLOC_CAP_SPIRAM);
+    if (!line) {
+        fclose(f);
+        return;
+    }
+
+    int loaded = 0;
+    time_t now = time(NULL);
+    while (fgets(line, SPILL_LINE_SIZE, f)) {
+        cJSON *obj = cJSON_Parse(line);
+        if (!obj) continue;
+        const char *q = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "q"));
+        const char *r = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "r"));
+        cJSON *ts = cJSON_GetObjectItem(obj, "ts");
+        if (q && r && cJSON_IsNumber(ts)) {
+            cache_entry_t probe = { .query = (char *)q, .stored = (time_t)ts->valuedouble };
+            if (entry_fresh(&probe, now)) {
+                xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+                cache_store(q, fnv1a(q), r, probe.stored);
+                xSemaphoreGive(s_cache_lock);
+                loaded++;
+            }
+        }
+        cJSON_Delete(obj);
+    }
+    long size = ftell(f);
+    fclose(f);
+    free(line);
+
+    if (size > MIMI_SEARCH_CACHE_FILE_MAX) spill_compact();
+    ESP_LOGI(TAG, "Search cache: %d results restored from flash", loaded);
+}
+
+/* True once the spill file can be used; replays it on the first call after
+ * the clock is synced (spill lock held) */
+static bool spill_ready(void)
+{
+    static bool loaded;
+    if (!loaded && clock_service_synced()) {
+        spill_load();
+        loaded = true;
+    }
+    return loaded;
+}
+
+/* Load the spill file if it is due; call without s_cache_lock */
+static void spill_prepare(void)
+{
+    xSemaphoreTake(s_spill_lock, portMAX_DELAY);
+    spill_ready();
+    xSemaphoreGive(s_spill_lock);
+}
+
+/* Persist one new result; call without s_cache_lock */
+static void spill_append(const char *key, const char *result, time_t stored)
+{
+    xSemaphoreTake(s_spill_lock, portMAX_DELAY);
+    if (spill_ready()) {
+        FILE *f = fopen(MIMI_SEARCH_CACHE_FILE, "a");
+        if (f) {
+            spill_write(f, key, result, stored);
+            long size = ftell(f);
+            fclose(f);
+            if (size > MIMI_SEARCH_CACHE_FILE_MAX) spill_compact();
+        } else {
+            ESP_LOGW(TAG, "Cannot open %s", MIMI_SEARCH_CACHE_FILE);
+        }
+    }
+    xSemaphoreGive(s_spill_lock);
 }
+#endif
 
 /* ── Init ─────────────────────────────────────────────────────── */
 
 esp_err_t tool_web_search_init(void)
 {
+    s_session = http_session_create("search", SEARCH_IDLE_MS);
+
+    s_cache = heap_caps_calloc(MIMI_SEARCH_CACHE_SLOTS, sizeof(cache_entry_t), MALLOC_CAP_SPIRAM);
+    s_cache_lock = xSemaphoreCreateMutex();
+    s_spill_lock = xSemaphoreCreateMutex();
+    if (!s_cache || !s_cache_lock || !s_spill_lock) {
+        ESP_LOGE(TAG, "Failed to allocate search cache");
+        return ESP_ERR_NO_MEM;
+    }
     /* Start with build-time default */
     if (MIMI_SECRET_SEARCH_KEY[0] != '\0') {
         strncpy(s_search_key, MIMI_SECRET_SEARCH_KEY, sizeof(s_search_key) - 1);
@@ -130,98 +391,6 @@ static void format_results(cJSON *root, char *output, size_t output_size)
     }
 }
 
-/* ── Direct HTTPS request ─────────────────────────────────────── */
-
-static esp_err_t search_direct(const char *url, search_buf_t *sb)
-{
-    esp_http_client_config_t config = {
-        .url = url,
-        .event_handler = http_event_handler,
-        .user_data = sb,
-        .timeout_ms = 15000,
-        .buffer_size = 4096,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (!client) return ESP_FAIL;
-
-    esp_http_client_set_header(client, "Accept", "application/json");
-    esp_http_client_set_header(client, "X-Subscription-Token", s_search_key);
-
-    esp_err_t err = esp_http_client_perform(client);
-    int status = esp_http_client_get_status_code(client);
-    esp_http_client_cleanup(client);
-
-    if (err != ESP_OK) return err;
-    if (status != 200) {
-        ESP_LOGE(TAG, "Search API returned %d", status);
-        return ESP_FAIL;
-    }
-    return ESP_OK;
-}
-
-/* ── Proxy HTTPS request ──────────────────────────────────────── */
-
-static esp_err_t search_via_proxy(const char *path, search_buf_t *sb)
-{
-    proxy_conn_t *conn = proxy_conn_open("api.search.brave.com", 443, 15000);
-    if (!conn) return ESP_ERR_HTTP_CONNECT;
-
-    char header[512];
-    int hlen = snprintf(header, sizeof(header),
-        "GET %s HTTP/1.1\r\n"
-        "Host: api.search.brave.com\r\n"
-        "Accept: application/json\r\n"
-        "X-Subscription-Token: %s\r\n"
-        "Connection: close\r\n\r\n",
-        path, s_search_key);
-
-    if (proxy_conn_write(conn, header, hlen) < 0) {
-        proxy_conn_close(conn);
-        return ESP_ERR_HTTP_WRITE_DATA;
-    }
-
-    /* Read full response */
-    char tmp[4096];
-    size_t total = 0;
-    while (1) {
-        int n = proxy_conn_read(conn, tmp, sizeof(tmp), 15000);
-        if (n <= 0) break;
-        size_t copy = (total + n < sb->cap - 1) ? (size_t)n : sb->cap - 1 - total;
-        if (copy > 0) {
-            memcpy(sb->data + total, tmp, copy);
-            total += copy;
-        }
-    }
-    sb->data[total] = '\0';
-    sb->len = total;
-    proxy_conn_close(conn);
-
-    /* Check status */
-    int status = 0;
-    if (total > 5 && strncmp(sb->data, "HTTP/", 5) == 0) {
-        const char *sp = strchr(sb->data, ' ');
-        if (sp) status = atoi(sp + 1);
-    }
-
-    /* Strip headers */
-    char *body = strstr(sb->data, "\r\n\r\n");
-    if (body) {
-        body += 4;
-        size_t blen = total - (body - sb->data);
-        memmove(sb->data, body, blen);
-        sb->len = blen;
-        sb->data[sb->len] = '\0';
-    }
-
-    if (status != 200) {
-        ESP_LOGE(TAG, "Search API returned %d via proxy", status);
-        return ESP_FAIL;
-    }
-    return ESP_OK;
-}
-
 /* ── Execute ──────────────────────────────────────────────────── */
 
 esp_err_t tool_web_search_execute(const char *input_json, char *output, size_t output_size)
@@ -245,6 +414,27 @@ esp_err_t tool_web_search_execute(const char *input_json, char *output, size_t o
         return ESP_ERR_INVALID_ARG;
     }
 
+    /* Serve repeated lookups from the cache */
+    char key[CACHE_KEY_SIZE];
+    normalize_query(query->valuestring, key, sizeof(key));
+    uint32_t hash = fnv1a(key);
+
+#if MIMI_SEARCH_CACHE_PERSIST
+    spill_prepare();
+#endif
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    const cache_entry_t *hit = cache_lookup(key, hash);
+    if (hit && entry_fresh(hit, time(NULL))) {
+        snprintf(output, output_size, "%s", hit->result);
+        s_hits++;
+        xSemaphoreGive(s_cache_lock);
+        cJSON_Delete(input);
+        ESP_LOGI(TAG, "Cache hit: %s", key);
+        return ESP_OK;
+    }
+    s_misses++;
+    xSemaphoreGive(s_cache_lock);
+
     ESP_LOGI(TAG, "Searching: %s", query->valuestring);
 
     /* Build URL */
@@ -256,34 +446,38 @@ esp_err_t tool_web_search_execute(const char *input_json, char *output, size_t o
     snprintf(path, sizeof(path),
              "/res/v1/web/search?q=%s&count=%d", encoded_query, SEARCH_RESULT_COUNT);
 
-    /* Allocate response buffer from PSRAM */
-    search_buf_t sb = {0};
-    sb.data = heap_caps_calloc(1, SEARCH_BUF_SIZE, MALLOC_CAP_SPIRAM);
-    if (!sb.data) {
-        snprintf(output, output_size, "Error: Out of memory");
-        return ESP_ERR_NO_MEM;
-    }
-    sb.cap = SEARCH_BUF_SIZE;
+    char url[512];
+    snprintf(url, sizeof(url), "https://api.search.brave.com%s", path);
+
+    const http_header_t headers[] = {
+        { "Accept", "application/json" },
+        { "X-Subscription-Token", s_search_key },
+    };
+    http_request_t req = {
+        .url = url,
+        .headers = headers,
+        .header_count = 2,
+        .timeout_ms = 15000,
+        .max_body = SEARCH_BUF_SIZE,
+    };
 
     /* Make HTTP request */
-    esp_err_t err;
-    if (http_proxy_is_enabled()) {
-        err = search_via_proxy(path, &sb);
-    } else {
-        char url[512];
-        snprintf(url, sizeof(url), "https://api.search.brave.com%s", path);
-        err = search_direct(url, &sb);
+    http_response_t resp;
+    esp_err_t err = http_client_perform(s_session, &req, &resp);
+    if (err == ESP_OK && resp.status != 200) {
+        ESP_LOGE(TAG, "Search API returned %d", resp.status);
+        http_response_free(&resp);
+        err = ESP_FAIL;
     }
 
     if (err != ESP_OK) {
-        free(sb.data);
         snprintf(output, output_size, "Error: Search request failed");
         return err;
     }
 
     /* Parse and format results */
-    cJSON *root = cJSON_Parse(sb.data);
-    free(sb.data);
+    cJSON *root = cJSON_Parse(resp.body);
+    http_response_free(&resp);
 
     if (!root) {
         snprintf(output, output_size, "Error: Failed to parse search results");
@@ -293,6 +487,14 @@ esp_err_t tool_web_search_execute(const char *input_json, char *output, size_t o
     format_results(root, output, output_size);
     cJSON_Delete(root);
 
+    time_t now = time(NULL);
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    cache_store(key, hash, output, now);
+    xSemaphoreGive(s_cache_lock);
+#if MIMI_SEARCH_CACHE_PERSIST
+    spill_append(key, output, now);
+#endif
+
     ESP_LOGI(TAG, "Search complete, %d bytes result", (int)strlen(output));
     return ESP_OK;
 }
@@ -309,3 +511,35 @@ esp_err_t tool_web_search_set_key(const char *api_key)
     ESP_LOGI(TAG, "Search API key saved");
     return ESP_OK;
 }
+
+void tool_web_search_cache_stats(web_search_cache_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!s_cache_lock) return;
+
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    stats->hits = s_hits;
+    stats->misses = s_misses;
+    time_t now = time(NULL);
+    for (int i = 0; i < MIMI_SEARCH_CACHE_SLOTS; i++) {
+        if (entry_fresh(&s_cache[i], now)) stats->entries++;
+    }
+    xSemaphoreGive(s_cache_lock);
+}
+
+void tool_web_search_cache_clear(void)
+{
+    if (!s_cache_lock) return;
+
+    xSemaphoreTake(s_spill_lock, portMAX_DELAY);
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_SEARCH_CACHE_SLOTS; i++) {
+        entry_free(&s_cache[i]);
+    }
+    xSemaphoreGive(s_cache_lock);
+#if MIMI_SEARCH_CACHE_PERSIST
+    remove(MIMI_SEARCH_CACHE_FILE);
+#endif
+    xSemaphoreGive(s_spill_lock);
+    ESP_LOGI(TAG, "Search cache cleared");
+}
@@ -22,3 +22,15 @@ esp_err_t tool_web_search_execute(const char *input_json, char *output, size_t o
  * Save Brave Search API key to NVS.
  */
 esp_err_t tool_web_search_set_key(const char *api_key);
+
+typedef struct {
+    unsigned hits;
+    unsigned misses;
+    int      entries;       /* live (unexpired) cached queries */
+} web_search_cache_stats_t;
+
+/** Result cache counters since boot. */
+void tool_web_search_cache_stats(web_search_cache_stats_t *stats);
+
+/** Drop every cached result, in PSRAM and on SPIFFS. */
+void tool_web_search_cache_clear(void);
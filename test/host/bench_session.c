@@ -0,0 +1,19 @@
+/*
+ * Host run of the session_bench CLI command: grows a JSONL session file from
+ * 100 records by powers of ten and times the tail read a cache miss takes.
+ *
+ *   bench_session [max_records]     (default 100000)
+ */
+#include "memory/session_mgr.h"
+#include "mimi_config.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
+
+int main(int argc, char **argv)
+{
+    int max_records = argc > 1 ? atoi(argv[1]) : 100000;
+    mkdir(MIMI_SPIFFS_SESSION_DIR, 0755);
+    session_bench(max_records);
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include "host_test.h"
+
+#include <stdlib.h>
+
+int host_test_failures;
+
+char *host_read_file(const char *dir, const char *name, size_t *len)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open fixture %s\n", path);
+        exit(2);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(size + 1);
+    if (!buf || fread(buf, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "Cannot read fixture %s\n", path);
+        exit(2);
+    }
+    fclose(f);
+    buf[size] = '\0';
+    *len = (size_t)size;
+    return buf;
+}
+
+int host_test_done(const char *name)
+{
+    if (host_test_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, host_test_failures);
+        return 1;
+    }
+    printf("%s: all checks passed\n", name);
+    return 0;
+}
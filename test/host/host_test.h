@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Minimal assertions: failures are counted and reported, the test goes on */
+extern int host_test_failures;
+
+#define CHECK(cond) do {                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            host_test_failures++;                                           \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_STR(actual, expected) do {                                    \
+        const char *a_ = (actual), *e_ = (expected);                        \
+        if (!a_ || strcmp(a_, e_) != 0) {                                   \
+            fprintf(stderr, "%s:%d: expected \"%s\", got \"%s\"\n",          \
+                    __FILE__, __LINE__, e_, a_ ? a_ : "(null)");            \
+            host_test_failures++;                                           \
+        }                                                                   \
+    } while (0)
+
+/** Read dir/name into a NUL-terminated malloc'd buffer; exits if missing. */
+char *host_read_file(const char *dir, const char *name, size_t *len);
+
+/** Print a summary and return the process exit code. */
+int host_test_done(const char *name);
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+
+static inline void *heap_caps_malloc(size_t size, uint32_t caps) { return malloc(size); }
+static inline void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) { return calloc(n, size); }
+static inline void *heap_caps_realloc(void *p, size_t size, uint32_t caps) { return realloc(p, size); }
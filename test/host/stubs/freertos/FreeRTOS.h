@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Host tests are single-threaded: locks always succeed */
+#define pdTRUE          1
+#define pdFALSE         0
+#define portMAX_DELAY   0xFFFFFFFFu
@@ -0,0 +1,118 @@
+#include "host_partition.h"
+#include "esp_rom_crc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static esp_partition_t s_part;
+static FILE *s_file;
+static size_t s_tear = (size_t)-1;
+static unsigned s_erases;
+
+const esp_partition_t *host_partition_open(const char *label, const char *path,
+                                           size_t size, size_t erase_size)
+{
+    host_partition_close();
+    s_file = fopen(path, "r+b");
+    if (!s_file) {
+        /* New flash reads as erased */
+        s_file = fopen(path, "w+b");
+        if (!s_file) return NULL;
+        for (size_t i = 0; i < size; i++) fputc(0xFF, s_file);
+    }
+    memset(&s_part, 0, sizeof(s_part));
+    s_part.type = ESP_PARTITION_TYPE_DATA;
+    s_part.subtype = ESP_PARTITION_SUBTYPE_ANY;
+    s_part.size = (uint32_t)size;
+    s_part.erase_size = (uint32_t)erase_size;
+    snprintf(s_part.label, sizeof(s_part.label), "%s", label);
+    return &s_part;
+}
+
+void host_partition_close(void)
+{
+    if (s_file) fclose(s_file);
+    s_file = NULL;
+    s_part.label[0] = '\0';
+}
+
+void host_partition_tear_next_write(size_t keep)
+{
+    s_tear = keep;
+}
+
+unsigned host_partition_erases(void)
+{
+    return s_erases;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    if (!s_file || type != s_part.type || strcmp(label, s_part.label) != 0) return NULL;
+    return &s_part;
+}
+
+static bool in_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    return part == &s_part && s_file && offset <= part->size && size <= part->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    if (!in_range(part, offset, size)) return ESP_ERR_INVALID_SIZE;
+    if (fseek(s_file, (long)offset, SEEK_SET) != 0 || fread(dst, 1, size, s_file) != size) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    if (!in_range(part, offset, size)) return ESP_ERR_INVALID_SIZE;
+
+    size_t n = size;
+    bool torn = s_tear != (size_t)-1;
+    if (torn) {
+        n = s_tear < size ? s_tear : size;
+        s_tear = (size_t)-1;
+    }
+
+    /* NOR flash: programming only turns 1 bits into 0 */
+    uint8_t *cell = malloc(n ? n : 1);
+    esp_err_t err = esp_partition_read(part, offset, cell, n);
+    if (err == ESP_OK) {
+        for (size_t i = 0; i < n; i++) cell[i] &= ((const uint8_t *)src)[i];
+        if (fseek(s_file, (long)offset, SEEK_SET) != 0 || fwrite(cell, 1, n, s_file) != n) {
+            err = ESP_FAIL;
+        }
+        fflush(s_file);
+    }
+    free(cell);
+    return err == ESP_OK && torn ? ESP_FAIL : err;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if (!in_range(part, offset, size)) return ESP_ERR_INVALID_SIZE;
+    if (offset % part->erase_size || size % part->erase_size) return ESP_ERR_INVALID_ARG;
+
+    if (fseek(s_file, (long)offset, SEEK_SET) != 0) return ESP_FAIL;
+    for (size_t i = 0; i < size; i++) fputc(0xFF, s_file);
+    fflush(s_file);
+    s_erases += size / part->erase_size;
+    return ESP_OK;
+}
+
+/* Same polynomial and conditioning as the ROM routine */
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+    }
+    return ~crc;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "esp_partition.h"
+
+/*
+ * File-backed flash partition for host tests. Behaves like NOR flash:
+ * erase sets whole sectors to 0xFF and writes can only clear bits. The file
+ * persists across session_log_unmount()/mount, which stands in for a reboot.
+ */
+
+/** Register (or reopen) the partition `label` backed by path. */
+const esp_partition_t *host_partition_open(const char *label, const char *path,
+                                           size_t size, size_t erase_size);
+
+/** Unregister the partition and close its file. */
+void host_partition_close(void);
+
+/** Power cut: the next write stores only its first `keep` bytes and fails. */
+void host_partition_tear_next_write(size_t keep);
+
+/** Sector erases performed so far. */
+unsigned host_partition_erases(void);
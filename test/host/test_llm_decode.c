@@ -0,0 +1,206 @@
+/*
+ * Replays recorded non-streaming response bodies through llm_decode, whole,
+ * one byte at a time and split at every offset, and checks the decoded
+ * llm_response_t field by field.
+ */
+#include "host_test.h"
+#include "llm/llm_decode.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *s_dir;
+
+typedef struct {
+    const char *id;
+    const char *name;
+    const char *input;
+} expect_call_t;
+
+typedef struct {
+    const char         *file;
+    llm_stream_format_t format;
+    bool                ok;         /* decode succeeds */
+    const char         *text;       /* NULL: no text */
+    bool                tool_use;
+    int                 call_count;
+    expect_call_t       calls[MIMI_MAX_TOOL_CALLS];
+} expect_t;
+
+static const expect_t s_cases[] = {
+    {
+        .file = "anthropic_text.json",
+        .format = LLM_STREAM_ANTHROPIC,
+        .ok = true,
+        .text = "It's 23\xC2\xB0" "C in Taipei right now \xE2\x80\x94 light rain later.\n"
+                "Bring an umbrella \xF0\x9F\x8C\x82.",
+    },
+    {
+        /* Text plus two tool_use blocks; input is the raw object span */
+        .file = "anthropic_tool_use.json",
+        .format = LLM_STREAM_ANTHROPIC,
+        .ok = true,
+        .text = "Let me look both up.",
+        .tool_use = true,
+        .call_count = 2,
+        .calls = {
+            { "toolu_01A09q90qw90lq917835lq9", "web_search",
+              "{\"query\":\"ESP32-S3 \\\"PSRAM\\\" bandwidth\","
+              "\"filters\":{\"site\":[\"espressif.com\",\"esp32.com\"],\"recent\":true},\"count\":5}" },
+            { "toolu_01B7xk2LmN4pQrS8tUvWxYz", "get_current_time", "{}" },
+        },
+    },
+    {
+        /* Pretty-printed, "type" last: the span keeps its whitespace */
+        .file = "anthropic_tool_use_pretty.json",
+        .format = LLM_STREAM_ANTHROPIC,
+        .ok = true,
+        .tool_use = true,
+        .call_count = 1,
+        .calls = {
+            { "toolu_01Zx9Cv8Bn7Mm6Ll5Kk4Jj3H", "write_file",
+              "{\n"
+              "        \"path\": \"/spiffs/memory/MEMORY.md\",\n"
+              "        \"content\": \"- likes {braces} and [brackets]\\n- \\\"quoted\\\" \\\\ backslash\"\n"
+              "      }" },
+        },
+    },
+    {
+        .file = "anthropic_error.json",
+        .format = LLM_STREAM_ANTHROPIC,
+        .ok = false,
+    },
+    {
+        .file = "openai_text.json",
+        .format = LLM_STREAM_OPENAI,
+        .ok = true,
+        .text = "Hello! \xF0\x9F\x91\x8B How can I help?\nTabs\tand \"quotes\" survive.",
+    },
+    {
+        /* arguments strings are unescaped once; \\u stays literal */
+        .file = "openai_tool_calls.json",
+        .format = LLM_STREAM_OPENAI,
+        .ok = true,
+        .tool_use = true,
+        .call_count = 3,
+        .calls = {
+            { "call_62136354", "web_search", "{\"query\":\"weather in Taipei\",\"count\":3}" },
+            { "call_62136355", "get_current_time", "{}" },
+            { "call_62136356", "read_file",
+              "{\"path\":\"/spiffs/memory/notes \\u00e9t\\u00e9.md\"}" },
+        },
+    },
+};
+
+static void free_response(llm_response_t *resp)
+{
+    free(resp->text);
+    for (int i = 0; i < resp->call_count; i++) free(resp->calls[i].input);
+    memset(resp, 0, sizeof(*resp));
+}
+
+/* Decode body fed as slices cut at the given offsets (ascending) */
+static esp_err_t decode(const expect_t *e, const char *body, size_t len,
+                        const size_t *cuts, int ncuts, llm_response_t *resp)
+{
+    llm_decoder_t d;
+    memset(resp, 0, sizeof(*resp));
+    llm_decode_init(&d, e->format, resp);
+
+    size_t from = 0;
+    for (int i = 0; i <= ncuts; i++) {
+        size_t to = i < ncuts ? cuts[i] : len;
+        /* Copy each slice so reads past its end are caught */
+        char *slice = malloc(to - from + 1);
+        memcpy(slice, body + from, to - from);
+        esp_err_t err = llm_decode_feed(&d, slice, to - from);
+        free(slice);
+        if (err != ESP_OK) return err;
+        from = to;
+    }
+    return llm_decode_finish(&d);
+}
+
+static void check_response(const expect_t *e, esp_err_t err, const llm_response_t *resp,
+                           const char *how)
+{
+    int before = host_test_failures;
+
+    CHECK((err == ESP_OK) == e->ok);
+    if (!e->ok) goto out;
+
+    if (e->text) {
+        CHECK_STR(resp->text, e->text);
+        CHECK(resp->text && resp->text_len == strlen(e->text));
+    } else {
+        CHECK(resp->text_len == 0);
+    }
+    CHECK(resp->tool_use == e->tool_use);
+    CHECK(resp->call_count == e->call_count);
+    for (int i = 0; i < e->call_count && i < resp->call_count; i++) {
+        const llm_tool_call_t *call = &resp->calls[i];
+        CHECK_STR(call->id, e->calls[i].id);
+        CHECK_STR(call->name, e->calls[i].name);
+        CHECK_STR(call->input, e->calls[i].input);
+        CHECK(call->input && call->input_len == strlen(e->calls[i].input));
+    }
+
+out:
+    if (host_test_failures != before) fprintf(stderr, "  ^ %s, %s\n", e->file, how);
+}
+
+static void run_case(const expect_t *e)
+{
+    size_t len;
+    char *body = host_read_file(s_dir, e->file, &len);
+    llm_response_t resp;
+    char how[64];
+
+    check_response(e, decode(e, body, len, NULL, 0, &resp), &resp, "whole body");
+    free_response(&resp);
+
+    /* Every two-slice split */
+    for (size_t cut = 1; cut < len; cut++) {
+        esp_err_t err = decode(e, body, len, &cut, 1, &resp);
+        snprintf(how, sizeof(how), "split at %u", (unsigned)cut);
+        check_response(e, err, &resp, how);
+        free_response(&resp);
+        if (host_test_failures > 20) break;
+    }
+
+    /* One byte per slice */
+    size_t *cuts = malloc(len * sizeof(*cuts));
+    for (size_t i = 0; i + 1 < len; i++) cuts[i] = i + 1;
+    check_response(e, decode(e, body, len, cuts, (int)len - 1, &resp), &resp, "byte by byte");
+    free_response(&resp);
+    free(cuts);
+
+    /* A body cut short never decodes */
+    while (len > 0 && (body[len - 1] == '\n' || body[len - 1] == ' ')) len--;
+    CHECK(decode(e, body, len - 1, NULL, 0, &resp) != ESP_OK);
+    free_response(&resp);
+
+    free(body);
+}
+
+int main(int argc, char **argv)
+{
+    s_dir = argc > 1 ? argv[1] : "fixtures/llm";
+    for (size_t i = 0; i < sizeof(s_cases) / sizeof(s_cases[0]); i++) {
+        run_case(&s_cases[i]);
+    }
+
+    /* Garbage and trailing data are rejected */
+    static const expect_t garbage = { .file = "inline", .format = LLM_STREAM_ANTHROPIC };
+    llm_response_t resp;
+    static const char *bad[] = {
+        "{\"content\":[}", "{\"stop_reason\" \"x\"}", "{} {}", "[1,2,]x", "{\"a\":\"\\q\"}",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        check_response(&garbage, decode(&garbage, bad[i], strlen(bad[i]), NULL, 0, &resp),
+                       &resp, bad[i]);
+        free_response(&resp);
+    }
+
+    return host_test_done("llm_decode");
+}
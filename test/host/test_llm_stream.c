@@ -0,0 +1,217 @@
+/*
+ * Replays recorded server-sent event streams through llm_stream, cut at
+ * awkward places: every single offset (inside "data:", between '\r' and
+ * '\n', inside UTF-8 sequences and JSON escapes), one byte at a time, and
+ * at random multi-way splits. Text deltas, the on_token sequence and
+ * input_json_delta / tool_calls argument reassembly are checked per run.
+ */
+#include "host_test.h"
+#include "llm/llm_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char *s_dir;
+
+typedef struct {
+    const char *id;
+    const char *name;
+    const char *input;
+} expect_call_t;
+
+typedef struct {
+    const char         *file;
+    llm_stream_format_t format;
+    bool                ok;
+    const char         *text;
+    int                 tokens;     /* non-empty text deltas */
+    bool                tool_use;
+    int                 call_count;
+    expect_call_t       calls[MIMI_MAX_TOOL_CALLS];
+} expect_t;
+
+static const expect_t s_cases[] = {
+    {
+        .file = "anthropic_stream.sse",
+        .format = LLM_STREAM_ANTHROPIC,
+        .ok = true,
+        .text = "Let me check the weather in Taipei \xE2\x80\x94 and the time \xF0\x9F\x95\x92.\n",
+        .tokens = 5,
+        .tool_use = true,
+        .call_count = 2,
+        .calls = {
+            { "toolu_01T1x2y3z4A5b6C7d8E9f0Gh", "web_search",
+              "{\"query\": \"Taipei weather \\\"today\\\"\", \"count\": 3}" },
+            { "toolu_01U2v3W4x5Y6z7A8b9C0dEfG", "get_current_time", "{}" },
+        },
+    },
+    {
+        /* CRLF line ends, a keep-alive comment, one event's data on two lines */
+        .file = "anthropic_stream_crlf.sse",
+        .format = LLM_STREAM_ANTHROPIC,
+        .ok = true,
+        .text = "Bonjour \xE2\x80\x94 \xC3\xA7" "a va tr\xC3\xA8s bien \xF0\x9F\x98\x80!",
+        .tokens = 4,
+    },
+    {
+        .file = "anthropic_stream_error.sse",
+        .format = LLM_STREAM_ANTHROPIC,
+        .ok = false,
+    },
+    {
+        /* Interleaved tool_calls fragments, usage-only chunk, [DONE] */
+        .file = "openai_stream.sse",
+        .format = LLM_STREAM_OPENAI,
+        .ok = true,
+        .text = "Sure \xE2\x80\x94 checking now \xF0\x9F\x94\x8D",
+        .tokens = 3,
+        .tool_use = true,
+        .call_count = 3,
+        .calls = {
+            { "call_Ab12Cd34", "web_search", "{\"query\":\"Taipei \\\"weather\\\"\"}" },
+            { "call_Ef56Gh78", "read_file", "{\"path\":\"/spiffs/memory/MEMORY.md\"}" },
+            { "call_Ij90Kl12", "get_current_time", "{}" },
+        },
+    },
+};
+
+typedef struct {
+    char  *text;
+    size_t len;
+    int    count;
+} tokens_t;
+
+static void on_token(const char *text, size_t len, void *ctx)
+{
+    tokens_t *t = (tokens_t *)ctx;
+    t->text = realloc(t->text, t->len + len + 1);
+    memcpy(t->text + t->len, text, len);
+    t->len += len;
+    t->text[t->len] = '\0';
+    t->count++;
+}
+
+static void free_response(llm_response_t *resp)
+{
+    free(resp->text);
+    for (int i = 0; i < resp->call_count; i++) free(resp->calls[i].input);
+    memset(resp, 0, sizeof(*resp));
+}
+
+/* Feed body as slices cut at the given ascending offsets */
+static esp_err_t replay(const expect_t *e, const char *body, size_t len,
+                        const size_t *cuts, int ncuts, llm_response_t *resp, tokens_t *tok)
+{
+    llm_stream_t s;
+    memset(resp, 0, sizeof(*resp));
+    memset(tok, 0, sizeof(*tok));
+    llm_stream_init(&s, e->format, resp, on_token, tok);
+
+    esp_err_t err = ESP_OK;
+    size_t from = 0;
+    for (int i = 0; i <= ncuts && err == ESP_OK; i++) {
+        size_t to = i < ncuts ? cuts[i] : len;
+        /* Copy each slice so reads past its end are caught */
+        char *slice = malloc(to - from + 1);
+        memcpy(slice, body + from, to - from);
+        err = llm_stream_feed(&s, slice, to - from);
+        free(slice);
+        from = to;
+    }
+    if (err == ESP_OK) err = llm_stream_finish(&s);
+    llm_stream_free(&s);
+    return err;
+}
+
+static void check_response(const expect_t *e, esp_err_t err, const llm_response_t *resp,
+                           const tokens_t *tok, const char *how)
+{
+    int before = host_test_failures;
+
+    CHECK((err == ESP_OK) == e->ok);
+    if (!e->ok) goto out;
+
+    CHECK_STR(resp->text, e->text);
+    CHECK(resp->text && resp->text_len == strlen(e->text));
+    CHECK_STR(tok->text, e->text);
+    CHECK(tok->count == e->tokens);
+    CHECK(resp->tool_use == e->tool_use);
+    CHECK(resp->call_count == e->call_count);
+    for (int i = 0; i < e->call_count && i < resp->call_count; i++) {
+        const llm_tool_call_t *call = &resp->calls[i];
+        CHECK_STR(call->id, e->calls[i].id);
+        CHECK_STR(call->name, e->calls[i].name);
+        CHECK_STR(call->input, e->calls[i].input);
+        CHECK(call->input && call->input_len == strlen(e->calls[i].input));
+    }
+
+out:
+    if (host_test_failures != before) fprintf(stderr, "  ^ %s, %s\n", e->file, how);
+}
+
+static void run(const expect_t *e, const char *body, size_t len,
+                const size_t *cuts, int ncuts, const char *how)
+{
+    llm_response_t resp;
+    tokens_t tok;
+    esp_err_t err = replay(e, body, len, cuts, ncuts, &resp, &tok);
+    check_response(e, err, &resp, &tok, how);
+    free_response(&resp);
+    free(tok.text);
+}
+
+static int cmp_size(const void *a, const void *b)
+{
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run_case(const expect_t *e)
+{
+    size_t len;
+    char *body = host_read_file(s_dir, e->file, &len);
+    char how[64];
+
+    run(e, body, len, NULL, 0, "whole stream");
+
+    for (size_t cut = 1; cut < len && host_test_failures < 20; cut++) {
+        snprintf(how, sizeof(how), "split at %u", (unsigned)cut);
+        run(e, body, len, &cut, 1, how);
+    }
+
+    size_t *cuts = malloc(len * sizeof(*cuts));
+    for (size_t i = 0; i + 1 < len; i++) cuts[i] = i + 1;
+    run(e, body, len, cuts, (int)len - 1, "byte by byte");
+
+    /* Random multi-way splits, reproducible */
+    srand(1234);
+    for (int round = 0; round < 200 && host_test_failures < 20; round++) {
+        int n = 2 + rand() % 30;
+        for (int i = 0; i < n; i++) cuts[i] = 1 + (size_t)rand() % (len - 1);
+        qsort(cuts, n, sizeof(*cuts), cmp_size);
+        snprintf(how, sizeof(how), "random split round %d", round);
+        run(e, body, len, cuts, n, how);
+    }
+    free(cuts);
+
+    /* Anthropic streams cut before message_stop never complete */
+    const char *stop = strstr(body, "event: message_stop");
+    if (e->ok && stop) {
+        llm_response_t resp;
+        tokens_t tok;
+        CHECK(replay(e, body, (size_t)(stop - body), NULL, 0, &resp, &tok) != ESP_OK);
+        free_response(&resp);
+        free(tok.text);
+    }
+
+    free(body);
+}
+
+int main(int argc, char **argv)
+{
+    s_dir = argc > 1 ? argv[1] : "fixtures/llm";
+    for (size_t i = 0; i < sizeof(s_cases) / sizeof(s_cases[0]); i++) {
+        run_case(&s_cases[i]);
+    }
+    return host_test_done("llm_stream");
+}
@@ -0,0 +1,285 @@
+/*
+ * session_log on a file-backed partition: append, clear, ring wrap-around,
+ * records torn by a power cut, and remounts (standing in for reboots)
+ * after each, checking that recovery rebuilds the same index.
+ */
+#include "host_test.h"
+#include "host_partition.h"
+#include "memory/session_log.h"
+#include "mimi_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LABEL       "sessions"
+#define BLOCKS      4
+#define ERASE_SIZE  4096
+#define PART_SIZE   (BLOCKS * MIMI_SESSION_LOG_BLOCK)
+
+static const char *s_path;
+
+typedef struct {
+    int   n;
+    char  role[64][12];
+    char *content[64];
+} seen_t;
+
+static void visit(const char *role, const char *content, void *ctx)
+{
+    seen_t *s = (seen_t *)ctx;
+    if (s->n >= 64) return;
+    snprintf(s->role[s->n], sizeof(s->role[0]), "%s", role);
+    s->content[s->n] = strdup(content);
+    s->n++;
+}
+
+static int history(const char *chat_id, int max, seen_t *s)
+{
+    for (int i = 0; i < s->n; i++) free(s->content[i]);
+    memset(s, 0, sizeof(*s));
+    int n = session_log_history(chat_id, max, visit, s);
+    CHECK(n == s->n);
+    return n;
+}
+
+static void seen_free(seen_t *s)
+{
+    for (int i = 0; i < s->n; i++) free(s->content[i]);
+    memset(s, 0, sizeof(*s));
+}
+
+static esp_err_t mount(void)
+{
+    CHECK(host_partition_open(LABEL, s_path, PART_SIZE, ERASE_SIZE) != NULL);
+    return session_log_mount(LABEL);
+}
+
+/* Power cycle: drop all RAM state, keep the flash file */
+static esp_err_t reboot(void)
+{
+    session_log_unmount();
+    host_partition_close();
+    return mount();
+}
+
+static void fresh(void)
+{
+    session_log_unmount();
+    host_partition_close();
+    remove(s_path);
+    CHECK(mount() == ESP_OK);
+}
+
+typedef struct {
+    char chat[32];
+    int  records;
+} listed_t;
+
+static void list_one(const char *chat_id, int records, void *ctx)
+{
+    listed_t *l = (listed_t *)ctx;
+    for (; l->chat[0]; l++) {}
+    snprintf(l->chat, sizeof(l->chat), "%s", chat_id);
+    l->records = records;
+}
+
+static int listed(const char *chat_id)
+{
+    listed_t l[16] = {0};
+    session_log_list(list_one, l);
+    for (int i = 0; l[i].chat[0]; i++) {
+        if (strcmp(l[i].chat, chat_id) == 0) return l[i].records;
+    }
+    return 0;
+}
+
+static void test_mount_errors(void)
+{
+    session_log_unmount();
+    host_partition_close();
+    CHECK(session_log_mount(LABEL) == ESP_ERR_NOT_FOUND);
+
+    /* One block leaves nothing to wrap into */
+    remove(s_path);
+    CHECK(host_partition_open(LABEL, s_path, MIMI_SESSION_LOG_BLOCK, ERASE_SIZE) != NULL);
+    CHECK(session_log_mount(LABEL) == ESP_ERR_INVALID_SIZE);
+    CHECK(session_log_append("a", "user", "x", 1) == ESP_ERR_INVALID_STATE);
+    host_partition_close();
+    remove(s_path);
+}
+
+static void test_append_clear_remount(void)
+{
+    seen_t s = {0};
+    unsigned erases = host_partition_erases();
+    fresh();
+    CHECK(host_partition_erases() - erases == MIMI_SESSION_LOG_BLOCK / ERASE_SIZE);
+    CHECK(history("a", 20, &s) == 0);
+
+    CHECK(session_log_append("a", "user", "hello", 100) == ESP_OK);
+    CHECK(session_log_append("b", "user", "b1", 101) == ESP_OK);
+    CHECK(session_log_append("a", "assistant", "hi there", 102) == ESP_OK);
+    CHECK(session_log_append("b", "assistant", "b2", 103) == ESP_OK);
+    CHECK(session_log_append("a", "user", "\xC2\xBFqu\xC3\xA9 tal?", 104) == ESP_OK);
+    CHECK(session_log_append("a", "", "no role", 105) == ESP_ERR_INVALID_ARG);
+
+    CHECK(history("a", 20, &s) == 3);
+    CHECK_STR(s.role[0], "user");
+    CHECK_STR(s.content[0], "hello");
+    CHECK_STR(s.role[1], "assistant");
+    CHECK_STR(s.content[1], "hi there");
+    CHECK_STR(s.content[2], "\xC2\xBFqu\xC3\xA9 tal?");
+    CHECK(history("a", 2, &s) == 2);
+    CHECK_STR(s.content[0], "hi there");
+
+    CHECK(session_log_clear("b") == ESP_OK);
+    CHECK(history("b", 20, &s) == 0);
+    CHECK(session_log_clear("b") == ESP_ERR_NOT_FOUND);
+    CHECK(session_log_clear("nobody") == ESP_ERR_NOT_FOUND);
+    CHECK(session_log_append("b", "user", "b3", 106) == ESP_OK);
+
+    /* The clear marker is replayed too */
+    CHECK(reboot() == ESP_OK);
+    CHECK(history("a", 20, &s) == 3);
+    CHECK_STR(s.content[2], "\xC2\xBFqu\xC3\xA9 tal?");
+    CHECK(history("b", 20, &s) == 1);
+    CHECK_STR(s.content[0], "b3");
+    CHECK(listed("a") == 3);
+    CHECK(listed("b") == 1);
+
+    /* Appends continue behind the recovered records */
+    erases = host_partition_erases();
+    CHECK(session_log_append("a", "assistant", "after reboot", 107) == ESP_OK);
+    CHECK(host_partition_erases() == erases);
+    CHECK(reboot() == ESP_OK);
+    CHECK(history("a", 20, &s) == 4);
+    CHECK_STR(s.content[3], "after reboot");
+    seen_free(&s);
+}
+
+static void test_index_cap_and_truncation(void)
+{
+    seen_t s = {0};
+    fresh();
+
+    char msg[16];
+    for (int i = 0; i < MIMI_SESSION_MAX_MSGS + 5; i++) {
+        snprintf(msg, sizeof(msg), "m%d", i);
+        CHECK(session_log_append("cap", (i & 1) ? "assistant" : "user", msg, i) == ESP_OK);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        CHECK(history("cap", 100, &s) == MIMI_SESSION_MAX_MSGS);
+        CHECK_STR(s.content[0], "m5");
+        CHECK_STR(s.content[MIMI_SESSION_MAX_MSGS - 1], "m24");
+        CHECK(reboot() == ESP_OK);
+    }
+
+    /* A message larger than a block is cut to what one record can hold */
+    size_t big = MIMI_SESSION_LOG_BLOCK + 100;
+    char *text = malloc(big + 1);
+    memset(text, 'x', big);
+    text[big] = '\0';
+    CHECK(session_log_append("big", "user", text, 1) == ESP_OK);
+    CHECK(session_log_append("big", "user", "next", 2) == ESP_OK);
+    CHECK(reboot() == ESP_OK);
+    CHECK(history("big", 20, &s) == 2);
+    size_t max_content = MIMI_SESSION_LOG_BLOCK - 8 - 8 - 6 - strlen("user") - strlen("big");
+    CHECK(s.content[0] && strlen(s.content[0]) == max_content);
+    CHECK_STR(s.content[1], "next");
+    free(text);
+    seen_free(&s);
+}
+
+static void test_torn_records(void)
+{
+    seen_t s = {0};
+    fresh();
+    CHECK(session_log_append("t", "user", "one", 1) == ESP_OK);
+    CHECK(session_log_append("t", "assistant", "two", 2) == ESP_OK);
+
+    /* Power lost mid-record: header and part of the payload reach flash */
+    host_partition_tear_next_write(12);
+    CHECK(session_log_append("t", "user", "torn record", 3) != ESP_OK);
+    CHECK(reboot() == ESP_OK);
+    CHECK(history("t", 20, &s) == 2);
+    CHECK_STR(s.content[1], "two");
+
+    /* Recovery abandoned the rest of that block: the next append starts a new one */
+    unsigned erases = host_partition_erases();
+    CHECK(session_log_append("t", "user", "three", 4) == ESP_OK);
+    CHECK(host_partition_erases() - erases == MIMI_SESSION_LOG_BLOCK / ERASE_SIZE);
+    CHECK(reboot() == ESP_OK);
+    CHECK(history("t", 20, &s) == 3);
+    CHECK_STR(s.content[2], "three");
+
+    /* Torn header, no reboot: the failed write also moves on to a new block */
+    host_partition_tear_next_write(2);
+    CHECK(session_log_append("t", "assistant", "torn again", 5) != ESP_OK);
+    erases = host_partition_erases();
+    CHECK(session_log_append("t", "assistant", "four", 6) == ESP_OK);
+    CHECK(host_partition_erases() - erases == MIMI_SESSION_LOG_BLOCK / ERASE_SIZE);
+    CHECK(reboot() == ESP_OK);
+    CHECK(history("t", 20, &s) == 4);
+    CHECK_STR(s.content[0], "one");
+    CHECK_STR(s.content[3], "four");
+    seen_free(&s);
+}
+
+/*
+ * With 16 KB blocks and 3000-byte messages, five records fit per block.
+ * Block 1 holds "old" and w-0..w-4, block 2 w-5..w-9, and so on: 32 records
+ * need seven blocks, so blocks 1-3 are erased by wrap-around and w-15..w-31
+ * are left. The index still holds positions of w-12..w-14 in erased blocks;
+ * history must skip them.
+ */
+_Static_assert(MIMI_SESSION_LOG_BLOCK == 16 * 1024, "wrap test assumes 16 KB blocks");
+
+static void test_wrap(void)
+{
+    seen_t s = {0};
+    fresh();
+    CHECK(session_log_append("old", "user", "ancient", 1) == ESP_OK);
+
+    char *msg = malloc(3001);
+    for (int i = 0; i < 32; i++) {
+        memset(msg, '.', 3000);
+        msg[3000] = '\0';
+        int n = snprintf(msg, 3000, "w-%04d", i);
+        msg[n] = ' ';
+        CHECK(session_log_append("w", "user", msg, 10 + i) == ESP_OK);
+    }
+    free(msg);
+
+    for (int pass = 0; pass < 2; pass++) {
+        CHECK(history("old", 20, &s) == 0);
+        CHECK(listed("old") == 0);
+        CHECK(history("w", MIMI_SESSION_MAX_MSGS, &s) == 17);
+        CHECK(listed("w") == 17);
+        CHECK(s.content[0] && strncmp(s.content[0], "w-0015", 6) == 0);
+        CHECK(s.content[16] && strncmp(s.content[16], "w-0031", 6) == 0);
+        CHECK(s.content[16] && strlen(s.content[16]) == 3000);
+        CHECK(reboot() == ESP_OK);
+    }
+
+    CHECK(session_log_append("w", "assistant", "still going", 99) == ESP_OK);
+    CHECK(reboot() == ESP_OK);
+    CHECK(history("w", MIMI_SESSION_MAX_MSGS, &s) == 18);
+    CHECK_STR(s.content[17], "still going");
+    seen_free(&s);
+}
+
+int main(int argc, char **argv)
+{
+    s_path = argc > 1 ? argv[1] : "session_log.bin";
+
+    test_mount_errors();
+    test_append_clear_remount();
+    test_index_cap_and_truncation();
+    test_torn_records();
+    test_wrap();
+
+    session_log_unmount();
+    host_partition_close();
+    remove(s_path);
+    return host_test_done("session_log");
+}
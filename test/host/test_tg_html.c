@@ -0,0 +1,104 @@
+/*
+ * Runs Markdown through tg_html at several chunk sizes and checks every
+ * chunk: it validates, fits the limit, and the source slices handed out
+ * with the chunks are consecutive and add up to the whole input (what
+ * post_html falls back to when a chunk fails validation).
+ */
+#include "host_test.h"
+#include "telegram/tg_html.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *md;
+    size_t      max;
+    size_t      next;       /* source offset the next slice must start at */
+    int         chunks;
+    char        html[4096]; /* concatenated chunks, while they fit */
+    size_t      html_len;
+} run_t;
+
+static esp_err_t on_chunk(const char *html, size_t len, const char *src, size_t src_len,
+                          void *ctx)
+{
+    run_t *r = (run_t *)ctx;
+    r->chunks++;
+    CHECK(len <= r->max);
+    CHECK(strlen(html) == len);
+    CHECK(tg_html_validate(html, len));
+    CHECK(src == r->md + r->next);
+    r->next += src_len;
+
+    if (r->html_len + len < sizeof(r->html)) {
+        memcpy(r->html + r->html_len, html, len);
+        r->html_len += len;
+        r->html[r->html_len] = '\0';
+    }
+    return ESP_OK;
+}
+
+static run_t *convert(const char *md, size_t max)
+{
+    run_t *r = calloc(1, sizeof(*r));
+    r->md = md;
+    r->max = max;
+    CHECK(tg_html_from_markdown(md, strlen(md), max, on_chunk, r) == ESP_OK);
+    CHECK(r->next == strlen(md));
+    return r;
+}
+
+static void test_single_chunk(void)
+{
+    const char *md = "# Title\n**bold** and *it* with `a<b` & [link](https://x.io/?a=1&b=2)\n"
+                     "- item\n> quote\n```c\nint x = 1 < 2;\n```\n";
+    run_t *r = convert(md, 1024);
+    CHECK(r->chunks == 1);
+    CHECK_STR(r->html,
+              "<b>Title</b>\n<b>bold</b> and <i>it</i> with <code>a&lt;b</code> &amp; "
+              "<a href=\"https://x.io/?a=1&amp;b=2\">link</a>\n"
+              "\xE2\x80\xA2 item\n<blockquote>quote\n</blockquote>"
+              "<pre><code class=\"language-c\">int x = 1 &lt; 2;</code></pre>\n");
+    free(r);
+}
+
+/* A long reply with formatting, code and multi-byte text, cut many ways */
+static void test_split(void)
+{
+    size_t cap = 64 * 1024;
+    char *md = malloc(cap);
+    size_t n = 0;
+    for (int i = 0; i < 150; i++) {
+        n += snprintf(md + n, cap - n,
+                      "%d. **Step %d** \xE2\x80\x94 see [docs](https://example.com/%d) & "
+                      "use `cmd --flag=%d` \xF0\x9F\x98\x80 a\\*b\n", i, i, i, i);
+        if (i % 25 == 0) {
+            n += snprintf(md + n, cap - n, "```\nline <%d>\n\nmore & more\n```\n", i);
+        }
+        if (i % 40 == 0) n += snprintf(md + n, cap - n, "> quoted %d\n\n", i);
+    }
+
+    static const size_t sizes[] = { 1024, 1500, 2048, 4096 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        run_t *r = convert(md, sizes[s]);
+        CHECK(r->chunks > 1);
+        free(r);
+    }
+    free(md);
+}
+
+/* Whitespace-only chunks are skipped; their source joins the next slice */
+static void test_whitespace(void)
+{
+    run_t *r = convert("\n\n   \nhello\n", 1024);
+    CHECK(r->chunks == 1);
+    free(r);
+}
+
+int main(void)
+{
+    test_single_chunk();
+    test_split();
+    test_whitespace();
+    return host_test_done("tg_html");
+}